@@ -2,10 +2,16 @@
 #include <I2Cdev.h>
 #include <ADXL345.h>
 #include <Wire.h>
+#include <SensorFrame.h>
+#include <SensorScale.h>
+#include <SensorConfig.h>
+#include <SensorCalibration.h>
+#include <EnergyMeter.h>
+#include <SpscRing.h>
+#include <SerialTxQueue.h>
 #include<Arduino_FreeRTOS.h>
 #include<task.h>
 #include<avr/io.h>
-#include<semphr.h>
 #define STACK_SIZE 200
 #include<stdio.h>
 #include<stdlib.h>
@@ -16,95 +22,82 @@
 #define TO_READ (6)        //num of bytes we are going to read each time
 #define voltageDividerPin 0
 #define currentSensorPin 1
-#define RS 0.1
-#define RL 10000
+#define I2C_CLOCK_KHZ 400 //both ADXL345 and the MPU6050 support fast mode
+#define ENERGY_REPORT_PERIOD_MS 0 //how often packet.power and packet.energy are refreshed (power is the mean over the period), 0 for every sample
+#define PACKET_RING_SIZE 8 //packets buffered between collectData and sendToPi, power of two
+#define SAMPLE_SIZE (9 * 2 + 2 * 2 + 2 * 4) // bytes per sample in a frame: 9 raw int16 IMU values, 2 uint16 and 2 uint32 for power
+#define FRAME_SAMPLES 1 //samples in every SAMPLES frame, each goes out in the tick it was read
+#define CALIBRATION_SAMPLES 200 //readings averaged per offset trial, about 8 trials
+#define SAMPLE_TICKS 10 //collectData period
+//Same handshake as mega.ino: before 'H' the Pi can ask who it talks to with COMMAND_HELLO, and gets a
+//HELLO frame (SensorFrame.h). This sketch has one fixed session, COMMAND_SESSION only accepts that one
+#define FIRMWARE_VERSION 0x0100 //major << 8 | minor
+#define COMMAND_HELLO 'V'
+#define COMMAND_SESSION 'S'
+#define SESSION_LENGTH 7 //bytes after COMMAND_SESSION: divider, samples per frame, framing, 4 channel dividers
+#define SESSION_TIMEOUT_MS 100
 
 ADXL345 sensorA = ADXL345(DEVICE_A_ACCEL);
 ADXL345 sensorB = ADXL345(DEVICE_B_ACCEL);
 MPU6050 sensorC = MPU6050(DEVICE_C_GYRO);
 
-//determining scale factor based on range set
-//Since range in +-2g, range is 4mg/LSB.
-//value of 1023 is used because ADC is 10 bit
-int rangeAccel = (2-(-2));
-const float scaleFactorAccel = rangeAccel/1023.0;
+//Sensor ranges and rates, applied in calibrateSensors(). Scale factors follow from these (SensorConfig.h)
+typedef Adxl345Config<ADXL345_RANGE_2G, ADXL345_RATE_100> AccelConfig;
+typedef Mpu6050Config<MPU6050_GYRO_FS_250, MPU6050_ACCEL_FS_2, MPU6050_DLPF_BW_256, 0> MotionConfig; //as initialize() leaves it
 
 /*
- * +-250degrees/second already set initialize() function
- * value of 65535 is used due to 16 bit ADC
- */ 
-//determining the scale factor for gyroscope
-int rangeGyro = 250-(-250);
-const float scaleFactorGyro = rangeGyro/65535.0; 
+ * Accelerometer and gyroscope readings are sent as 16-bit counts, zeroed by the offset registers calibrateSensors() programs.
+ * Scaling to g and degrees/second is done on the Pi (serial_frames.py).
+ * Power readings are scaled to integer mV, uA, uW and uJ with SensorScale.h.
+ */
  
-//declaring variable to store value of volt and amps
-    float vOut;
-    float voltageReading;
-    float currentReading;
-
-//16 bit integer values for raw data of accelerometers
-int16_t xa_raw, ya_raw, za_raw, xb_raw, yb_raw, zb_raw;
-
-//16 bit integer values for offset data of accelerometers
-int16_t xa_offset, ya_offset, za_offset, xb_offset, yb_offset, zb_offset;
-
-//Float values for scaled factors of accelerometers
-float xa, ya, za, xb, yb, zb;
-
-//16 bit integer values for gyroscope readings
-int16_t xg_raw, yg_raw, zg_raw;
-
-//16 bit integer values for offset data of gyroscope
-int16_t xg_offset, yg_offset, zg_offset;
-
-//Float values for scaled values of gyroscopes
-float xg, yg, zg;
+//raw ADC counts of the voltage divider and the current sensor
+    uint16_t voltageReading;
+    uint16_t currentReading;
 
 //Structure of data packet
 typedef struct Packet {
-  float gyro[3];
-  float acc1[3];
-  float acc2[3];
-  float power;
-  float current;
-  float voltage;
-  float energy;
-} Packet;   //Size of packet is 60 (15 of 4 bytes)
-
-Packet packet;
-
-char* acc1_x;
-char* acc1_y;
-char* acc1_z;
-char* acc2_x;
-char* acc2_y;
-char* acc2_z;
-char* gyro_x;
-char* gyro_y;
-char* gyro_z;
-char* voltage_c;
-char* current_c;
-char* power_c;
-char* energy_c;
-
-int test_flag = 0;
-int dataReady = 0;
-char databuf[3000];
+  int16_t gyro[3];
+  int16_t acc1[3];
+  int16_t acc2[3];
+  uint32_t power;   //uW
+  uint16_t current; //uA
+  uint16_t voltage; //mV
+  uint32_t energy;  //uJ since the first sample, low 32 bits
+} Packet;   //Size of packet is 30 (11 of 2 bytes, 2 of 4 bytes)
+
+Packet packet; //filled by collectData only
+EnergyMeter energyMeter(ENERGY_REPORT_PERIOD_MS * 1000UL);
+
+//Packets go from collectData to sendToPi through the ring, so a slow UART write never blocks sampling
+SpscRing<Packet, PACKET_RING_SIZE> packetRing;
+uint16_t reportedOverruns = 0;
+
+//Binary frame sent to the Pi, built by sendToPi only
+SensorFrame frame;
+uint16_t frameSequence = 0;
+
+//the only session sendToPi sends: every sample, FRAME_SAMPLES per SAMPLES frame
+const uint8_t fixedSession[SESSION_LENGTH] = { 1, FRAME_SAMPLES, SENSORFRAME_FRAMING_SAMPLES, 0, 0, 0, 0 };
+uint8_t sessionStatus = SENSORFRAME_SESSION_ACCEPTED;
 
 //Function prototypes
-float remapVoltage(int);
 void calibrateSensors();
 void getScaledReadings();
-void printSensorReadings();
+void packSample(const Packet *sample);
 void sendToPi(void *p);
 
-SemaphoreHandle_t taskSemaphore =  xSemaphoreCreateMutex();
-
 void setup()
 {
-  Wire.begin();        // join i2c bus (address optional for master)
+  // join i2c bus as master at I2C_CLOCK_KHZ
+  #if I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE
+    Wire.begin();
+    Wire.setClock(I2C_CLOCK_KHZ * 1000L);
+  #elif I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+    Fastwire::setup(I2C_CLOCK_KHZ, true);
+  #endif
   Serial.begin(115200);  // start serial for output
-  Serial1.begin(115200); //serial for gpio connection between Mega and Rpi
+  SerialTxQueue::begin(115200); //serial for gpio connection between Mega and Rpi, frames sent from its interrupt
   
   // Initializing sensors 
   sensorA.initialize();
@@ -139,25 +132,73 @@ void handshake() {
   int n_flag = 0;
 
   while (h_flag == 0) {
-    if (Serial1.available()) {
-      if ((Serial1.read() == 'H')) {
-        h_flag = 1;
+    if (SerialTxQueue::available()) {
+      switch (SerialTxQueue::read()) {
+        case 'H':
+          h_flag = 1;
+          SerialTxQueue::write('A');
+          break;
+        case COMMAND_HELLO:
+          sendHello();
+          break;
+        case COMMAND_SESSION:
+          receiveSession();
+          sendHello();
+          break;
       }
     }
   }
 
   while (n_flag == 0) {
-    if (Serial1.available()) {
-      Serial1.write('A');
-      if (Serial1.read() == 'N') {
+    if (SerialTxQueue::available()) {
+      if (SerialTxQueue::read() == 'N') {
         Serial.println("Handshake done");
         n_flag = 1;
       }
+      else {
+        SerialTxQueue::write('A');
+      }
     }
   }
 
 }
 
+/**
+ * Answer COMMAND_HELLO or COMMAND_SESSION with a HELLO frame. No capabilities: no rate
+ * divider, delta coding, channels, resends or stored offsets in this sketch
+ */
+void sendHello() {
+  uint8_t n;
+
+  frame.begin(SENSORFRAME_TYPE_HELLO, frameSequence++);
+  frame.putByte(SENSORFRAME_HANDSHAKE_VERSION);
+  frame.putUInt16(FIRMWARE_VERSION);
+  frame.putByte(0); //polled, as ACQ_POLL in mega.ino
+  frame.putUInt16(0);
+  frame.putByte(SAMPLE_TICKS * portTICK_PERIOD_MS);
+  frame.putByte(SENSORFRAME_MAX_PAYLOAD / SAMPLE_SIZE);
+  frame.putByte(sessionStatus);
+  for (n = 0; n < SESSION_LENGTH; n++) frame.putByte(fixedSession[n]);
+  frame.finish();
+  SerialTxQueue::enqueue(frame.getData(), frame.getLength());
+}
+
+/**
+ * Read the session after COMMAND_SESSION, only fixedSession is accepted
+ */
+void receiveSession() {
+  uint8_t settings[SESSION_LENGTH];
+  uint8_t received = 0;
+  uint32_t start = millis();
+
+  while (received < SESSION_LENGTH) {
+    if (SerialTxQueue::available()) settings[received++] = SerialTxQueue::read();
+    else if (millis() - start > SESSION_TIMEOUT_MS) break;
+  }
+  sessionStatus = received == SESSION_LENGTH && memcmp(settings, fixedSession, SESSION_LENGTH) == 0
+                ? SENSORFRAME_SESSION_ACCEPTED : SENSORFRAME_SESSION_UNSUPPORTED;
+}
+
 /**
  *  To collect readings from all the sensor and package into one packet every 20ms
  */
@@ -166,177 +207,103 @@ void collectData(void *p){
   static TickType_t xLastWakeTime = xTaskGetTickCount();
   while (1)
   {
-    if (xSemaphoreTake(taskSemaphore, (TickType_t)portMAX_DELAY) == pdTRUE)
-    {
-      // Read values from different sensors
-      getScaledReadings();
+    // Read values from different sensors
+    getScaledReadings();
     
-      //Measure and display voltage measured from voltage divider
-      voltageReading = analogRead(voltageDividerPin);
-      packet.voltage = remapVoltage(voltageReading) * 2;
-
-
-      //Measure voltage out from current sensor to calculate current
-      vOut = analogRead(currentSensorPin);
-      vOut = remapVoltage(vOut);
-      packet.current = (vOut * 1000) / (RS * RL) * 1000;
-
-      //Power is in mW due to current being in mA
-      packet.power = packet.current * packet.voltage;
-
-      static long prevTime = 0;
-      float secondsPassed = (millis()-prevTime) / (1000.0);
-
-      static float energy = 0;
-      //Power / 1000.0 because converting mW to W
-      //This allows joules to  be in W per seconds
-      energy += secondsPassed * (packet.power /1000.0);
-
-      prevTime = millis();
+    //Measure voltage from voltage divider and current from the current sensor output
+    voltageReading = analogRead(voltageDividerPin);
+    currentReading = analogRead(currentSensorPin);
+    packet.voltage = sensorScaleVoltage(voltageReading);
+    packet.current = sensorScaleCurrent(currentReading);
+
+    if (energyMeter.update(sensorScalePower(packet.voltage, packet.current), micros())) {
+      packet.power = energyMeter.getReportedPower();
+      packet.energy = (uint32_t)energyMeter.getReportedEnergy(); //wraps after 4295J, the Pi unwraps it
+    }
 
-      packet.energy = energy;
+    //Never waits: if sendToPi has fallen behind the packet is dropped and counted
+    packetRing.push(packet);
 
-      xSemaphoreGive(taskSemaphore);      
-    }
-    vTaskDelayUntil(&xLastWakeTime, 10);
+    vTaskDelayUntil(&xLastWakeTime, SAMPLE_TICKS);
   }
 }
 
- /*
- * Data processing
- */
-float remapVoltage(int volt) {
-  float analogToDigital;
-  analogToDigital = (5.0/1023) * volt;  
-  return analogToDigital;
-}
-
-
 /*
- * To process the raw data obtained from sensor reading
+ * To read the sensors into the packet. The offset registers already zero the readings
  */
 void getScaledReadings() {
-  sensorA.getAcceleration(&xa_raw, &ya_raw, &za_raw);
-  packet.acc1[0] = (xa_raw + xa_offset)*scaleFactorAccel;
-  packet.acc1[1] = (ya_raw + ya_offset)*scaleFactorAccel;
-  packet.acc1[2] = (za_raw + za_offset)*scaleFactorAccel;
-  
-  sensorB.getAcceleration(&xb_raw, &yb_raw, &zb_raw);
-  packet.acc2[0] = (xb_raw + xb_offset)*scaleFactorAccel;
-  packet.acc2[1] = (yb_raw + yb_offset)*scaleFactorAccel;
-  packet.acc2[2] = (zb_raw + zb_offset)*scaleFactorAccel;
-  
-  sensorC.getRotation(&xg_raw, &yg_raw, &zg_raw);
-  packet.gyro[0] = (xg_raw + xg_offset)*scaleFactorGyro;
-  packet.gyro[1]= (yg_raw + yg_offset)*scaleFactorGyro;
-  packet.gyro[2] = (zg_raw + zg_offset)*scaleFactorGyro;
+  sensorA.getAcceleration(&packet.acc1[0], &packet.acc1[1], &packet.acc1[2]);
+  sensorB.getAcceleration(&packet.acc2[0], &packet.acc2[1], &packet.acc2[2]);
+  sensorC.getRotation(&packet.gyro[0], &packet.gyro[1], &packet.gyro[2]);
  }
 
 
 /*
- * Purpose of adding 255 is to account for downward default acceleration in Z axis to be 1g
+ * Set ranges and rates, then program the offset registers so the sensors read 0 on every axis
+ * but Z, which reads 1g (AccelConfig::countsPerG). The device must lie still and level meanwhile.
+ * Each trial averages CALIBRATION_SAMPLES readings (SensorCalibration.h).
  */
 void calibrateSensors() {
-  //Setting range of ADXL345
-  sensorA.setRange(ADXL345_RANGE_2G);
-  sensorB.setRange(ADXL345_RANGE_2G);
-  
-  sensorA.getAcceleration(&xa_raw, &ya_raw, &za_raw);
-  sensorB.getAcceleration(&xb_raw, &yb_raw, &zb_raw);
-  sensorC.getRotation(&xg_raw, &yg_raw, &zg_raw);
-  
-  xa_offset = -xa_raw;
-  ya_offset = -ya_raw;
-  za_offset = -za_raw+255;
-
-  xb_offset = -xb_raw;
-  yb_offset = -yb_raw;
-  zb_offset = -zb_raw+255;
-
-  xg_offset = -xg_raw;
-  yg_offset = -yg_raw;
-  zg_offset = -zg_raw;
+  //Setting ranges and rates of the sensors
+  AccelConfig::apply(sensorA);
+  AccelConfig::apply(sensorB);
+  MotionConfig::apply(sensorC);
+
+  Adxl345Calibration calibrationA(sensorA, AccelConfig::range);
+  Adxl345Calibration calibrationB(sensorB, AccelConfig::range);
+  Mpu6050Calibration calibrationC(sensorC, MotionConfig::gyroRange, MotionConfig::accelRange);
+  OffsetCalibration *calibrations[] = { &calibrationA, &calibrationB, &calibrationC };
+
+  Serial.println("Calibrating, keep the device still and level");
+  //one new ADXL345 reading per output period
+  OffsetCalibration::run(calibrations, 3, CALIBRATION_SAMPLES, 1000000UL / AccelConfig::rateMilliHz);
+  Serial.println("Calibration done");
 }
 
 
-/** 
- Change the format of the data from float to string
+/**
+ * Append one packet to the frame as a binary sample.
+ * Field order matches mega.ino: acc1, acc2, gyro, voltage, current, power, energy
  */
-void changeFormat(){
-char charbuf[100] ;
-
-  acc1_x = dtostrf( packet.acc1[0],3,2,charbuf);
-  strcat(databuf, acc1_x); 
-  strcat(databuf, ",");
-  acc1_y = dtostrf(packet.acc1[1],3,2,charbuf);
-  strcat(databuf, acc1_y); 
-  strcat(databuf, ",");
-  acc1_z = dtostrf(packet.acc1[2],3,2,charbuf);
-  strcat(databuf, acc1_z); 
-  strcat(databuf, ",");
-
-  acc2_x = dtostrf(packet.acc2[0],3,2,charbuf);
-  strcat(databuf, acc2_x); 
-  strcat(databuf, ",");
-  acc2_y = dtostrf(packet.acc2[1],3,2,charbuf);
-  strcat(databuf, acc2_y); 
-  strcat(databuf, ",");
-  acc2_z = dtostrf(packet.acc2[2],3,2,charbuf);
-  strcat(databuf, acc2_z); 
-  strcat(databuf, ",");
-
-  gyro_x = dtostrf(packet.gyro[0],3,2,charbuf);
-  strcat(databuf, gyro_x); 
-  strcat(databuf, ",");
-  gyro_y = dtostrf( packet.gyro[1],3,2,charbuf);
-  strcat(databuf, gyro_y); 
-  strcat(databuf, ",");
-  gyro_z = dtostrf(packet.gyro[2],3,2,charbuf);
-  strcat(databuf, gyro_z); 
-  strcat(databuf, ",");
-
-  voltage_c = dtostrf(packet.voltage,3,2,charbuf);
-  strcat(databuf,  voltage_c); 
-  strcat(databuf, ",");
-  current_c = dtostrf( packet.current,3,2,charbuf);
-  strcat(databuf, current_c); 
-  strcat(databuf, ",");
-  power_c = dtostrf( packet.power,3,2,charbuf);
-  strcat(databuf, power_c ); 
-  strcat(databuf, ",");
-  
-  energy_c = dtostrf( packet.energy,3,2,charbuf);
-  strcat(databuf, energy_c  ); 
-  strcat(databuf, ",");
- }
+void packSample(const Packet *sample) {
+  uint8_t axis;
+
+  for (axis = 0; axis < 3; axis++) frame.putInt16(sample->acc1[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putInt16(sample->acc2[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putInt16(sample->gyro[axis]);
+
+  frame.putUInt16(sample->voltage);
+  frame.putUInt16(sample->current);
+  frame.putUInt32(sample->power);
+  frame.putUInt32(sample->energy);
+}
  
  
  /** 
  *To send to Pi once Pi is ready for communication
- *Packet is of Type float (4 bytes) thus one packet contains 15 values, a total of 60 bytes
- * A sample of 20 packets will be sent to Rpi every 200ms
+ *Every packet collectData has queued goes out as its own SensorFrame frame,
+ *as the HELLO frame tells the Pi. SerialTxQueue takes the frame and returns
+ *at once, its interrupt sends it while the tasks go on
  */
  void sendToPi(void *p) {
   static TickType_t xLastWakeTime = xTaskGetTickCount();
+  Packet sample;
+
   while (1)
   {
-    if (xSemaphoreTake(taskSemaphore, (TickType_t)portMAX_DELAY) == pdTRUE)
-    {
-      changeFormat();
-      strcat(databuf, "\r");
-      int len = strlen(databuf);
-
-      Serial.println();
-       
-      for (int i = 0; i < len; i++) {
-        Serial.print(databuf[i]);
-        Serial1.write(databuf[i]);
-        strcpy(databuf, "");
-      }
-      xSemaphoreGive(taskSemaphore);      
+    while (packetRing.pop(&sample)) {
+      frame.begin(SENSORFRAME_TYPE_SAMPLES, frameSequence++);
+      packSample(&sample);
+      frame.finish();
+      SerialTxQueue::enqueue(frame.getData(), frame.getLength()); //dropped and counted if the link is backed up
+    }
+
+    uint16_t overruns = packetRing.getOverrunCount();
+    if (overruns != reportedOverruns) {
+      Serial.print("Packets dropped: ");
+      Serial.println(overruns);
+      reportedOverruns = overruns;
     }
-    vTaskDelayUntil(&xLastWakeTime, 20);
+    vTaskDelayUntil(&xLastWakeTime, SAMPLE_TICKS); //runs after collectData, which has the higher priority
   }
 }
- 
-
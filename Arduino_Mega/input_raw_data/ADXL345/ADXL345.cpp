@@ -1363,6 +1363,16 @@ uint8_t ADXL345::getIntOverrunSource() {
     I2Cdev::readBit(devAddr, ADXL345_RA_INT_SOURCE, ADXL345_INT_OVERRUN_BIT, buffer);
     return buffer[0];
 }
+/** Get all interrupt source flags in one read.
+ * Reading INT_SOURCE clears the latched flags, so the single-bit getters
+ * above lose every flag but the one they return; use this to test several.
+ * @return INT_SOURCE register, one bit per ADXL345_INT_*_BIT
+ * @see ADXL345_RA_INT_SOURCE
+ */
+uint8_t ADXL345::getIntSource() {
+    I2Cdev::readByte(devAddr, ADXL345_RA_INT_SOURCE, buffer);
+    return buffer[0];
+}
 
 // DATA_FORMAT register
 
@@ -1666,3 +1676,25 @@ uint8_t ADXL345::getFIFOLength() {
     I2Cdev::readBits(devAddr, ADXL345_RA_FIFO_STATUS, ADXL345_FIFOSTAT_LENGTH_BIT, ADXL345_FIFOSTAT_LENGTH_LENGTH, buffer);
     return buffer[0];
 }
+/** Drain entries from FIFO.
+ * Each entry is popped with one 6-byte read of DATAX0 through DATAZ1, so the
+ * X, Y and Z values of an entry always belong together. The datasheet asks
+ * for 5us between the end of one read and the start of the next; the I2C
+ * address and register bytes of the next transaction already take longer
+ * than that at 400kHz. Use getFIFOLength() to find out how many entries are
+ * waiting.
+ * @param xyz Array of at least 3 * count values, filled as x, y, z per entry
+ * @param count Number of entries to read
+ * @return Number of entries actually read (less than count on a bus error)
+ * @see ADXL345_RA_DATAX0
+ * @see getFIFOLength()
+ */
+uint8_t ADXL345::getFIFOAccelerations(int16_t* xyz, uint8_t count) {
+    for (uint8_t entry = 0; entry < count; entry++) {
+        if (I2Cdev::readBytes(devAddr, ADXL345_RA_DATAX0, 6, buffer) != 6) return entry;
+        *xyz++ = (((int16_t)buffer[1]) << 8) | buffer[0];
+        *xyz++ = (((int16_t)buffer[3]) << 8) | buffer[2];
+        *xyz++ = (((int16_t)buffer[5]) << 8) | buffer[4];
+    }
+    return count;
+}
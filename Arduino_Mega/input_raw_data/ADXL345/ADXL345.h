@@ -320,6 +320,7 @@ class ADXL345 {
         uint8_t getIntFreefallSource();
         uint8_t getIntWatermarkSource();
         uint8_t getIntOverrunSource();
+        uint8_t getIntSource();
         
         // DATA_FORMAT register
         uint8_t getSelfTestEnabled();
@@ -352,6 +353,7 @@ class ADXL345 {
         // FIFO_STATUS register
         bool getFIFOTriggerOccurred();
         uint8_t getFIFOLength();
+        uint8_t getFIFOAccelerations(int16_t* xyz, uint8_t count);
 
     private:
         uint8_t devAddr;
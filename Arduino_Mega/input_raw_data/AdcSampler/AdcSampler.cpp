@@ -0,0 +1,156 @@
+// AdcSampler - interrupt driven, oversampling ADC reader
+// See AdcSampler.h for an overview.
+
+#include "AdcSampler.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#if ADCSAMPLER_MAX_SAMPLES < 2 || ADCSAMPLER_MAX_SAMPLES > 32768
+#error "ADCSAMPLER_MAX_SAMPLES must be from 2 to 32768 so the per-channel count fits in 16 bits"
+#endif
+
+typedef struct Accumulator {
+    uint32_t sum;
+    uint16_t count;
+} Accumulator;
+
+// Shared with the ISR. The task side only touches an accumulator with
+// interrupts off, and reads the channel list only before the ADC starts.
+static uint8_t channelList[ADCSAMPLER_MAX_CHANNELS];
+static uint8_t channelCount = 0;
+static bool pipelined = false;
+static volatile Accumulator accumulators[ADCSAMPLER_MAX_CHANNELS];
+static volatile uint8_t running = 0;    // slot of the conversion in progress (free running only)
+static volatile uint8_t selected = 0;   // slot the multiplexer points at
+static volatile uint32_t conversions = 0;
+static uint16_t lastMean[ADCSAMPLER_MAX_CHANNELS];
+
+/** Point the multiplexer at an analog input, AVcc reference like analogRead().
+ * @param channel Analog input number (0 for A0 ...)
+ */
+static inline void selectChannel(uint8_t channel) {
+#ifdef MUX5
+    if (channel >= 8) ADCSRB |= _BV(MUX5);
+    else              ADCSRB &= ~_BV(MUX5);
+#endif
+    ADMUX = _BV(REFS0) | (channel & 0x07);
+}
+
+/** Start converting the given analog inputs in turn.
+ * The digital input buffers of the pins are switched off, they only waste
+ * power on an analog level.
+ * @param channels Analog input numbers (0 for A0 ...), read() takes their index
+ * @param count Number of channels, 1 to ADCSAMPLER_MAX_CHANNELS
+ * @param trigger ADCSAMPLER_FREE_RUNNING or ADCSAMPLER_TIMER0
+ * @return False if count is out of range (nothing is started)
+ */
+bool AdcSampler::begin(const uint8_t *channels, uint8_t count, uint8_t trigger) {
+    if (count == 0 || count > ADCSAMPLER_MAX_CHANNELS) return false;
+
+    end();
+    for (uint8_t slot = 0; slot < count; slot++) {
+        channelList[slot] = channels[slot];
+        accumulators[slot].sum = 0;
+        accumulators[slot].count = 0;
+        lastMean[slot] = 0;
+        if (channels[slot] < 8) DIDR0 |= _BV(channels[slot]);
+#ifdef DIDR2
+        else DIDR2 |= _BV(channels[slot] - 8);
+#endif
+    }
+    channelCount = count;
+    pipelined = trigger == ADCSAMPLER_FREE_RUNNING;
+    running = 0;
+    selected = 0;
+    conversions = 0;
+
+    selectChannel(channelList[0]);
+    // auto trigger source: 0 = free running, 4 = Timer0 overflow
+    ADCSRB = (ADCSRB & ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0))) | (trigger == ADCSAMPLER_TIMER0 ? _BV(ADTS2) : 0);
+    // ADC clock F_CPU / 128, the only prescaler keeping 16MHz within the 200kHz full-resolution limit
+    ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0)
+           | (pipelined ? _BV(ADSC) : 0);
+    return true;
+}
+
+/** Stop the ADC and its interrupt. analogRead() works again afterwards.
+ */
+void AdcSampler::end() {
+    ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+    while (ADCSRA & _BV(ADSC)); // let a conversion in progress finish
+    ADCSRA |= _BV(ADIF);
+    ADCSRB &= ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0));
+}
+
+/** Get the mean of the conversions on a channel since the previous call, and start a new one.
+ * Never waits. If nothing was converted in between, the previous mean is returned again.
+ * @param slot Index of the channel in the list given to begin()
+ * @return Mean reading in ADC counts (0 to 1023)
+ */
+uint16_t AdcSampler::read(uint8_t slot) {
+    uint32_t sum;
+    uint16_t count;
+
+    if (slot >= channelCount) return 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sum = accumulators[slot].sum;
+        count = accumulators[slot].count;
+        accumulators[slot].sum = 0;
+        accumulators[slot].count = 0;
+    }
+    if (count > 0) lastMean[slot] = (sum + count / 2) / count;
+    return lastMean[slot];
+}
+
+/** Get the number of conversions the next read() of a channel will average.
+ * @param slot Index of the channel in the list given to begin()
+ * @return Conversions accumulated so far (at most ADCSAMPLER_MAX_SAMPLES)
+ */
+uint16_t AdcSampler::getSampleCount(uint8_t slot) {
+    uint16_t count;
+
+    if (slot >= channelCount) return 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        count = accumulators[slot].count;
+    }
+    return count;
+}
+
+/** Get the number of conversions since begin(), all channels together.
+ * @return Conversion count, wraps around
+ */
+uint32_t AdcSampler::getConversionCount() {
+    uint32_t count;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        count = conversions;
+    }
+    return count;
+}
+
+// One conversion done. In free running mode the next conversion has already
+// started on the channel selected at the previous interrupt, so a new
+// multiplexer setting only applies to the one after it: the result belongs
+// to the slot that was running, not to the one selected.
+ISR(ADC_vect) {
+    uint16_t value = ADC;
+    uint8_t done;
+
+    if (pipelined) {
+        done = running;
+        running = selected;
+    } else {
+        done = selected;
+    }
+    selected = selected + 1 < channelCount ? selected + 1 : 0;
+    selectChannel(channelList[selected]);
+
+    volatile Accumulator *acc = &accumulators[done];
+    acc->sum += value;
+    if (++acc->count >= ADCSAMPLER_MAX_SAMPLES) {
+        // read() has not come for a long time: keep a running mean instead of overflowing
+        acc->sum >>= 1;
+        acc->count >>= 1;
+    }
+    conversions++;
+}
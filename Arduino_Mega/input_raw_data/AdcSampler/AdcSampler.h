@@ -0,0 +1,44 @@
+// AdcSampler - interrupt driven, oversampling ADC reader
+//
+// analogRead() starts one conversion and busy-waits about 110us for it, and
+// a single 10-bit reading of the battery divider or the current sensor is
+// noisy. Here the ADC converts continuously: the ADC interrupt adds every
+// result to a per-channel sum and moves the multiplexer on to the next
+// channel. read() hands out the mean of everything converted on a channel
+// since the previous read() in constant time, so the sampling task neither
+// waits for the ADC nor sees single-conversion noise.
+//
+// Two trigger sources:
+//   ADCSAMPLER_FREE_RUNNING  back-to-back conversions, about 9600/s shared
+//                            by the channels (ADC clock 125kHz at 16MHz).
+//                            Most samples, but one interrupt every 104us.
+//   ADCSAMPLER_TIMER0        one conversion per Timer0 overflow (the
+//                            millis() tick, 976/s), for fewer wake-ups.
+//
+// The driver owns the ADC and its interrupt vector: analogRead() must not be
+// called while it runs. All methods are static; there is only one ADC.
+
+#ifndef _ADCSAMPLER_H_
+#define _ADCSAMPLER_H_
+
+#include <Arduino.h>
+
+#define ADCSAMPLER_MAX_CHANNELS     4
+#ifndef ADCSAMPLER_MAX_SAMPLES
+#define ADCSAMPLER_MAX_SAMPLES      4096    // per channel between two read()s, older samples are halved away beyond this
+#endif
+
+#define ADCSAMPLER_FREE_RUNNING     0
+#define ADCSAMPLER_TIMER0           1
+
+class AdcSampler {
+    public:
+        static bool begin(const uint8_t *channels, uint8_t count, uint8_t trigger=ADCSAMPLER_FREE_RUNNING);
+        static void end();
+
+        static uint16_t read(uint8_t slot);
+        static uint16_t getSampleCount(uint8_t slot);
+        static uint32_t getConversionCount();
+};
+
+#endif /* _ADCSAMPLER_H_ */
@@ -0,0 +1,51 @@
+// ChannelScheduler - per-channel rates for a multi-rate sensor stream
+// See ChannelScheduler.h for an overview.
+
+#include "ChannelScheduler.h"
+
+/** Default constructor. All channels are off.
+ */
+ChannelScheduler::ChannelScheduler() {
+    for (uint8_t channel = 0; channel < CHANNELSCHEDULER_MAX_CHANNELS; channel++) {
+        dividers[channel] = 0;
+        countdown[channel] = 0;
+    }
+}
+
+/** Set how often a channel is due.
+ * @param channel Channel number, its bit in the mask next() returns
+ * @param divider Due once every divider ticks, 0 to turn the channel off
+ * @param phase Ticks before it is first due (taken modulo divider)
+ * @return False if channel is out of range (nothing is changed)
+ */
+bool ChannelScheduler::setDivider(uint8_t channel, uint16_t divider, uint16_t phase) {
+    if (channel >= CHANNELSCHEDULER_MAX_CHANNELS) return false;
+    dividers[channel] = divider;
+    countdown[channel] = divider > 0 ? phase % divider : 0;
+    return true;
+}
+
+/** Get the divider of a channel.
+ * @param channel Channel number
+ * @return Ticks between two times the channel is due, 0 if it is off
+ */
+uint16_t ChannelScheduler::getDivider(uint8_t channel) const {
+    return channel < CHANNELSCHEDULER_MAX_CHANNELS ? dividers[channel] : 0;
+}
+
+/** Advance by one tick.
+ * @return Bitmask of the channels due at this tick (bit n = channel n)
+ */
+uint8_t ChannelScheduler::next() {
+    uint8_t due = 0;
+
+    for (uint8_t channel = 0; channel < CHANNELSCHEDULER_MAX_CHANNELS; channel++) {
+        if (dividers[channel] == 0) continue;
+        if (countdown[channel] == 0) {
+            due |= 1 << channel;
+            countdown[channel] = dividers[channel];
+        }
+        countdown[channel]--;
+    }
+    return due;
+}
@@ -0,0 +1,38 @@
+// ChannelScheduler - per-channel rates for a multi-rate sensor stream
+//
+// The sampling task wakes at one base rate, but not every field it reads
+// needs sending that often: motion data wants every tick while the power
+// readings change over seconds. Each channel (a group of fields sent
+// together) is given a divider and is due once every that many ticks;
+// next() is called once per tick and returns the bitmask of the channels
+// due, so the task only sends those. A phase spreads channels with the same
+// divider over different ticks.
+//
+// Usage:
+//     ChannelScheduler scheduler;
+//     scheduler.setDivider(0, 1);         // channel 0 every tick
+//     scheduler.setDivider(1, 50, 25);    // channel 1 every 50th, starting at tick 25
+//     uint8_t due = scheduler.next();
+
+#ifndef _CHANNELSCHEDULER_H_
+#define _CHANNELSCHEDULER_H_
+
+#include <Arduino.h>
+
+#define CHANNELSCHEDULER_MAX_CHANNELS   8   // one bit each in the mask
+
+class ChannelScheduler {
+    public:
+        ChannelScheduler();
+
+        bool setDivider(uint8_t channel, uint16_t divider, uint16_t phase=0);
+        uint16_t getDivider(uint8_t channel) const;
+
+        uint8_t next();
+
+    private:
+        uint16_t dividers[CHANNELSCHEDULER_MAX_CHANNELS];   // 0 = channel off
+        uint16_t countdown[CHANNELSCHEDULER_MAX_CHANNELS];  // ticks until the channel is due again
+};
+
+#endif /* _CHANNELSCHEDULER_H_ */
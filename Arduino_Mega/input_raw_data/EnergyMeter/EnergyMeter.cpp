@@ -0,0 +1,101 @@
+// EnergyMeter - drift-free integer energy accumulator
+// See EnergyMeter.h for an overview.
+
+#include "EnergyMeter.h"
+
+#define PICOJOULES_PER_MICROJOULE 1000000UL
+
+/** Default constructor.
+ * @param reportPeriodMicros Interval between two reports in microseconds, 0 to report at every update
+ */
+EnergyMeter::EnergyMeter(uint32_t reportPeriodMicros) {
+    reportPeriod = reportPeriodMicros;
+    reset();
+}
+
+/** Clear the total and the last report. The next update() only sets the
+ * starting time, the time before it is not counted.
+ */
+void EnergyMeter::reset() {
+    energy = 0;
+    remainder = 0;
+    lastMicros = 0;
+    started = false;
+    periodStart = 0;
+    periodStartEnergy = 0;
+    reportedPower = 0;
+    reportedEnergy = 0;
+}
+
+/** Change the report period. Takes effect from the period in progress.
+ * @param reportPeriodMicros Interval between two reports in microseconds, 0 to report at every update
+ */
+void EnergyMeter::setReportPeriod(uint32_t reportPeriodMicros) {
+    reportPeriod = reportPeriodMicros;
+}
+
+/** Add the energy used since the previous update.
+ * The power is taken as the mean over that interval, which is what an
+ * averaged reading (AdcSampler) measures.
+ * @param powerMicrowatts Power in uW
+ * @param nowMicros micros() at the time of the reading
+ * @return True if a report period ended, getReportedPower() and getReportedEnergy() then hold the new report
+ */
+bool EnergyMeter::update(uint32_t powerMicrowatts, uint32_t nowMicros) {
+    if (!started) {
+        lastMicros = nowMicros;
+        periodStart = nowMicros;
+        started = true;
+        return false;
+    }
+
+    uint32_t elapsed = nowMicros - lastMicros; // unsigned subtraction handles micros() wrap
+    lastMicros = nowMicros;
+
+    // uW * us = pJ
+    if (powerMicrowatts <= 0xFFFF && elapsed <= 0xFFFF) {
+        // usual case, a 50Hz step is a 16x16 bit product: no 64-bit multiply or division
+        uint32_t step = powerMicrowatts * elapsed;
+        energy += step / PICOJOULES_PER_MICROJOULE;
+        remainder += step % PICOJOULES_PER_MICROJOULE;
+    } else {
+        uint64_t step = (uint64_t)powerMicrowatts * elapsed;
+        energy += step / PICOJOULES_PER_MICROJOULE;
+        remainder += (uint32_t)(step % PICOJOULES_PER_MICROJOULE);
+    }
+    if (remainder >= PICOJOULES_PER_MICROJOULE) {
+        remainder -= PICOJOULES_PER_MICROJOULE;
+        energy++;
+    }
+
+    uint32_t period = nowMicros - periodStart;
+    if (period < reportPeriod || period == 0) return false;
+
+    // uJ * 1000000 / us = uW
+    reportedPower = (uint32_t)((energy - periodStartEnergy) * PICOJOULES_PER_MICROJOULE / period);
+    reportedEnergy = energy;
+    periodStart = nowMicros;
+    periodStartEnergy = energy;
+    return true;
+}
+
+/** Get the total so far.
+ * @return Energy in uJ since reset()
+ */
+uint64_t EnergyMeter::getEnergy() const {
+    return energy;
+}
+
+/** Get the mean power of the last completed report period.
+ * @return Power in uW, 0 before the first report
+ */
+uint32_t EnergyMeter::getReportedPower() const {
+    return reportedPower;
+}
+
+/** Get the total at the end of the last completed report period.
+ * @return Energy in uJ since reset(), 0 before the first report
+ */
+uint64_t EnergyMeter::getReportedEnergy() const {
+    return reportedEnergy;
+}
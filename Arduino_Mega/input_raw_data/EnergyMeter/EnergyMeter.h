@@ -0,0 +1,52 @@
+// EnergyMeter - drift-free integer energy accumulator
+//
+// Each update() adds power x time since the previous update to the total.
+// Power is in uW and time in us from micros(), so one step is in pJ; whole
+// uJ go to a 64-bit total and the pJ left over are carried to the next step.
+// Nothing is ever rounded away, so the total does not drift however long the
+// session runs (a float total stops adding small steps once it is large).
+// Intervals are unsigned micros() differences, correct across the 71 minute
+// wrap as long as updates come more often than that.
+//
+// Besides the running total the meter reports, once per report period, the
+// mean power over the period and the total at its end, so slow consumers
+// get steady figures without doing their own averaging.
+//
+// Usage:
+//     EnergyMeter meter(1000000UL);       // report once a second
+//     if (meter.update(powerMicrowatts, micros())) {
+//         send(meter.getReportedPower(), meter.getReportedEnergy());
+//     }
+
+#ifndef _ENERGYMETER_H_
+#define _ENERGYMETER_H_
+
+#include <Arduino.h>
+
+class EnergyMeter {
+    public:
+        EnergyMeter(uint32_t reportPeriodMicros=1000000UL);
+
+        void reset();
+        void setReportPeriod(uint32_t reportPeriodMicros);
+
+        bool update(uint32_t powerMicrowatts, uint32_t nowMicros);
+
+        uint64_t getEnergy() const;
+        uint32_t getReportedPower() const;
+        uint64_t getReportedEnergy() const;
+
+    private:
+        uint64_t energy;                // uJ
+        uint32_t remainder;             // pJ not yet in energy, below 1000000
+        uint32_t lastMicros;
+        bool started;
+
+        uint32_t reportPeriod;          // us
+        uint32_t periodStart;
+        uint64_t periodStartEnergy;
+        uint32_t reportedPower;         // uW
+        uint64_t reportedEnergy;        // uJ
+};
+
+#endif /* _ENERGYMETER_H_ */
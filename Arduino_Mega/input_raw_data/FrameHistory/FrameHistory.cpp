@@ -0,0 +1,88 @@
+// FrameHistory - the last frames sent, kept for resending
+// See FrameHistory.h for an overview.
+
+#include "FrameHistory.h"
+#include <string.h>
+
+#define SEQUENCE_OFFSET 4   // sync (2), type, length, then the sequence number, little-endian
+
+FrameHistory::FrameHistory() {
+    clear();
+}
+
+/** Forget every frame kept.
+ */
+void FrameHistory::clear() {
+    oldest = 0;
+    count = 0;
+    head = 0;
+}
+
+/** Keep a copy of a frame, overwriting the oldest ones as needed.
+ * @param frame Whole encoded frame, sync bytes to CRC
+ * @param length Frame length in bytes, frames longer than FRAMEHISTORY_SIZE are not kept
+ */
+void FrameHistory::add(const uint8_t *frame, uint16_t length) {
+    uint16_t start = head;
+
+    if (length <= SEQUENCE_OFFSET + 1 || length > FRAMEHISTORY_SIZE) return;
+
+    // no room before the end: the rest of the ring is skipped, the frames still in it go first
+    bool wrap = start + length > FRAMEHISTORY_SIZE;
+    if (wrap) start = 0;
+
+    while (count > 0) {
+        const Entry *entry = &entries[oldest];
+        if (count < FRAMEHISTORY_MAX_FRAMES
+            && !overlaps(entry, start, start + length)
+            && !(wrap && overlaps(entry, head, FRAMEHISTORY_SIZE))) break;
+        oldest = oldest + 1 < FRAMEHISTORY_MAX_FRAMES ? oldest + 1 : 0;
+        count--;
+    }
+
+    memcpy(buffer + start, frame, length);
+    uint8_t slot = oldest + count;
+    if (slot >= FRAMEHISTORY_MAX_FRAMES) slot -= FRAMEHISTORY_MAX_FRAMES;
+    entries[slot].offset = start;
+    entries[slot].length = length;
+    count++;
+    head = start + length;
+}
+
+/** Look a frame up by its sequence number, newest first.
+ * The frame stays valid until the next add().
+ * @param sequence Sequence number from the frame header
+ * @param frame Set to the start of the frame if found
+ * @param length Set to the frame length if found
+ * @return False if the frame is not (or no longer) kept
+ */
+bool FrameHistory::find(uint16_t sequence, const uint8_t **frame, uint16_t *length) const {
+    for (uint8_t n = count; n > 0; n--) {
+        uint8_t slot = oldest + n - 1;
+        if (slot >= FRAMEHISTORY_MAX_FRAMES) slot -= FRAMEHISTORY_MAX_FRAMES;
+        const uint8_t *data = buffer + entries[slot].offset;
+        if ((data[SEQUENCE_OFFSET] | (data[SEQUENCE_OFFSET + 1] << 8)) == sequence) {
+            *frame = data;
+            *length = entries[slot].length;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Get the number of frames kept.
+ * @return Frame count
+ */
+uint8_t FrameHistory::getCount() const {
+    return count;
+}
+
+/** Check whether a kept frame lies (partly) in a byte range.
+ * @param entry Frame
+ * @param start First byte of the range
+ * @param end Byte after the range
+ * @return True if they share a byte
+ */
+bool FrameHistory::overlaps(const Entry *entry, uint16_t start, uint16_t end) const {
+    return entry->offset < end && entry->offset + entry->length > start;
+}
@@ -0,0 +1,54 @@
+// FrameHistory - the last frames sent, kept for resending
+//
+// Every frame put on the link is also copied in here with add(). When the
+// receiver finds a gap in the sequence numbers (a frame lost, or dropped for
+// a bad CRC) it asks for the frame again, and find() looks it up by the
+// sequence number in its header (SensorFrame.h).
+//
+// Frames are stored whole, one after the other, in a byte ring of
+// FRAMEHISTORY_SIZE bytes: a frame that does not fit before the end starts
+// again at the beginning, so every frame is contiguous and can be queued in
+// one call. The oldest frames are overwritten to make room, so the history
+// reaches back as far as its size allows: about 2 full SAMPLES frames or a
+// few dozen small CHANNELS frames with the default size.
+//
+// Not thread safe: add() and find() must be called from the same task.
+
+#ifndef _FRAMEHISTORY_H_
+#define _FRAMEHISTORY_H_
+
+#include <Arduino.h>
+
+#ifndef FRAMEHISTORY_SIZE
+#define FRAMEHISTORY_SIZE       512     // bytes of frames kept
+#endif
+#ifndef FRAMEHISTORY_MAX_FRAMES
+#define FRAMEHISTORY_MAX_FRAMES 24      // frames kept, whatever their size
+#endif
+
+class FrameHistory {
+    public:
+        FrameHistory();
+
+        void clear();
+        void add(const uint8_t *frame, uint16_t length);
+        bool find(uint16_t sequence, const uint8_t **frame, uint16_t *length) const;
+
+        uint8_t getCount() const;
+
+    private:
+        typedef struct Entry {
+            uint16_t offset;
+            uint16_t length;
+        } Entry;
+
+        uint8_t buffer[FRAMEHISTORY_SIZE];
+        Entry entries[FRAMEHISTORY_MAX_FRAMES];
+        uint8_t oldest;     // index in entries of the oldest frame kept
+        uint8_t count;
+        uint16_t head;      // where the next frame goes
+
+        bool overlaps(const Entry *entry, uint16_t start, uint16_t end) const;
+};
+
+#endif /* _FRAMEHISTORY_H_ */
@@ -443,8 +443,8 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
 
         // Fastwire library
         // no loop required for fastwire
-        uint16_t intermediate[(uint8_t)length];
-        uint8_t status = Fastwire::readBuf(devAddr << 1, regAddr, (uint8_t *)intermediate, (uint8_t)(length * 2));
+        uint8_t intermediate[(uint8_t)(length * 2)];
+        uint8_t status = Fastwire::readBuf(devAddr << 1, regAddr, intermediate, (uint8_t)(length * 2));
         if (status == 0) {
             count = length; // success
             for (uint8_t i = 0; i < length; i++) {
@@ -467,6 +467,57 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
     return count;
 }
 
+/** Read several register blocks, possibly from different devices, in one call.
+ * Each block is fetched with a single write-register/repeated-start/read
+ * transaction and copied out without the per-byte timeout check readBytes()
+ * does, which is what dominates when the same few blocks are polled for
+ * every sample. The timeout is only checked once, after the whole batch.
+ * @param bursts Blocks to read, in order
+ * @param count Number of blocks
+ * @param timeout Optional read timeout in milliseconds (0 to disable, leave off to use default class value in I2Cdev::readTimeout)
+ * @return Number of blocks read completely (-1 indicates timeout)
+ */
+int8_t I2Cdev::readBursts(const I2CdevBurst *bursts, uint8_t count, uint16_t timeout) {
+    int8_t done = 0;
+    uint32_t t1 = millis();
+
+    for (uint8_t b = 0; b < count; b++) {
+        const I2CdevBurst *burst = &bursts[b];
+
+        #if (I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE && ARDUINO > 100)
+            // Arduino v1.0.1+, Wire library: repeated start between register write and read
+            if (burst->length > BUFFER_LENGTH) break;
+            Wire.beginTransmission(burst->devAddr);
+            Wire.write(burst->regAddr);
+            if (Wire.endTransmission(false) != 0) break;
+            if (Wire.requestFrom(burst->devAddr, burst->length, (uint8_t)true) != burst->length) break;
+            for (uint8_t k = 0; k < burst->length; k++) {
+                burst->data[k] = Wire.read();
+            }
+        #elif (I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE)
+            // Fastwire library, readBuf() already uses a repeated start
+            if (Fastwire::readBuf(burst->devAddr << 1, burst->regAddr, burst->data, burst->length) != 0) break;
+        #else
+            // other implementations: no faster path, fall back to readBytes()
+            if (readBytes(burst->devAddr, burst->regAddr, burst->length, burst->data, 0) != burst->length) break;
+        #endif
+
+        done++;
+    }
+
+    if (timeout > 0 && millis() - t1 >= timeout && done < count) done = -1; // timeout
+
+    #ifdef I2CDEV_SERIAL_DEBUG
+        Serial.print("I2C burst read of ");
+        Serial.print(count, DEC);
+        Serial.print(" blocks. Done (");
+        Serial.print(done, DEC);
+        Serial.println(" read).");
+    #endif
+
+    return done;
+}
+
 /** write a single bit in an 8-bit device register.
  * @param devAddr I2C slave device address
  * @param regAddr Register regAddr to write to
@@ -50,9 +50,13 @@ THE SOFTWARE.
 // -----------------------------------------------------------------------------
 // I2C interface implementation setting
 // -----------------------------------------------------------------------------
+// Fastwire is the supported setting for the dance sensor bus (two ADXL345 and
+// one MPU6050 at 400kHz, see Fastwire::setup() in the sketches). To go back to
+// the Arduino Wire library, build with -DI2CDEV_IMPLEMENTATION=1 or swap the
+// two lines below; examples/I2Cdev_benchmark compares the two.
 #ifndef I2CDEV_IMPLEMENTATION
-#define I2CDEV_IMPLEMENTATION       I2CDEV_ARDUINO_WIRE
-//#define I2CDEV_IMPLEMENTATION       I2CDEV_BUILTIN_FASTWIRE
+//#define I2CDEV_IMPLEMENTATION       I2CDEV_ARDUINO_WIRE
+#define I2CDEV_IMPLEMENTATION       I2CDEV_BUILTIN_FASTWIRE
 #endif // I2CDEV_IMPLEMENTATION
 
 // comment this out if you are using a non-optimal IDE/implementation setting
@@ -96,6 +100,14 @@ THE SOFTWARE.
 // 1000ms default read timeout (modify with "I2Cdev::readTimeout = [ms];")
 #define I2CDEV_DEFAULT_READ_TIMEOUT     1000
 
+// One register block read by I2Cdev::readBursts()
+typedef struct I2CdevBurst {
+    uint8_t devAddr;    // I2C slave device address
+    uint8_t regAddr;    // first register to read
+    uint8_t length;     // number of bytes, at most BUFFER_LENGTH with the Arduino Wire library
+    uint8_t *data;      // destination buffer
+} I2CdevBurst;
+
 class I2Cdev {
     public:
         I2Cdev();
@@ -108,6 +120,7 @@ class I2Cdev {
         static int8_t readWord(uint8_t devAddr, uint8_t regAddr, uint16_t *data, uint16_t timeout=I2Cdev::readTimeout);
         static int8_t readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data, uint16_t timeout=I2Cdev::readTimeout);
         static int8_t readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t *data, uint16_t timeout=I2Cdev::readTimeout);
+        static int8_t readBursts(const I2CdevBurst *bursts, uint8_t count, uint16_t timeout=I2Cdev::readTimeout);
 
         static bool writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data);
         static bool writeBitW(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint16_t data);
@@ -0,0 +1,138 @@
+// I2Cdev transaction latency benchmark for the dance sensor bus
+// (ADXL345 at 0x53 and 0x1D, MPU6050 at 0x68)
+//
+// Times readBytes(), writeBytes() and readBursts() with micros() and prints
+// min/avg/max per transaction. Only one I2Cdev implementation is compiled in
+// at a time, so build and run this once per setting of I2CDEV_IMPLEMENTATION
+// (I2Cdev.h, or -DI2CDEV_IMPLEMENTATION=1 for Wire, =3 for Fastwire) and
+// compare the two reports.
+
+// Arduino Wire library is required if I2Cdev I2CDEV_ARDUINO_WIRE implementation
+// is used in I2Cdev.h
+#include "Wire.h"
+
+#include "I2Cdev.h"
+
+#define DEVICE_A_ACCEL      0x53
+#define DEVICE_B_ACCEL      0x1D
+#define DEVICE_C_GYRO       0x68
+
+#define ADXL345_RA_OFSX     0x1E
+#define ADXL345_RA_POWER_CTL 0x2D
+#define ADXL345_RA_DATAX0   0x32
+#define MPU6050_RA_PWR_MGMT_1 0x6B
+#define MPU6050_RA_ACCEL_XOUT_H 0x3B
+
+#define I2C_CLOCK_KHZ       400
+#define ITERATIONS          500
+
+uint8_t accelABuffer[6];
+uint8_t accelBBuffer[6];
+uint8_t motionBuffer[14];
+
+const I2CdevBurst bursts[] = {
+    { DEVICE_A_ACCEL, ADXL345_RA_DATAX0, sizeof(accelABuffer), accelABuffer },
+    { DEVICE_B_ACCEL, ADXL345_RA_DATAX0, sizeof(accelBBuffer), accelBBuffer },
+    { DEVICE_C_GYRO, MPU6050_RA_ACCEL_XOUT_H, sizeof(motionBuffer), motionBuffer }
+};
+
+typedef struct Result {
+    uint32_t minMicros;
+    uint32_t maxMicros;
+    uint32_t totalMicros;
+    uint16_t failures;
+} Result;
+
+void resetResult(Result *r) {
+    r->minMicros = 0xFFFFFFFF;
+    r->maxMicros = 0;
+    r->totalMicros = 0;
+    r->failures = 0;
+}
+
+void addResult(Result *r, uint32_t elapsed, bool ok) {
+    if (elapsed < r->minMicros) r->minMicros = elapsed;
+    if (elapsed > r->maxMicros) r->maxMicros = elapsed;
+    r->totalMicros += elapsed;
+    if (!ok) r->failures++;
+}
+
+void printResult(const char *name, const Result *r) {
+    Serial.print(name);
+    Serial.print("\tmin="); Serial.print(r->minMicros);
+    Serial.print("us\tavg="); Serial.print(r->totalMicros / ITERATIONS);
+    Serial.print("us\tmax="); Serial.print(r->maxMicros);
+    Serial.print("us\tfailures="); Serial.println(r->failures);
+}
+
+void setup() {
+    // join I2C bus (I2Cdev library doesn't do this automatically)
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE
+        Wire.begin();
+        Wire.setClock(I2C_CLOCK_KHZ * 1000L);
+    #elif I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+        Fastwire::setup(I2C_CLOCK_KHZ, true);
+    #endif
+
+    Serial.begin(115200);
+
+    // wake the sensors up so the data registers are live
+    I2Cdev::writeByte(DEVICE_A_ACCEL, ADXL345_RA_POWER_CTL, 0x08);
+    I2Cdev::writeByte(DEVICE_B_ACCEL, ADXL345_RA_POWER_CTL, 0x08);
+    I2Cdev::writeByte(DEVICE_C_GYRO, MPU6050_RA_PWR_MGMT_1, 0x01);
+    delay(100);
+}
+
+void loop() {
+    Result r;
+    uint32_t t;
+    uint8_t offset;
+
+    Serial.println();
+    #if I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE
+        Serial.print("I2CDEV_ARDUINO_WIRE");
+    #elif I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+        Serial.print("I2CDEV_BUILTIN_FASTWIRE");
+    #endif
+    Serial.print(" at ");
+    Serial.print(I2C_CLOCK_KHZ);
+    Serial.print("kHz, ");
+    Serial.print(ITERATIONS);
+    Serial.println(" iterations");
+
+    resetResult(&r);
+    for (uint16_t n = 0; n < ITERATIONS; n++) {
+        t = micros();
+        int8_t count = I2Cdev::readBytes(DEVICE_A_ACCEL, ADXL345_RA_DATAX0, 6, accelABuffer);
+        addResult(&r, micros() - t, count == 6);
+    }
+    printResult("readBytes ADXL345 6B", &r);
+
+    resetResult(&r);
+    for (uint16_t n = 0; n < ITERATIONS; n++) {
+        t = micros();
+        int8_t count = I2Cdev::readBytes(DEVICE_C_GYRO, MPU6050_RA_ACCEL_XOUT_H, 14, motionBuffer);
+        addResult(&r, micros() - t, count == 14);
+    }
+    printResult("readBytes MPU6050 14B", &r);
+
+    // write the current offset back so the benchmark leaves the device unchanged
+    I2Cdev::readByte(DEVICE_A_ACCEL, ADXL345_RA_OFSX, &offset);
+    resetResult(&r);
+    for (uint16_t n = 0; n < ITERATIONS; n++) {
+        t = micros();
+        bool ok = I2Cdev::writeBytes(DEVICE_A_ACCEL, ADXL345_RA_OFSX, 1, &offset);
+        addResult(&r, micros() - t, ok);
+    }
+    printResult("writeBytes ADXL345 1B", &r);
+
+    resetResult(&r);
+    for (uint16_t n = 0; n < ITERATIONS; n++) {
+        t = micros();
+        int8_t count = I2Cdev::readBursts(bursts, 3);
+        addResult(&r, micros() - t, count == 3);
+    }
+    printResult("readBursts all sensors", &r);
+
+    delay(5000);
+}
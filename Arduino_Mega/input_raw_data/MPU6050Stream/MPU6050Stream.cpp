@@ -0,0 +1,137 @@
+// MPU6050Stream - bulk reader for the MPU6050 FIFO
+// See MPU6050Stream.h for an overview.
+
+#include "MPU6050Stream.h"
+
+#if (MPU6050STREAM_RING_SIZE & (MPU6050STREAM_RING_SIZE - 1)) != 0 || MPU6050STREAM_RING_SIZE > 128
+#error "MPU6050STREAM_RING_SIZE must be a power of two no larger than 128"
+#endif
+
+/** Constructor.
+ * @param device Initialized MPU6050 to stream from
+ * @param address I2C address of the same device (the MPU6050 class does not expose it)
+ */
+MPU6050Stream::MPU6050Stream(MPU6050 *device, uint8_t address) {
+    this->device = device;
+    devAddr = address;
+    head = 0;
+    tail = 0;
+    overflows = 0;
+}
+
+/** Configure the sample rate and start filling the FIFO with accel and gyro data.
+ * The sample rate is the gyro output rate / (1 + rateDivider), where the gyro
+ * output rate is 8kHz with the DLPF off (MPU6050_DLPF_BW_256) and 1kHz otherwise.
+ * Pick a dlpfMode below half the resulting sample rate.
+ * @param rateDivider Value for SMPLRT_DIV
+ * @param dlpfMode Digital low pass filter setting (MPU6050_DLPF_BW_*)
+ * @see MPU6050::setRate()
+ * @see MPU6050::setDLPFMode()
+ */
+void MPU6050Stream::begin(uint8_t rateDivider, uint8_t dlpfMode) {
+    device->setFIFOEnabled(false);
+    device->setDLPFMode(dlpfMode);
+    device->setRate(rateDivider);
+
+    // FIFO entries are written in register order: accel XYZ, then gyro XYZ
+    device->setTempFIFOEnabled(false);
+    device->setAccelFIFOEnabled(true);
+    device->setXGyroFIFOEnabled(true);
+    device->setYGyroFIFOEnabled(true);
+    device->setZGyroFIFOEnabled(true);
+
+    device->resetFIFO();
+    device->setFIFOEnabled(true);
+    clear();
+}
+
+/** Drop all decoded samples that have not been read yet.
+ */
+void MPU6050Stream::clear() {
+    head = 0;
+    tail = 0;
+}
+
+/** Move complete frames from the FIFO into the ring.
+ * Frames that do not fit in the ring stay in the FIFO for the next call.
+ * @return Number of samples added to the ring
+ */
+uint8_t MPU6050Stream::poll() {
+    uint16_t count = readFIFOCount();
+    uint8_t added = 0;
+
+    if (count >= MPU6050STREAM_FIFO_SIZE) {
+        // FIFO overflowed, frame alignment is lost: start over
+        overflows++;
+        device->resetFIFO();
+        return 0;
+    }
+
+    uint16_t frames = count / MPU6050STREAM_FRAME_LENGTH;
+    uint8_t space = MPU6050STREAM_RING_SIZE - available();
+    if (frames > space) frames = space;
+
+    while (frames > 0) {
+        uint8_t burst = frames > MPU6050STREAM_BURST_FRAMES ? MPU6050STREAM_BURST_FRAMES : frames;
+        uint8_t length = burst * MPU6050STREAM_FRAME_LENGTH;
+        if (I2Cdev::readBytes(devAddr, MPU6050_RA_FIFO_R_W, length, buffer) != length) {
+            // part of a frame may have been popped, realign on the next poll
+            device->resetFIFO();
+            break;
+        }
+
+        for (uint8_t frame = 0; frame < burst; frame++) {
+            const uint8_t *data = buffer + frame * MPU6050STREAM_FRAME_LENGTH;
+            MPU6050Sample *sample = &ring[head & (MPU6050STREAM_RING_SIZE - 1)];
+            for (uint8_t axis = 0; axis < 3; axis++) {
+                sample->accel[axis] = (((int16_t)data[2 * axis]) << 8) | data[2 * axis + 1];
+                sample->gyro[axis] = (((int16_t)data[2 * axis + 6]) << 8) | data[2 * axis + 7];
+            }
+            head++;
+        }
+        added += burst;
+        frames -= burst;
+    }
+    return added;
+}
+
+/** Take the oldest sample out of the ring, polling the FIFO first if the ring is empty.
+ * @param sample Where to store the sample
+ * @return False if no sample was available
+ */
+bool MPU6050Stream::read(MPU6050Sample *sample) {
+    if (available() == 0 && poll() == 0) return false;
+    *sample = ring[tail & (MPU6050STREAM_RING_SIZE - 1)];
+    tail++;
+    return true;
+}
+
+/** Get the number of decoded samples waiting in the ring.
+ * @return Samples available to read() without touching the bus
+ */
+uint8_t MPU6050Stream::available() const {
+    return (uint8_t)(head - tail);
+}
+
+/** Get the number of samples waiting in the ring and in the FIFO together.
+ * @return Samples read() can return right now
+ */
+uint16_t MPU6050Stream::getPendingSamples() {
+    uint16_t count = readFIFOCount();
+    if (count >= MPU6050STREAM_FIFO_SIZE) count = 0; // poll() will reset it
+    return available() + count / MPU6050STREAM_FRAME_LENGTH;
+}
+
+/** Get the number of FIFO overflows seen since construction.
+ * Each one lost up to a full FIFO worth of samples.
+ * @return Overflow count
+ */
+uint16_t MPU6050Stream::getOverflowCount() const {
+    return overflows;
+}
+
+uint16_t MPU6050Stream::readFIFOCount() {
+    uint8_t count[2];
+    if (I2Cdev::readBytes(devAddr, MPU6050_RA_FIFO_COUNTH, 2, count) != 2) return 0;
+    return (((uint16_t)count[0]) << 8) | count[1];
+}
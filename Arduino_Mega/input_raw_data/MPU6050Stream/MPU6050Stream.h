@@ -0,0 +1,57 @@
+// MPU6050Stream - bulk reader for the MPU6050 FIFO
+//
+// The MPU6050 writes accelerometer and gyroscope readings into its 1024 byte
+// FIFO at the sample rate set with begin(), so the gyro can run at 200-1000Hz
+// while the MCU only visits the bus now and then. poll() reads all complete
+// 12-byte frames (accel XYZ then gyro XYZ, big-endian) in a few large bursts
+// and decodes them into a fixed ring of samples for read().
+//
+// If the FIFO fills up, the chip keeps writing over the oldest bytes and the
+// frame boundaries are lost. poll() detects this from the FIFO count, counts
+// it, and resets the FIFO so the stream starts again on a frame boundary.
+
+#ifndef _MPU6050STREAM_H_
+#define _MPU6050STREAM_H_
+
+#include <MPU6050.h>
+
+#define MPU6050STREAM_FRAME_LENGTH      12      // bytes per FIFO entry
+#define MPU6050STREAM_FIFO_SIZE         1024    // bytes of FIFO on the chip
+#define MPU6050STREAM_BURST_FRAMES      5       // frames fetched per I2C read
+
+#ifndef MPU6050STREAM_RING_SIZE
+#define MPU6050STREAM_RING_SIZE         32      // decoded samples, must be a power of two
+#endif
+
+typedef struct MPU6050Sample {
+    int16_t accel[3];
+    int16_t gyro[3];
+} MPU6050Sample;
+
+class MPU6050Stream {
+    public:
+        MPU6050Stream(MPU6050 *device, uint8_t address=MPU6050_DEFAULT_ADDRESS);
+
+        void begin(uint8_t rateDivider, uint8_t dlpfMode);
+        void clear();
+
+        uint8_t poll();
+        bool read(MPU6050Sample *sample);
+        uint8_t available() const;
+        uint16_t getPendingSamples();
+
+        uint16_t getOverflowCount() const;
+
+    private:
+        MPU6050 *device;
+        uint8_t devAddr;
+        MPU6050Sample ring[MPU6050STREAM_RING_SIZE];
+        uint8_t head;
+        uint8_t tail;
+        uint16_t overflows;
+        uint8_t buffer[MPU6050STREAM_FRAME_LENGTH * MPU6050STREAM_BURST_FRAMES];
+
+        uint16_t readFIFOCount();
+};
+
+#endif /* _MPU6050STREAM_H_ */
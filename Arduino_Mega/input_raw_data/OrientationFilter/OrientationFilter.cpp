@@ -0,0 +1,88 @@
+// OrientationFilter - gyro/accelerometer fusion into an orientation quaternion
+// See OrientationFilter.h for an overview.
+
+#include "OrientationFilter.h"
+
+/** Constructor.
+ * @param kp Proportional gain of the accelerometer correction (1/s)
+ * @param ki Integral gain (1/s^2), 0 to disable gyro bias estimation
+ * @param accelTolerance Largest difference between the accelerometer magnitude and 1g (in g) for which it is trusted
+ */
+OrientationFilter::OrientationFilter(float kp, float ki, float accelTolerance) {
+    this->kp = kp;
+    this->ki = ki;
+    this->accelTolerance = accelTolerance;
+    reset();
+}
+
+/** Go back to the identity orientation and clear the integral feedback.
+ */
+void OrientationFilter::reset() {
+    q = Quaternion();
+    integral = VectorFloat();
+    corrections = 0;
+}
+
+/** Advance the orientation by one sample.
+ * @param gyro Angular rates in rad/s
+ * @param accel Acceleration in g, in the same axes as gyro
+ * @param dt Time since the previous update in seconds
+ */
+void OrientationFilter::update(VectorFloat gyro, VectorFloat accel, float dt) {
+    if (dt <= 0.0f) return;
+
+    float magnitude = accel.getMagnitude();
+    if (magnitude > 0.0f && fabs(magnitude - 1.0f) <= accelTolerance) {
+        accel.x /= magnitude;
+        accel.y /= magnitude;
+        accel.z /= magnitude;
+
+        // gravity direction predicted by the current orientation (third row of its rotation matrix)
+        VectorFloat v(2.0f * (q.x * q.z - q.w * q.y),
+                      2.0f * (q.w * q.x + q.y * q.z),
+                      q.w * q.w - q.x * q.x - q.y * q.y + q.z * q.z);
+
+        // error is the cross product between the measured and the predicted direction
+        VectorFloat e(accel.y * v.z - accel.z * v.y,
+                      accel.z * v.x - accel.x * v.z,
+                      accel.x * v.y - accel.y * v.x);
+
+        if (ki > 0.0f) {
+            integral.x += ki * e.x * dt;
+            integral.y += ki * e.y * dt;
+            integral.z += ki * e.z * dt;
+        }
+        gyro.x += kp * e.x + integral.x;
+        gyro.y += kp * e.y + integral.y;
+        gyro.z += kp * e.z + integral.z;
+        corrections++;
+    } else {
+        gyro.x += integral.x;
+        gyro.y += integral.y;
+        gyro.z += integral.z;
+    }
+
+    // dq/dt = 1/2 q * (0, gyro)
+    Quaternion rate = q.getProduct(Quaternion(0.0f, gyro.x, gyro.y, gyro.z));
+    float half = 0.5f * dt;
+    q.w += rate.w * half;
+    q.x += rate.x * half;
+    q.y += rate.y * half;
+    q.z += rate.z * half;
+    q.normalize();
+}
+
+/** Get the current orientation.
+ * @return Unit quaternion rotating sensor axes into the reference frame
+ */
+Quaternion OrientationFilter::getQuaternion() const {
+    return q;
+}
+
+/** Get the number of updates that used the accelerometer correction since reset().
+ * Stays low while the sensor is being shaken; wraps at 65535.
+ * @return Correction count
+ */
+uint16_t OrientationFilter::getCorrectionCount() const {
+    return corrections;
+}
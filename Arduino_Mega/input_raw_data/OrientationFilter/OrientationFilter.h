@@ -0,0 +1,41 @@
+// OrientationFilter - gyro/accelerometer fusion into an orientation quaternion
+//
+// Mahony complementary filter: the gyro rates are integrated into the
+// quaternion every update, and the angle between the gravity direction the
+// accelerometer measures and the one the quaternion predicts is fed back
+// through a PI controller, which pulls the gyro drift out over time.
+//
+// The Mahony form is used rather than Madgwick's gradient descent because
+// it needs fewer float operations per update, which matters with the AVR's
+// software floating point at 200Hz.
+//
+// Accelerometer samples whose magnitude is too far from 1g are taken to be
+// dominated by motion rather than gravity (a dancer rarely stands still) and
+// only the gyro is integrated for them.
+
+#ifndef _ORIENTATIONFILTER_H_
+#define _ORIENTATIONFILTER_H_
+
+#include <Arduino.h>
+#include <helper_3dmath.h>
+
+class OrientationFilter {
+    public:
+        OrientationFilter(float kp=1.0f, float ki=0.0f, float accelTolerance=0.3f);
+
+        void reset();
+        void update(VectorFloat gyro, VectorFloat accel, float dt);
+
+        Quaternion getQuaternion() const;
+        uint16_t getCorrectionCount() const;
+
+    private:
+        Quaternion q;
+        VectorFloat integral;       // integral feedback, rad/s
+        float kp;
+        float ki;
+        float accelTolerance;       // in g
+        uint16_t corrections;       // updates that used the accelerometer
+};
+
+#endif /* _ORIENTATIONFILTER_H_ */
@@ -0,0 +1,297 @@
+// SensorCalibration - hardware offset calibration for the ADXL345 and MPU6050
+// See SensorCalibration.h for an overview.
+
+#include "SensorCalibration.h"
+
+#define PHASE_GUESS     0   // measuring at the offsets found in the device
+#define PHASE_LOW       1   // looking for an offset reading at or below the target
+#define PHASE_HIGH      2   // looking for an offset reading above the target
+#define PHASE_BISECT    3   // closing the bracket
+#define PHASE_DONE      4
+
+/** Divide rounding to the nearest integer, halves away from zero.
+ * @param value Dividend
+ * @param divisor Divisor, above 0
+ * @return Rounded quotient
+ */
+static int32_t divideRounded(int32_t value, int32_t divisor) {
+    return (value >= 0 ? value + divisor / 2 : value - divisor / 2) / divisor;
+}
+
+/** Constructor for the device classes.
+ * @param axes Number of offset registers, at most CALIBRATION_MAX_AXES
+ * @param offsetMin Lowest value an offset register takes
+ * @param offsetMax Highest value an offset register takes
+ */
+OffsetCalibration::OffsetCalibration(uint8_t axes, int16_t offsetMin, int16_t offsetMax) {
+    axisCount = axes < CALIBRATION_MAX_AXES ? axes : CALIBRATION_MAX_AXES;
+    this->offsetMin = offsetMin;
+    this->offsetMax = offsetMax;
+    for (uint8_t axis = 0; axis < CALIBRATION_MAX_AXES; axis++) {
+        targets[axis] = 0;
+        countsPerStepQ4[axis] = 16;
+        phase[axis] = PHASE_DONE;
+        trial[axis] = 0;
+        error[axis] = 0;
+    }
+    sampleCount = 0;
+}
+
+/** Start a calibration from the offsets currently in the device.
+ * The device must lie still and level, Z up, until isDone().
+ */
+void OffsetCalibration::begin() {
+    readOffsets(trial);
+    for (uint8_t axis = 0; axis < axisCount; axis++) {
+        phase[axis] = PHASE_GUESS;
+        sums[axis] = 0;
+        error[axis] = 0;
+    }
+    sampleCount = 0;
+}
+
+/** Take one reading into the batch of the current trial.
+ * Does nothing once the calibration is done, or after 65535 readings.
+ */
+void OffsetCalibration::addSample() {
+    int16_t values[CALIBRATION_MAX_AXES];
+
+    if (isDone() || sampleCount == 0xFFFF) return;
+    readSample(values);
+    for (uint8_t axis = 0; axis < axisCount; axis++) sums[axis] += values[axis];
+    sampleCount++;
+}
+
+/** End the batch: move every axis on by one trial and write the next offsets to the device.
+ * The first readings after this still come from the old offsets, drop a few
+ * (CALIBRATION_SETTLE_SAMPLES) before the next batch.
+ * @return True once every axis is done, the device then holds the results
+ */
+bool OffsetCalibration::step() {
+    if (isDone()) return true;
+    if (sampleCount == 0) return false;
+
+    for (uint8_t axis = 0; axis < axisCount; axis++) {
+        if (phase[axis] == PHASE_DONE) continue;
+
+        int32_t deviation = divideRounded(sums[axis], sampleCount) - targets[axis];
+        int16_t measured = deviation > 32767 ? 32767 : deviation < -32768 ? -32768 : (int16_t)deviation;
+        error[axis] = measured;
+        sums[axis] = 0;
+
+        switch (phase[axis]) {
+            case PHASE_GUESS:
+                guess[axis] = clampOffset(trial[axis] - divideRounded((int32_t)measured * 16, countsPerStepQ4[axis]));
+                margin[axis] = CALIBRATION_FIRST_MARGIN;
+                trial[axis] = clampOffset((int32_t)guess[axis] - margin[axis]);
+                phase[axis] = PHASE_LOW;
+                break;
+
+            case PHASE_LOW:
+                if (measured <= 0) {
+                    low[axis] = trial[axis];
+                    lowError[axis] = measured;
+                    trial[axis] = clampOffset((int32_t)guess[axis] + margin[axis]);
+                    phase[axis] = PHASE_HIGH;
+                } else if (trial[axis] == offsetMin) {
+                    // reads above the target even at the bottom of the register
+                    low[axis] = high[axis] = trial[axis];
+                    lowError[axis] = highError[axis] = measured;
+                    finish(axis);
+                } else {
+                    if (margin[axis] < 0x8000) margin[axis] <<= 1;
+                    trial[axis] = clampOffset((int32_t)guess[axis] - margin[axis]);
+                }
+                break;
+
+            case PHASE_HIGH:
+                if (measured > 0) {
+                    high[axis] = trial[axis];
+                    highError[axis] = measured;
+                    bisect(axis);
+                } else if (trial[axis] == offsetMax) {
+                    low[axis] = high[axis] = trial[axis];
+                    lowError[axis] = highError[axis] = measured;
+                    finish(axis);
+                } else {
+                    // still at or below the target, a better low end at least
+                    low[axis] = trial[axis];
+                    lowError[axis] = measured;
+                    if (margin[axis] < 0x8000) margin[axis] <<= 1;
+                    trial[axis] = clampOffset((int32_t)guess[axis] + margin[axis]);
+                }
+                break;
+
+            case PHASE_BISECT:
+                if (measured > 0) {
+                    high[axis] = trial[axis];
+                    highError[axis] = measured;
+                } else {
+                    low[axis] = trial[axis];
+                    lowError[axis] = measured;
+                }
+                bisect(axis);
+                break;
+        }
+    }
+    sampleCount = 0;
+    writeOffsets(trial);
+    return isDone();
+}
+
+/** Check whether every axis has its offset.
+ * @return True once step() has settled all axes
+ */
+bool OffsetCalibration::isDone() const {
+    for (uint8_t axis = 0; axis < axisCount; axis++) {
+        if (phase[axis] != PHASE_DONE) return false;
+    }
+    return true;
+}
+
+/** Get the number of offset registers calibrated.
+ * @return Axis count
+ */
+uint8_t OffsetCalibration::getAxisCount() const {
+    return axisCount;
+}
+
+/** Get the offset of an axis: the result once done, the trial in progress before.
+ * @param axis Axis index
+ * @return Offset register value
+ */
+int16_t OffsetCalibration::getOffset(uint8_t axis) const {
+    return axis < axisCount ? trial[axis] : 0;
+}
+
+/** Get how far the mean reading was from the target, at the offset getOffset() returns once done.
+ * @param axis Axis index
+ * @return Mean reading minus target, counts
+ */
+int16_t OffsetCalibration::getError(uint8_t axis) const {
+    return axis < axisCount ? error[axis] : 0;
+}
+
+/** Calibrate several devices at once, each batch reading all of them in turn.
+ * The devices must lie still and level, Z up, until it returns.
+ * @param calibrations Calibrations to run, begin() is called here
+ * @param count Number of calibrations
+ * @param samples Readings averaged per trial
+ * @param sampleDelayMs Wait between two readings, at least one output period of the slowest device
+ */
+void OffsetCalibration::run(OffsetCalibration *const *calibrations, uint8_t count, uint16_t samples, uint16_t sampleDelayMs) {
+    uint8_t index;
+    bool done;
+
+    for (index = 0; index < count; index++) calibrations[index]->begin();
+    do {
+        for (uint16_t n = 0; n < samples + CALIBRATION_SETTLE_SAMPLES; n++) {
+            delay(sampleDelayMs);
+            if (n < CALIBRATION_SETTLE_SAMPLES) continue;
+            for (index = 0; index < count; index++) calibrations[index]->addSample();
+        }
+        done = true;
+        for (index = 0; index < count; index++) {
+            if (!calibrations[index]->step()) done = false;
+        }
+    } while (!done);
+}
+
+/** Limit an offset to what the register holds.
+ * @param offset Wanted offset
+ * @return Offset within offsetMin..offsetMax
+ */
+int16_t OffsetCalibration::clampOffset(int32_t offset) const {
+    return offset < offsetMin ? offsetMin : offset > offsetMax ? offsetMax : (int16_t)offset;
+}
+
+/** Try the middle of the bracket next, or finish once its ends are neighbours.
+ * @param axis Axis index
+ */
+void OffsetCalibration::bisect(uint8_t axis) {
+    if ((int32_t)high[axis] - low[axis] <= 1) {
+        finish(axis);
+        return;
+    }
+    trial[axis] = low[axis] + (int16_t)(((int32_t)high[axis] - low[axis]) / 2);
+    phase[axis] = PHASE_BISECT;
+}
+
+/** Settle an axis on the end of the bracket whose mean was closer to the target.
+ * @param axis Axis index
+ */
+void OffsetCalibration::finish(uint8_t axis) {
+    if (abs(lowError[axis]) <= abs(highError[axis])) {
+        trial[axis] = low[axis];
+        error[axis] = lowError[axis];
+    } else {
+        trial[axis] = high[axis];
+        error[axis] = highError[axis];
+    }
+    phase[axis] = PHASE_DONE;
+}
+
+/** ADXL345 calibration: offsets -128..127 in steps of 15.6mg.
+ * @param sensor Device, configured for range before begin()
+ * @param range ADXL345_RANGE_* in use (full resolution off)
+ */
+Adxl345Calibration::Adxl345Calibration(ADXL345 &sensor, uint8_t range)
+    : OffsetCalibration(3, -128, 127), sensor(sensor) {
+    // 15.6mg is 4 counts at +-2g (256 counts per g), halved for every range step
+    for (uint8_t axis = 0; axis < 3; axis++) countsPerStepQ4[axis] = 64 >> range;
+    targets[2] = 256 >> range;
+}
+
+void Adxl345Calibration::readOffsets(int16_t *offsets) {
+    int8_t x, y, z;
+
+    sensor.getOffset(&x, &y, &z);
+    offsets[0] = x;
+    offsets[1] = y;
+    offsets[2] = z;
+}
+
+void Adxl345Calibration::writeOffsets(const int16_t *offsets) {
+    sensor.setOffset((int8_t)offsets[0], (int8_t)offsets[1], (int8_t)offsets[2]);
+}
+
+void Adxl345Calibration::readSample(int16_t *values) {
+    sensor.getAcceleration(&values[0], &values[1], &values[2]);
+}
+
+/** MPU6050 calibration: the 16-bit accelerometer and gyroscope offsets.
+ * The accelerometer offsets count in +-16g units (2048 per g) and the gyroscope
+ * offsets in +-1000deg/s units (32.8 per deg/s), whatever range is in use.
+ * @param sensor Device, configured for the ranges before begin()
+ * @param gyroRange MPU6050_GYRO_FS_* in use
+ * @param accelRange MPU6050_ACCEL_FS_* in use
+ */
+Mpu6050Calibration::Mpu6050Calibration(MPU6050 &sensor, uint8_t gyroRange, uint8_t accelRange)
+    : OffsetCalibration(6, -32768, 32767), sensor(sensor) {
+    // one step is 8 counts at +-2g and 4 counts at +-250deg/s, halved for every range step
+    for (uint8_t axis = 0; axis < 3; axis++) countsPerStepQ4[axis] = 128 >> accelRange;
+    for (uint8_t axis = 3; axis < 6; axis++) countsPerStepQ4[axis] = 64 >> gyroRange;
+    targets[2] = 16384 >> accelRange;
+}
+
+void Mpu6050Calibration::readOffsets(int16_t *offsets) {
+    offsets[0] = sensor.getXAccelOffset();
+    offsets[1] = sensor.getYAccelOffset();
+    offsets[2] = sensor.getZAccelOffset();
+    offsets[3] = sensor.getXGyroOffset();
+    offsets[4] = sensor.getYGyroOffset();
+    offsets[5] = sensor.getZGyroOffset();
+}
+
+void Mpu6050Calibration::writeOffsets(const int16_t *offsets) {
+    sensor.setXAccelOffset(offsets[0]);
+    sensor.setYAccelOffset(offsets[1]);
+    sensor.setZAccelOffset(offsets[2]);
+    sensor.setXGyroOffset(offsets[3]);
+    sensor.setYGyroOffset(offsets[4]);
+    sensor.setZGyroOffset(offsets[5]);
+}
+
+void Mpu6050Calibration::readSample(int16_t *values) {
+    sensor.getMotion6(&values[0], &values[1], &values[2], &values[3], &values[4], &values[5]);
+}
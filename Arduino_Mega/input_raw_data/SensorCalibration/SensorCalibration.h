@@ -0,0 +1,111 @@
+// SensorCalibration - hardware offset calibration for the ADXL345 and MPU6050
+//
+// Both sensors can subtract an offset inside the chip (ADXL345 OFSX/Y/Z,
+// MPU6050 XA/YA/ZA_OFFS and XG/YG/ZG_OFFS), so once the registers are right
+// the readings come out zeroed and nothing has to be added per sample.
+// Finding the register values uses the search of the IMU_Zero example,
+// run for every axis at once:
+//   1. average a batch of readings at the current offsets and make a first
+//      guess from the counts one offset step is expected to move;
+//   2. widen a bracket around the guess (doubling the margin) until one end
+//      reads at or below the target and the other above it;
+//   3. halve the bracket until its ends are neighbours, and keep the end
+//      whose mean was closer to the target.
+// Every trial is the mean of a whole batch (hundreds of readings), so one
+// noisy reading cannot skew the result. The device has to lie still and
+// level, Z up, for the whole run.
+//
+// Usage:
+//     Adxl345Calibration calibrationA(sensorA, AccelConfig::range);
+//     Mpu6050Calibration calibrationC(sensorC, MotionConfig::gyroRange, MotionConfig::accelRange);
+//     OffsetCalibration *calibrations[] = { &calibrationA, &calibrationC };
+//     OffsetCalibration::run(calibrations, 2, 256, 5);
+
+#ifndef _SENSORCALIBRATION_H_
+#define _SENSORCALIBRATION_H_
+
+#include <Arduino.h>
+#include <ADXL345.h>
+#include <MPU6050.h>
+
+#define CALIBRATION_MAX_AXES        6
+#define CALIBRATION_SETTLE_SAMPLES  4       // readings dropped after new offsets, the filters still hold the old ones
+#define CALIBRATION_FIRST_MARGIN    2       // offset steps either side of the first guess
+
+class OffsetCalibration {
+    public:
+        virtual ~OffsetCalibration() {}
+
+        void begin();
+        void addSample();
+        bool step();
+
+        bool isDone() const;
+        uint8_t getAxisCount() const;
+        int16_t getOffset(uint8_t axis) const;
+        int16_t getError(uint8_t axis) const;
+
+        static void run(OffsetCalibration *const *calibrations, uint8_t count, uint16_t samples, uint16_t sampleDelayMs);
+
+    protected:
+        OffsetCalibration(uint8_t axes, int16_t offsetMin, int16_t offsetMax);
+
+        // device access, axis order as targets[]
+        virtual void readOffsets(int16_t *offsets) = 0;
+        virtual void writeOffsets(const int16_t *offsets) = 0;
+        virtual void readSample(int16_t *values) = 0;
+
+        int16_t targets[CALIBRATION_MAX_AXES];          // reading wanted at rest, counts
+        uint8_t countsPerStepQ4[CALIBRATION_MAX_AXES];  // counts one offset step moves the reading (x16), for the first guess only
+
+    private:
+        uint8_t axisCount;
+        int16_t offsetMin;
+        int16_t offsetMax;
+
+        int32_t sums[CALIBRATION_MAX_AXES];
+        uint16_t sampleCount;
+
+        uint8_t phase[CALIBRATION_MAX_AXES];
+        int16_t trial[CALIBRATION_MAX_AXES];
+        int16_t guess[CALIBRATION_MAX_AXES];
+        uint16_t margin[CALIBRATION_MAX_AXES];
+        int16_t low[CALIBRATION_MAX_AXES];          // offset read at or below the target
+        int16_t high[CALIBRATION_MAX_AXES];         // offset read above the target
+        int16_t lowError[CALIBRATION_MAX_AXES];
+        int16_t highError[CALIBRATION_MAX_AXES];
+        int16_t error[CALIBRATION_MAX_AXES];        // mean minus target at the last trial, at the result once done
+
+        int16_t clampOffset(int32_t offset) const;
+        void bisect(uint8_t axis);
+        void finish(uint8_t axis);
+};
+
+class Adxl345Calibration : public OffsetCalibration {
+    public:
+        Adxl345Calibration(ADXL345 &sensor, uint8_t range);
+
+    protected:
+        void readOffsets(int16_t *offsets);
+        void writeOffsets(const int16_t *offsets);
+        void readSample(int16_t *values);
+
+    private:
+        ADXL345 &sensor;
+};
+
+// axes 0-2 accelerometer X/Y/Z, 3-5 gyroscope X/Y/Z
+class Mpu6050Calibration : public OffsetCalibration {
+    public:
+        Mpu6050Calibration(MPU6050 &sensor, uint8_t gyroRange, uint8_t accelRange);
+
+    protected:
+        void readOffsets(int16_t *offsets);
+        void writeOffsets(const int16_t *offsets);
+        void readSample(int16_t *values);
+
+    private:
+        MPU6050 &sensor;
+};
+
+#endif /* _SENSORCALIBRATION_H_ */
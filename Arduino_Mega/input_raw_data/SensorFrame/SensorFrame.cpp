@@ -0,0 +1,270 @@
+// SensorFrame - binary framing for the Mega -> Raspberry Pi serial link
+// See SensorFrame.h for the frame layout.
+
+#include "SensorFrame.h"
+#include <string.h>
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#endif
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_word
+#define pgm_read_word(address) (*(const uint16_t *)(address)) // host builds: the table is in RAM
+#endif
+
+// CRC-16/CCITT-FALSE of every byte value (poly 0x1021, MSB first), in flash on the AVR: 512 bytes of RAM saved
+static const uint16_t crcTable[256] PROGMEM = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+// What the payload length byte adds to the CRC of a frame with n payload bytes: the CRC (zero start)
+// of n at header offset 3 and zeros everywhere else. The CRC is linear, so finish() folds the length
+// into a CRC run with length 0 by XORing this in. 482 bytes of flash
+static const uint16_t lengthCrcTable[SENSORFRAME_MAX_PAYLOAD + 1] PROGMEM = {
+    0x0000, 0x76B4, 0x4483, 0xCEE0, 0xC1C6, 0x48BE, 0x5A88, 0x1CFA,
+    0xA28E, 0x18DD, 0x819C, 0x66C8, 0xBCF7, 0x3973, 0xE55C, 0x01BA,
+    0x305D, 0x5EE0, 0x3500, 0x0B2E, 0xB47B, 0xAB5C, 0x965D, 0x121E,
+    0xED71, 0x7917, 0xF9B5, 0xC229, 0x4AB2, 0x02C8, 0x6E07, 0x164D,
+    0x272C, 0x51C4, 0x8228, 0x7D51, 0x0F6C, 0x734B, 0xDCF5, 0x3922,
+    0xE4DE, 0x2446, 0x4EA2, 0xA3F3, 0x3765, 0xC955, 0xCAE8, 0x8270,
+    0x08DC, 0x2648, 0x8C81, 0x4D63, 0x01E2, 0xB3E6, 0xC1B6, 0xE83B,
+    0x778A, 0x3F3F, 0x126C, 0x25AF, 0xA033, 0x58B8, 0xEA28, 0x38FB,
+    0xC2A5, 0x66F9, 0x554B, 0x34F6, 0x082A, 0x8988, 0x14E0, 0x43B9,
+    0xD148, 0x7220, 0xDDE5, 0x6348, 0x320C, 0x4526, 0x8A6E, 0x06F7,
+    0x3666, 0xD175, 0xB94D, 0xA55F, 0x1C35, 0xB4D2, 0x0B86, 0xC2FF,
+    0x99D9, 0xE499, 0x511C, 0xD125, 0x8F51, 0x4C56, 0x6D27, 0xC27C,
+    0x777D, 0xFA16, 0xF3B6, 0xC41C, 0x981D, 0x1835, 0xAB31, 0x7D1A,
+    0xAF5D, 0xAFB2, 0x6622, 0x4DF7, 0x3D70, 0x3AD9, 0x8BD0, 0xCF44,
+    0x0133, 0xF387, 0xEFFB, 0x37CA, 0x9312, 0x06E5, 0x9BF0, 0x8187,
+    0xBBC5, 0x817F, 0x3051, 0x272D, 0xF9D9, 0x35A3, 0x9EFB, 0x34E2,
+    0x5C1F, 0x3C47, 0x99AA, 0xF8A9, 0x826A, 0x717C, 0xE577, 0xEF23,
+    0x7037, 0x8715, 0x2BC8, 0xD998, 0x1251, 0x27B7, 0xA764, 0xF9CD,
+    0x80DC, 0x13D2, 0xC33E, 0x0120, 0x7F63, 0xA216, 0xDA97, 0x5E9C,
+    0x8AED, 0x916E, 0x9240, 0xDF3C, 0x948F, 0xA56E, 0xCA46, 0xFEBA,
+    0xD81D, 0x2776, 0xA43C, 0xF154, 0x39DC, 0x605F, 0xA969, 0xE68D,
+    0x8104, 0xED27, 0xAF71, 0xC7C0, 0x5E38, 0x7F71, 0x53CD, 0x18B4,
+    0xD9F0, 0xA047, 0x3415, 0xAE4E, 0xDFE0, 0xA80A, 0x65BC, 0xEC89,
+    0x6905, 0x860A, 0xD5A5, 0xD4A3, 0xDCC5, 0xFF74, 0xAF24, 0xA4BD,
+    0x0539, 0x95E6, 0x83A9, 0x26E0, 0xEDA2, 0x1A01, 0x713C, 0x3753,
+    0x9221, 0xDBAF, 0x6553, 0xC155, 0x9291, 0x36B9, 0xE819, 0xC164,
+    0xB55A, 0x1442, 0x0FA3, 0x01A5, 0x56C3, 0x4B51, 0x9625, 0xF2F4,
+    0x7465, 0xB2A1, 0x54B1, 0x86C2, 0xF302, 0x3A7E, 0x6963, 0x37E8,
+    0xCE5A, 0xD925, 0xBDA5, 0xD48C, 0x832F, 0x5929, 0x6872, 0xEA10,
+    0x4D8D, 0xA5D0, 0x2641, 0x1E6A, 0x8B58, 0x9FE8, 0x012C, 0x046F,
+    0x3F27
+};
+
+/** Default constructor. The frame is empty until begin() is called.
+ */
+SensorFrame::SensorFrame() {
+    length = 0;
+    crc = SENSORFRAME_CRC_INIT;
+}
+
+/** Start a new frame, discarding anything previously encoded.
+ * @param type Frame type (SENSORFRAME_TYPE_*)
+ * @param sequence Sequence number stamped into the header
+ */
+void SensorFrame::begin(uint8_t type, uint16_t sequence) {
+    buffer[0] = SENSORFRAME_SYNC1;
+    buffer[1] = SENSORFRAME_SYNC2;
+    buffer[2] = type;
+    buffer[3] = 0;
+    buffer[4] = (uint8_t)sequence;
+    buffer[5] = (uint8_t)(sequence >> 8);
+    length = SENSORFRAME_HEADER_LENGTH;
+    crc = crc16(buffer + 2, SENSORFRAME_HEADER_LENGTH - 2); // length 0 for now, finish() folds in the real one
+}
+
+/** Append one byte to the frame and to the running CRC. The put functions
+ * check the space first.
+ * @param value Byte to append
+ */
+void SensorFrame::append(uint8_t value) {
+    buffer[length++] = value;
+    crc = (crc << 8) ^ pgm_read_word(&crcTable[(uint8_t)(crc >> 8) ^ value]);
+}
+
+/** Append a single byte to the payload.
+ * @param value Byte to append
+ * @return False if the payload is already full (nothing is written)
+ */
+bool SensorFrame::putByte(uint8_t value) {
+    if (getPayloadSpace() < 1) return false;
+    append(value);
+    return true;
+}
+
+/** Append a signed 16-bit value to the payload (little-endian).
+ * @param value Value to append
+ * @return False if there is not enough space left (nothing is written)
+ */
+bool SensorFrame::putInt16(int16_t value) {
+    return putUInt16((uint16_t)value);
+}
+
+/** Append an unsigned 16-bit value to the payload (little-endian).
+ * @param value Value to append
+ * @return False if there is not enough space left (nothing is written)
+ */
+bool SensorFrame::putUInt16(uint16_t value) {
+    if (getPayloadSpace() < 2) return false;
+    append((uint8_t)value);
+    append((uint8_t)(value >> 8));
+    return true;
+}
+
+/** Append an unsigned 32-bit value to the payload (little-endian).
+ * @param value Value to append
+ * @return False if there is not enough space left (nothing is written)
+ */
+bool SensorFrame::putUInt32(uint32_t value) {
+    if (getPayloadSpace() < 4) return false;
+    append((uint8_t)value);
+    append((uint8_t)(value >> 8));
+    append((uint8_t)(value >> 16));
+    append((uint8_t)(value >> 24));
+    return true;
+}
+
+/** Append an IEEE-754 single precision value to the payload (little-endian).
+ * @param value Value to append
+ * @return False if there is not enough space left (nothing is written)
+ */
+bool SensorFrame::putFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return putUInt32(bits);
+}
+
+/** Append an unsigned value as a varint: 7 bits per byte, low groups first,
+ * the top bit set on every byte but the last.
+ * @param value Value to append
+ * @return False if there is not enough space left (nothing is written)
+ */
+bool SensorFrame::putVarUInt(uint32_t value) {
+    uint8_t size = 1;
+    for (uint32_t rest = value >> 7; rest != 0; rest >>= 7) size++;
+    if (getPayloadSpace() < size) return false;
+
+    while (value >= 0x80) {
+        append((uint8_t)value | 0x80);
+        value >>= 7;
+    }
+    append((uint8_t)value);
+    return true;
+}
+
+/** Append the difference between two 16-bit fields, zigzag mapped, as a varint.
+ * Works for signed fields too: the difference is taken modulo 2^16.
+ * @param value Field in this sample
+ * @param previous Same field in the previous sample
+ * @return False if there is not enough space left (nothing is written)
+ */
+bool SensorFrame::putDelta16(uint16_t value, uint16_t previous) {
+    uint16_t delta = value - previous;
+    // small negative differences become small odd numbers
+    return putVarUInt((uint16_t)(delta << 1) ^ ((delta & 0x8000) ? 0xFFFF : 0));
+}
+
+/** Append the difference between two 32-bit fields, zigzag mapped, as a varint.
+ * @param value Field in this sample
+ * @param previous Same field in the previous sample
+ * @return False if there is not enough space left (nothing is written)
+ */
+bool SensorFrame::putDelta32(uint32_t value, uint32_t previous) {
+    uint32_t delta = value - previous;
+    return putVarUInt((delta << 1) ^ ((delta & 0x80000000UL) ? 0xFFFFFFFFUL : 0));
+}
+
+/** Close the frame: fill in the payload length and append the CRC. The put
+ * functions have already run the CRC over the payload, so this only folds in
+ * the length byte, whatever the payload size.
+ * @return Total frame length in bytes, ready to be written to the port
+ */
+uint16_t SensorFrame::finish() {
+    uint8_t payload = getPayloadLength();
+    buffer[3] = payload;
+    crc ^= pgm_read_word(&lengthCrcTable[payload]);
+    buffer[length++] = (uint8_t)crc;
+    buffer[length++] = (uint8_t)(crc >> 8);
+    return length;
+}
+
+/** Get the encoded frame bytes.
+ * @return Pointer to the start of the frame (sync bytes included)
+ */
+const uint8_t *SensorFrame::getData() const {
+    return buffer;
+}
+
+/** Get the number of bytes encoded so far.
+ * @return Frame length in bytes (header, payload and, after finish(), CRC)
+ */
+uint16_t SensorFrame::getLength() const {
+    return length;
+}
+
+/** Get the number of payload bytes encoded so far.
+ * @return Payload length in bytes
+ */
+uint8_t SensorFrame::getPayloadLength() const {
+    uint16_t payload = length - SENSORFRAME_HEADER_LENGTH;
+    return payload > SENSORFRAME_MAX_PAYLOAD ? SENSORFRAME_MAX_PAYLOAD : (uint8_t)payload;
+}
+
+/** Get the number of payload bytes that can still be appended.
+ * @return Free payload space in bytes
+ */
+uint8_t SensorFrame::getPayloadSpace() const {
+    if (length < SENSORFRAME_HEADER_LENGTH) return 0; // begin() not called yet
+    return SENSORFRAME_MAX_PAYLOAD - getPayloadLength();
+}
+
+/** Compute a CRC-16/CCITT-FALSE (poly 0x1021, MSB first).
+ * One table lookup per byte instead of eight shift/xor steps, see
+ * examples/SensorFrame_benchmark for the cost of both on the Mega.
+ * Pass the previous result back in as crc to checksum data in pieces.
+ * @param data Bytes to checksum
+ * @param length Number of bytes
+ * @param crc Running CRC value (SENSORFRAME_CRC_INIT for a fresh checksum)
+ * @return Updated CRC value
+ */
+uint16_t SensorFrame::crc16(const uint8_t *data, uint16_t length, uint16_t crc) {
+    for (uint16_t i = 0; i < length; i++) {
+        crc = (crc << 8) ^ pgm_read_word(&crcTable[(uint8_t)(crc >> 8) ^ data[i]]);
+    }
+    return crc;
+}
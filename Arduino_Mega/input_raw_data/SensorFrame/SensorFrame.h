@@ -0,0 +1,115 @@
+// SensorFrame - binary framing for the Mega -> Raspberry Pi serial link
+// Replaces the comma separated dtostrf() lines and the additive checksum.
+//
+// Frame layout (all multi-byte fields little-endian):
+//
+//   offset  size  field
+//   0       1     sync byte 1 (0xAA)
+//   1       1     sync byte 2 (0x55)
+//   2       1     frame type (SENSORFRAME_TYPE_*)
+//   3       1     payload length in bytes
+//   4       2     sequence number
+//   6       n     payload
+//   6+n     2     CRC-16/CCITT-FALSE over bytes 2 .. 5+n
+//
+// Delta frames: a sample frame type with SENSORFRAME_TYPE_DELTA set holds the
+// same fields, but only its first sample is written out in full (the
+// keyframe). Every later sample stores, field by field, the difference from
+// the sample before it, taken modulo the field width, zigzag mapped
+// (0, -1, 1, -2 ... -> 0, 1, 2, 3 ...) and written as a varint (7 bits per
+// byte, low groups first, top bit set on all but the last byte). Slowly
+// changing fields shrink to one or two bytes, and every frame still decodes
+// on its own.
+//
+// The decoder on the Pi side lives in Raspberry_Pi/serial_frames.py and must
+// be kept in step with any change made here.
+
+#ifndef _SENSORFRAME_H_
+#define _SENSORFRAME_H_
+
+#include <stdint.h>
+
+#define SENSORFRAME_SYNC1               0xAA
+#define SENSORFRAME_SYNC2               0x55
+
+#define SENSORFRAME_HEADER_LENGTH       6
+#define SENSORFRAME_CRC_LENGTH          2
+#define SENSORFRAME_MAX_PAYLOAD         240
+#define SENSORFRAME_MAX_LENGTH          (SENSORFRAME_HEADER_LENGTH + SENSORFRAME_MAX_PAYLOAD + SENSORFRAME_CRC_LENGTH)
+
+#define SENSORFRAME_TYPE_SAMPLES        0x01    // samples: acc1[3], acc2[3], gyro[3] int16, voltage (mV), current (uA) uint16, power (uW), energy (uJ) uint32
+#define SENSORFRAME_TYPE_TIMED_SAMPLES  0x02    // as SAMPLES, each sample preceded by a uint32 micros() timestamp
+#define SENSORFRAME_TYPE_ORIENTATION    0x03    // uint32 micros() timestamp, quaternion w, x, y, z as int16 (1.0 = 16384)
+#define SENSORFRAME_TYPE_DMP_SAMPLES    0x04    // as TIMED_SAMPLES, each sample followed by the DMP quaternion (as ORIENTATION) and linear accel xyz int16 (1g = 8192)
+#define SENSORFRAME_TYPE_CHANNELS       0x05    // uint32 micros() timestamp, uint8 mask of the channels present, then the fields of each present channel in bit order
+#define SENSORFRAME_TYPE_FEATURES       0x06    // uint32 micros() timestamp, uint8 window length, then acc1, acc2, gyro xyz: mean int16, variance uint32, min, max int16, energy uint32
+#define SENSORFRAME_TYPE_HELLO          0x07    // handshake reply, see below
+#define SENSORFRAME_TYPE_DELTA          0x80    // flag on SAMPLES, TIMED_SAMPLES or DMP_SAMPLES: samples after the first are delta coded
+
+#define SENSORFRAME_DELTA16_MAX_LENGTH  3       // varint bytes of a 16-bit field's delta, at worst
+#define SENSORFRAME_DELTA32_MAX_LENGTH  5       // varint bytes of a 32-bit field's delta, at worst
+
+// Channels of a CHANNELS frame (bit numbers in its mask) and their fields
+#define SENSORFRAME_CHANNEL_ACCEL_A     0       // acc1 xyz int16
+#define SENSORFRAME_CHANNEL_ACCEL_B     1       // acc2 xyz int16
+#define SENSORFRAME_CHANNEL_GYRO        2       // gyro xyz int16
+#define SENSORFRAME_CHANNEL_POWER       3       // voltage (mV), current (uA) uint16, power (uW), energy (uJ) uint32
+
+// HELLO frame, the Mega's answer to the Pi's hello and session commands before the handshake:
+//   uint8 handshake version, uint16 firmware version (major << 8 | minor), uint8 acquisition mode,
+//   uint16 capabilities (SENSORFRAME_CAP_*), uint8 base sample period (ms), uint8 most samples per
+//   SAMPLES frame, uint8 status of the last session request (SENSORFRAME_SESSION_*), then the session
+//   in force: uint8 sample divider, uint8 samples per frame, uint8 framing (SENSORFRAME_FRAMING_*),
+//   uint8 divider of each CHANNELS frame channel (0 = never)
+#define SENSORFRAME_HANDSHAKE_VERSION   1
+
+#define SENSORFRAME_CAP_SAMPLE_DIVIDER  0x0001  // the sample rate can be divided down
+#define SENSORFRAME_CAP_DELTA           0x0002  // SENSORFRAME_FRAMING_DELTA
+#define SENSORFRAME_CAP_CHANNELS        0x0004  // SENSORFRAME_FRAMING_CHANNELS
+#define SENSORFRAME_CAP_FEATURES        0x0008  // sends FEATURES frames
+#define SENSORFRAME_CAP_ORIENTATION     0x0010  // sends ORIENTATION frames, or DMP_SAMPLES with a quaternion
+#define SENSORFRAME_CAP_RESEND          0x0020  // answers resend requests
+#define SENSORFRAME_CAP_ACTIVITY_GATING 0x0040  // slows down to keep-alive samples while the sensors are still
+#define SENSORFRAME_CAP_OFFSETS         0x0080  // calibrates and stores the sensor offsets on request
+
+#define SENSORFRAME_FRAMING_SAMPLES     0       // SAMPLES, TIMED_SAMPLES or DMP_SAMPLES frames, per acquisition mode
+#define SENSORFRAME_FRAMING_DELTA       1       // the same with SENSORFRAME_TYPE_DELTA
+#define SENSORFRAME_FRAMING_CHANNELS    2       // CHANNELS frames
+
+#define SENSORFRAME_SESSION_ACCEPTED    0
+#define SENSORFRAME_SESSION_UNSUPPORTED 1       // a setting out of range or not built in, nothing changed
+#define SENSORFRAME_SESSION_OVER_LINK   2       // would not fit the link, nothing changed
+
+#define SENSORFRAME_CRC_INIT            0xFFFF
+
+class SensorFrame {
+    public:
+        SensorFrame();
+
+        void begin(uint8_t type, uint16_t sequence);
+        bool putByte(uint8_t value);
+        bool putInt16(int16_t value);
+        bool putUInt16(uint16_t value);
+        bool putUInt32(uint32_t value);
+        bool putFloat(float value);
+        bool putVarUInt(uint32_t value);
+        bool putDelta16(uint16_t value, uint16_t previous);
+        bool putDelta32(uint32_t value, uint32_t previous);
+        uint16_t finish();
+
+        const uint8_t *getData() const;
+        uint16_t getLength() const;
+        uint8_t getPayloadLength() const;
+        uint8_t getPayloadSpace() const;
+
+        static uint16_t crc16(const uint8_t *data, uint16_t length, uint16_t crc=SENSORFRAME_CRC_INIT);
+
+    private:
+        void append(uint8_t value);
+
+        uint8_t buffer[SENSORFRAME_MAX_LENGTH];
+        uint16_t length;
+        uint16_t crc;       // CRC of the frame so far, with payload length 0
+};
+
+#endif /* _SENSORFRAME_H_ */
@@ -0,0 +1,92 @@
+// SensorFrame CRC benchmark
+//
+// Times the frame CRC with micros() and prints the cost in CPU cycles:
+//   - the bit-by-bit CRC-16 SensorFrame used before the lookup table
+//   - SensorFrame::crc16(), one PROGMEM table lookup per byte
+//   - a full SAMPLES frame (8 samples) from begin() to finish(), what mainTask
+//     pays per frame: the put functions carry the CRC, finish() folds in the length
+// Both CRCs run over the same full-size frame body, and the results are
+// compared, as is the CRC finish() wrote against crc16() over the frame, so a
+// wrong table shows up here rather than as bad frames on the Pi.
+
+#include <SensorFrame.h>
+
+#define ITERATIONS          200
+#define CYCLES_PER_MICRO    (F_CPU / 1000000UL)
+#define BODY_LENGTH         (SENSORFRAME_MAX_LENGTH - 2 - SENSORFRAME_CRC_LENGTH) // type to end of payload
+#define SAMPLES_PER_FRAME   8
+
+uint8_t body[BODY_LENGTH];
+SensorFrame frame;
+volatile uint16_t result;
+
+// the CRC SensorFrame used before the lookup table
+uint16_t crc16Bitwise(const uint8_t *data, uint16_t length, uint16_t crc) {
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+            else              crc <<= 1;
+        }
+    }
+    return crc;
+}
+
+void crcBitwise() {
+    result = crc16Bitwise(body, BODY_LENGTH, SENSORFRAME_CRC_INIT);
+}
+
+void crcTable() {
+    result = SensorFrame::crc16(body, BODY_LENGTH);
+}
+
+void finishFrame() {
+    frame.begin(SENSORFRAME_TYPE_SAMPLES, 0);
+    for (uint8_t n = 0; n < SAMPLES_PER_FRAME; n++) {
+        for (uint8_t field = 0; field < 9; field++) frame.putInt16(field * 100 - n);
+        frame.putUInt16(7400);
+        frame.putUInt16(210);
+        frame.putUInt32(1554000UL);
+        frame.putUInt32(123456UL + n);
+    }
+    result = frame.finish();
+}
+
+uint32_t timeCycles(void (*work)()) {
+    uint32_t t = micros();
+    for (uint16_t n = 0; n < ITERATIONS; n++) work();
+    return (micros() - t) * CYCLES_PER_MICRO / ITERATIONS;
+}
+
+void setup() {
+    Serial.begin(115200);
+    for (uint16_t i = 0; i < BODY_LENGTH; i++) body[i] = i * 37 + 11;
+}
+
+void loop() {
+    Serial.println();
+    Serial.print(BODY_LENGTH);
+    Serial.print(" bytes, ");
+    Serial.print(ITERATIONS);
+    Serial.println(" iterations, loop overhead included");
+
+    uint32_t bitwise = timeCycles(crcBitwise);
+    uint32_t table = timeCycles(crcTable);
+    Serial.print("bitwise\t"); Serial.print(bitwise); Serial.print(" cycles\t");
+    Serial.print(bitwise / BODY_LENGTH); Serial.println(" cycles/byte");
+    Serial.print("table\t"); Serial.print(table); Serial.print(" cycles\t");
+    Serial.print(table / BODY_LENGTH); Serial.println(" cycles/byte");
+
+    uint32_t finish = timeCycles(finishFrame);
+    Serial.print("SAMPLES frame of "); Serial.print(SAMPLES_PER_FRAME);
+    Serial.print(", begin() to finish()\t"); Serial.print(finish); Serial.println(" cycles");
+
+    bool same = crc16Bitwise(body, BODY_LENGTH, SENSORFRAME_CRC_INIT) == SensorFrame::crc16(body, BODY_LENGTH);
+    Serial.println(same ? "CRCs match" : "CRC MISMATCH");
+    const uint8_t *data = frame.getData();
+    uint16_t length = frame.getLength();
+    uint16_t sent = data[length - 2] | (data[length - 1] << 8);
+    Serial.println(sent == SensorFrame::crc16(data + 2, length - 2 - SENSORFRAME_CRC_LENGTH) ? "frame CRC matches" : "FRAME CRC MISMATCH");
+
+    delay(5000);
+}
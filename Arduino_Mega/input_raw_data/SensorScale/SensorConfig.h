@@ -0,0 +1,100 @@
+// SensorConfig - compile-time configuration of the ADXL345 and MPU6050
+//
+// A sensor set-up is a type: the range and rate settings are template
+// parameters, and everything that follows from them (counts per g, the Q10
+// scale constants of SensorScale.h, output rate, filter bandwidth) is a
+// constexpr member worked out by the compiler. apply() writes the same
+// settings to the device, so the registers and the scale factors used on
+// the readings can never disagree. Settings out of range, or a filter that
+// lets through more than half the sample rate, fail to compile.
+//
+// Usage:
+//     typedef Adxl345Config<ADXL345_RANGE_2G, ADXL345_RATE_100> AccelConfig;
+//     typedef Mpu6050Config<MPU6050_GYRO_FS_250, MPU6050_ACCEL_FS_2, MPU6050_DLPF_BW_20, 19> MotionConfig;
+//
+//     AccelConfig::apply(sensorA);
+//     MotionConfig::apply(sensorC);
+//     int32_t mg = sensorScale(raw, AccelConfig::mgQ);
+
+#ifndef _SENSORCONFIG_H_
+#define _SENSORCONFIG_H_
+
+#include "SensorScale.h"
+#include <ADXL345.h>
+#include <MPU6050.h>
+
+/** Bandwidth of an MPU6050 DLPF setting (gyro figures, the accelerometer's are within a few Hz).
+ * @param dlpf MPU6050_DLPF_BW_* setting
+ * @return Bandwidth in Hz
+ */
+constexpr uint16_t mpu6050Bandwidth(uint8_t dlpf) {
+    return dlpf == MPU6050_DLPF_BW_256 ? 256 :
+           dlpf == MPU6050_DLPF_BW_188 ? 188 :
+           dlpf == MPU6050_DLPF_BW_98  ? 98 :
+           dlpf == MPU6050_DLPF_BW_42  ? 42 :
+           dlpf == MPU6050_DLPF_BW_20  ? 20 :
+           dlpf == MPU6050_DLPF_BW_10  ? 10 : 5;
+}
+
+template <uint8_t Range, uint8_t Rate>
+struct Adxl345Config {
+    static_assert(Range <= ADXL345_RANGE_16G, "ADXL345 range must be one of ADXL345_RANGE_*");
+    static_assert(Rate <= ADXL345_RATE_3200, "ADXL345 rate must be one of ADXL345_RATE_*");
+
+    static constexpr uint8_t range = Range;
+    static constexpr uint8_t rate = Rate;
+
+    // 10-bit readings (full resolution off) span the whole range: 256 counts per g at +-2g
+    static constexpr int16_t countsPerG = 256 >> Range;
+    static constexpr int32_t mgQ = sensorScaleQ(1000, countsPerG);
+
+    // output data rate is 3200Hz halved for every step below ADXL345_RATE_3200, bandwidth is half of it
+    static constexpr uint32_t rateMilliHz = 3200000UL >> (ADXL345_RATE_3200 - Rate);
+    static constexpr uint32_t bandwidthMilliHz = rateMilliHz / 2;
+
+    /** Program range and rate into the device.
+     * @param sensor Device to configure, after initialize()
+     */
+    static void apply(ADXL345 &sensor) {
+        sensor.setFullResolution(false);
+        sensor.setRange(Range);
+        sensor.setRate(Rate);
+    }
+};
+
+template <uint8_t GyroRange, uint8_t AccelRange, uint8_t Dlpf, uint8_t RateDivider>
+struct Mpu6050Config {
+    static_assert(GyroRange <= MPU6050_GYRO_FS_2000, "MPU6050 gyro range must be one of MPU6050_GYRO_FS_*");
+    static_assert(AccelRange <= MPU6050_ACCEL_FS_16, "MPU6050 accel range must be one of MPU6050_ACCEL_FS_*");
+    static_assert(Dlpf <= MPU6050_DLPF_BW_5, "MPU6050 filter must be one of MPU6050_DLPF_BW_*");
+
+    static constexpr uint8_t gyroRange = GyroRange;
+    static constexpr uint8_t accelRange = AccelRange;
+    static constexpr uint8_t dlpf = Dlpf;
+    static constexpr uint8_t rateDivider = RateDivider;
+
+    // 16-bit readings: 32768 counts span +-250 deg/s at MPU6050_GYRO_FS_250, +-2g at MPU6050_ACCEL_FS_2
+    static constexpr uint32_t gyroRangeMdps = 250000UL << GyroRange;
+    static constexpr int32_t gyroMdpsQ = sensorScaleQ(gyroRangeMdps, 32768);
+    static constexpr float gyroRadPerCount = gyroRangeMdps / 1000.0f / 32768.0f * 3.14159265f / 180.0f;
+    static constexpr int16_t accelCountsPerG = 16384 >> AccelRange;
+    static constexpr float accelGPerCount = 1.0f / accelCountsPerG;
+
+    // the gyro output rate is 8kHz with the DLPF off and 1kHz with it on, divided by 1 + RateDivider
+    static constexpr uint16_t outputRateHz = Dlpf == MPU6050_DLPF_BW_256 ? 8000 : 1000;
+    static constexpr uint16_t sampleRateHz = outputRateHz / (1 + RateDivider);
+    static constexpr uint16_t bandwidthHz = mpu6050Bandwidth(Dlpf);
+    static_assert(2 * bandwidthHz <= sampleRateHz, "MPU6050 filter bandwidth is above half the sample rate");
+
+    /** Program ranges, filter and sample rate into the device.
+     * @param sensor Device to configure, after initialize()
+     */
+    static void apply(MPU6050 &sensor) {
+        sensor.setFullScaleGyroRange(GyroRange);
+        sensor.setFullScaleAccelRange(AccelRange);
+        sensor.setDLPFMode(Dlpf);
+        sensor.setRate(RateDivider);
+    }
+};
+
+#endif /* _SENSORCONFIG_H_ */
@@ -0,0 +1,84 @@
+// SensorScale - fixed-point scale factors for the sensor readings
+//
+// The ATmega2560 has no FPU, so every float multiply or int/float conversion
+// is a software library call. Each scale factor here is worked out at compile
+// time as a Q10 constant (the real factor times 1024, rounded), so scaling a
+// reading costs one 32-bit integer multiply and a shift. Results are integers
+// in small units (mg, mdeg/s, mV, uA, uW); conversion to float is left to the
+// Pi.
+//
+// The power constants follow the board: 5V ADC reference, battery voltage
+// halved by a divider and the current sensor's RS/RL pair. The accelerometer
+// and gyroscope constants depend on the range the sensor is set to, and come
+// from the configuration templates in SensorConfig.h.
+//
+// Usage:
+//     int32_t mg = sensorScale(raw, AccelConfig::mgQ);
+//     uint16_t mV = sensorScaleVoltage(analogRead(voltageDividerPin));
+
+#ifndef _SENSORSCALE_H_
+#define _SENSORSCALE_H_
+
+#include <stdint.h>
+
+#define SENSORSCALE_Q                   10      // fractional bits of the scale constants
+
+#define SENSORSCALE_ADC_REF_MV          5000UL  // analogRead() reference
+#define SENSORSCALE_ADC_STEPS           1023UL  // 10-bit ADC
+#define SENSORSCALE_DIVIDER_RATIO       2UL     // battery voltage is halved before the ADC
+#define SENSORSCALE_RS_MILLIOHM         100UL   // current sense resistor, 0.1 ohm
+#define SENSORSCALE_RL_OHM              10000UL // current sensor load resistor
+
+/** Round num / den to a Q10 constant at compile time.
+ * @param num Numerator of the real scale factor
+ * @param den Denominator of the real scale factor
+ * @return num / den * 2^SENSORSCALE_Q, rounded to the nearest integer
+ */
+constexpr int32_t sensorScaleQ(uint64_t num, uint64_t den) {
+    return (int32_t)(((num << SENSORSCALE_Q) + den / 2) / den);
+}
+
+// battery mV per ADC count, divider included
+constexpr int32_t SENSORSCALE_VOLTAGE_MV_Q = sensorScaleQ(SENSORSCALE_ADC_REF_MV * SENSORSCALE_DIVIDER_RATIO, SENSORSCALE_ADC_STEPS);
+// uA per ADC count of the current sensor output: I = Vout * 1000 / (RS * RL)
+constexpr int32_t SENSORSCALE_CURRENT_UA_Q = sensorScaleQ(SENSORSCALE_ADC_REF_MV * 1000000ULL,
+                                                          SENSORSCALE_ADC_STEPS * SENSORSCALE_RS_MILLIOHM * SENSORSCALE_RL_OHM);
+
+static_assert(SENSORSCALE_VOLTAGE_MV_Q * SENSORSCALE_ADC_STEPS >> SENSORSCALE_Q <= 0xFFFF, "voltage does not fit in uint16 mV");
+static_assert(SENSORSCALE_CURRENT_UA_Q * SENSORSCALE_ADC_STEPS >> SENSORSCALE_Q <= 0xFFFF, "current does not fit in uint16 uA");
+
+/** Scale a signed reading by a Q10 constant.
+ * @param raw Reading in sensor counts
+ * @param q Q10 scale constant (SENSORSCALE_*_Q, or one of the SensorConfig.h members)
+ * @return raw * q / 1024, rounded towards minus infinity
+ */
+inline int32_t sensorScale(int32_t raw, int32_t q) {
+    return (raw * q) >> SENSORSCALE_Q;
+}
+
+/** Convert a voltage divider ADC reading to the battery voltage.
+ * @param adc analogRead() result (0 to 1023)
+ * @return Battery voltage in mV
+ */
+inline uint16_t sensorScaleVoltage(uint16_t adc) {
+    return (uint16_t)(((uint32_t)adc * SENSORSCALE_VOLTAGE_MV_Q) >> SENSORSCALE_Q);
+}
+
+/** Convert a current sensor ADC reading to the current drawn.
+ * @param adc analogRead() result (0 to 1023)
+ * @return Current in uA
+ */
+inline uint16_t sensorScaleCurrent(uint16_t adc) {
+    return (uint16_t)(((uint32_t)adc * SENSORSCALE_CURRENT_UA_Q) >> SENSORSCALE_Q);
+}
+
+/** Multiply voltage and current into power.
+ * @param millivolts Voltage in mV
+ * @param microamps Current in uA
+ * @return Power in uW
+ */
+inline uint32_t sensorScalePower(uint16_t millivolts, uint16_t microamps) {
+    return ((uint32_t)millivolts * microamps + 500) / 1000;
+}
+
+#endif /* _SENSORSCALE_H_ */
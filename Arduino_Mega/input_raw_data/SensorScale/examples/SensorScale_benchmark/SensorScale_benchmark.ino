@@ -0,0 +1,104 @@
+// SensorScale float vs fixed-point benchmark
+//
+// Times the per-sample scaling work both ways with micros() and prints the
+// cost in CPU cycles:
+//   - nine IMU readings scaled to g / deg/s (float) or mg / mdeg/s (Q10)
+//   - voltage, current, power and energy from two ADC readings
+// The inputs are volatile so the compiler cannot fold the math away.
+
+#include <SensorScale.h>
+#include <SensorConfig.h>
+
+#define ITERATIONS          1000
+#define CYCLES_PER_MICRO    (F_CPU / 1000000UL)
+#define SAMPLE_PERIOD_MS    20
+
+typedef Adxl345Config<ADXL345_RANGE_2G, ADXL345_RATE_100> AccelConfig;
+typedef Mpu6050Config<MPU6050_GYRO_FS_250, MPU6050_ACCEL_FS_2, MPU6050_DLPF_BW_256, 0> MotionConfig;
+
+volatile int16_t imuRaw[9] = { 120, -35, 250, 118, -40, 255, 1500, -320, 42 };
+volatile uint16_t adcVoltage = 760;
+volatile uint16_t adcCurrent = 210;
+
+volatile float floatOut[9];
+volatile int32_t fixedOut[9];
+volatile float floatPower[4];
+volatile uint32_t fixedPower[4];
+
+const float scaleFactorAccel = (2 - (-2)) / 1023.0;
+const float scaleFactorGyro = (250 - (-250)) / 65535.0;
+
+void scaleFloat() {
+    for (uint8_t i = 0; i < 6; i++) floatOut[i] = imuRaw[i] * scaleFactorAccel;
+    for (uint8_t i = 6; i < 9; i++) floatOut[i] = imuRaw[i] * scaleFactorGyro;
+}
+
+void scaleFixed() {
+    for (uint8_t i = 0; i < 6; i++) fixedOut[i] = sensorScale(imuRaw[i], AccelConfig::mgQ);
+    for (uint8_t i = 6; i < 9; i++) fixedOut[i] = sensorScale(imuRaw[i], MotionConfig::gyroMdpsQ);
+}
+
+// the power path mega.ino used before SensorScale
+void powerFloat() {
+    float voltage = (5.0 / 1023) * adcVoltage * 2;
+    float vOut = (5.0 / 1023) * adcCurrent;
+    float current = (vOut * 1000) / (0.1 * 10000);
+    float power = current * voltage;
+    floatPower[0] = voltage;
+    floatPower[1] = current;
+    floatPower[2] = power;
+    floatPower[3] += (SAMPLE_PERIOD_MS / 1000.0) * power;
+}
+
+void powerFixed() {
+    static uint32_t remainder = 0;
+    uint16_t voltage = sensorScaleVoltage(adcVoltage);
+    uint16_t current = sensorScaleCurrent(adcCurrent);
+    uint32_t power = sensorScalePower(voltage, current);
+    fixedPower[0] = voltage;
+    fixedPower[1] = current;
+    fixedPower[2] = power;
+    remainder += power * SAMPLE_PERIOD_MS;
+    fixedPower[3] += remainder / 1000;
+    remainder %= 1000;
+}
+
+uint32_t timeCycles(void (*work)()) {
+    uint32_t t = micros();
+    for (uint16_t n = 0; n < ITERATIONS; n++) work();
+    return (micros() - t) * CYCLES_PER_MICRO / ITERATIONS;
+}
+
+void printResult(const char *name, uint32_t floatCycles, uint32_t fixedCycles) {
+    Serial.print(name);
+    Serial.print("\tfloat="); Serial.print(floatCycles);
+    Serial.print(" cycles\tfixed="); Serial.print(fixedCycles);
+    Serial.print(" cycles\tsaved="); Serial.println((int32_t)(floatCycles - fixedCycles));
+}
+
+void setup() {
+    Serial.begin(115200);
+}
+
+void loop() {
+    Serial.println();
+    Serial.print(ITERATIONS);
+    Serial.println(" iterations, loop overhead included");
+
+    uint32_t imuFloat = timeCycles(scaleFloat);
+    uint32_t imuFixed = timeCycles(scaleFixed);
+    printResult("imu x9", imuFloat, imuFixed);
+
+    uint32_t pwrFloat = timeCycles(powerFloat);
+    uint32_t pwrFixed = timeCycles(powerFixed);
+    printResult("power", pwrFloat, pwrFixed);
+
+    printResult("per sample", imuFloat + pwrFloat, imuFixed + pwrFixed);
+
+    // same readings both ways, to check the fixed-point results
+    Serial.print("voltage "); Serial.print(floatPower[0], 3); Serial.print(" V = "); Serial.print(fixedPower[0]); Serial.println(" mV");
+    Serial.print("current "); Serial.print(floatPower[1], 3); Serial.print(" mA = "); Serial.print(fixedPower[1]); Serial.println(" uA");
+    Serial.print("power "); Serial.print(floatPower[2], 3); Serial.print(" mW = "); Serial.print(fixedPower[2]); Serial.println(" uW");
+
+    delay(5000);
+}
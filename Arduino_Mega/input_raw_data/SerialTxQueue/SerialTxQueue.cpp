@@ -0,0 +1,180 @@
+// SerialTxQueue - interrupt driven USART1 driver for the link to the Raspberry Pi
+// See SerialTxQueue.h for an overview.
+
+#include "SerialTxQueue.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#if (SERIALTXQUEUE_TX_SIZE & (SERIALTXQUEUE_TX_SIZE - 1)) != 0
+#error "SERIALTXQUEUE_TX_SIZE must be a power of two"
+#endif
+#if (SERIALTXQUEUE_RX_SIZE & (SERIALTXQUEUE_RX_SIZE - 1)) != 0 || SERIALTXQUEUE_RX_SIZE > 256
+#error "SERIALTXQUEUE_RX_SIZE must be a power of two no larger than 256"
+#endif
+
+#define TX_MASK (SERIALTXQUEUE_TX_SIZE - 1)
+#define RX_MASK (SERIALTXQUEUE_RX_SIZE - 1)
+
+// Ring state shared with the ISRs. The task side only writes txHead and
+// rxTail, the ISRs only write txTail and rxHead.
+static uint8_t txBuffer[SERIALTXQUEUE_TX_SIZE];
+static volatile uint16_t txHead = 0;
+static volatile uint16_t txTail = 0;
+static uint8_t rxBuffer[SERIALTXQUEUE_RX_SIZE];
+static volatile uint8_t rxHead = 0;
+static volatile uint8_t rxTail = 0;
+
+static uint16_t highWaterMark = 0;
+static uint16_t framesQueued = 0;
+static uint16_t framesDropped = 0;
+static volatile uint16_t rxOverruns = 0;
+
+/** Set up USART1 for 8N1 at the given baud rate and enable its interrupts.
+ * Uses double speed mode like HardwareSerial, so 115200 baud comes out at
+ * 117647 (+2.1%) from a 16MHz clock, the same as Serial1.
+ * @param baud Baud rate
+ */
+void SerialTxQueue::begin(uint32_t baud) {
+    uint16_t setting = (F_CPU / 4 / baud - 1) / 2;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        txHead = txTail = 0;
+        rxHead = rxTail = 0;
+    }
+    UCSR1A = _BV(U2X1);
+    UBRR1H = setting >> 8;
+    UBRR1L = setting;
+    UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+    UCSR1B = _BV(RXEN1) | _BV(TXEN1) | _BV(RXCIE1);
+}
+
+/** Queue a block of bytes for sending, all or nothing.
+ * Never waits: if the ring cannot take the whole block, nothing is queued
+ * and the block is counted as dropped.
+ * @param data Bytes to send
+ * @param length Number of bytes
+ * @return False if the block was dropped
+ */
+bool SerialTxQueue::enqueue(const uint8_t *data, uint16_t length) {
+    if (length > getFree()) {
+        framesDropped++;
+        return false;
+    }
+
+    // only this side writes txHead, so it can be read without a lock
+    uint16_t head = txHead;
+    for (uint16_t i = 0; i < length; i++) {
+        txBuffer[head] = data[i];
+        head = (head + 1) & TX_MASK;
+    }
+
+    uint16_t queued;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        txHead = head;
+        UCSR1B |= _BV(UDRIE1);
+        queued = (txHead - txTail) & TX_MASK;
+    }
+    if (queued > highWaterMark) highWaterMark = queued;
+    framesQueued++;
+    return true;
+}
+
+/** Queue a single byte, e.g. a handshake reply.
+ * @param data Byte to send
+ * @return False if the ring was full (the byte is dropped)
+ */
+bool SerialTxQueue::write(uint8_t data) {
+    return enqueue(&data, 1);
+}
+
+/** Get the number of bytes waiting to be sent.
+ * @return Queued bytes
+ */
+uint16_t SerialTxQueue::getQueued() {
+    uint16_t queued;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        queued = (txHead - txTail) & TX_MASK;
+    }
+    return queued;
+}
+
+/** Get the number of bytes enqueue() can take right now.
+ * One slot is kept empty to tell a full ring from an empty one.
+ * @return Free bytes
+ */
+uint16_t SerialTxQueue::getFree() {
+    return SERIALTXQUEUE_TX_SIZE - 1 - getQueued();
+}
+
+/** Wait until everything queued has been handed to the USART.
+ */
+void SerialTxQueue::flush() {
+    while (getQueued() > 0);
+}
+
+/** Get the number of received bytes waiting to be read.
+ * @return Bytes available
+ */
+int SerialTxQueue::available() {
+    return (uint8_t)(rxHead - rxTail) & RX_MASK;
+}
+
+/** Read one received byte.
+ * @return The byte, or -1 if nothing has been received
+ */
+int SerialTxQueue::read() {
+    uint8_t tail = rxTail;
+    if (rxHead == tail) return -1;
+    uint8_t data = rxBuffer[tail];
+    rxTail = (tail + 1) & RX_MASK;
+    return data;
+}
+
+/** Get the queue statistics.
+ * @param stats Where to store them
+ */
+void SerialTxQueue::getStats(SerialTxQueueStats *stats) {
+    stats->queued = getQueued();
+    stats->highWaterMark = highWaterMark;
+    stats->framesQueued = framesQueued;
+    stats->framesDropped = framesDropped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats->rxOverruns = rxOverruns;
+    }
+}
+
+/** Start a new high-water measurement, e.g. after printing the statistics.
+ * The frame counters keep running.
+ */
+void SerialTxQueue::resetHighWaterMark() {
+    highWaterMark = getQueued();
+}
+
+// Data register empty: move the next queued byte to the USART, and switch
+// the interrupt off once the ring is empty (enqueue() switches it back on).
+ISR(USART1_UDRE_vect) {
+    uint16_t tail = txTail;
+    if (txHead == tail) {
+        UCSR1B &= ~_BV(UDRIE1);
+        return;
+    }
+    UDR1 = txBuffer[tail];
+    tail = (tail + 1) & TX_MASK;
+    txTail = tail;
+    if (txHead == tail) UCSR1B &= ~_BV(UDRIE1);
+}
+
+// Byte received: keep it unless it has a parity error or the ring is full.
+ISR(USART1_RX_vect) {
+    bool parityError = UCSR1A & _BV(UPE1);
+    uint8_t data = UDR1;
+    if (parityError) return;
+
+    uint8_t next = (rxHead + 1) & RX_MASK;
+    if (next == rxTail) {
+        rxOverruns++;
+        return;
+    }
+    rxBuffer[rxHead] = data;
+    rxHead = next;
+}
@@ -0,0 +1,54 @@
+// SerialTxQueue - interrupt driven USART1 driver for the link to the Raspberry Pi
+//
+// HardwareSerial only buffers 64 bytes, so Serial1.write() of a full frame
+// busy-waits until most of it has gone out, and the sampling task stalls
+// with it. Here enqueue() copies a whole frame into a large static ring in
+// one call and returns at once; the USART data register empty (UDRE)
+// interrupt then feeds the ring to the port one byte at a time. A frame that
+// does not fit is dropped whole and counted, never split or waited for.
+//
+// The driver owns the USART1 interrupt vectors, so it cannot be linked
+// together with Serial1: a sketch using it must not reference Serial1 at all.
+// Received bytes (the handshake) go into a small RX ring read with
+// available() and read().
+//
+// All methods are static; there is only one USART1.
+
+#ifndef _SERIALTXQUEUE_H_
+#define _SERIALTXQUEUE_H_
+
+#include <Arduino.h>
+
+#ifndef SERIALTXQUEUE_TX_SIZE
+#define SERIALTXQUEUE_TX_SIZE       1024    // bytes, power of two; holds a full ADXL345 FIFO drain (32 samples)
+#endif
+#ifndef SERIALTXQUEUE_RX_SIZE
+#define SERIALTXQUEUE_RX_SIZE       32      // bytes, power of two, at most 256
+#endif
+
+typedef struct SerialTxQueueStats {
+    uint16_t queued;            // bytes waiting right now
+    uint16_t highWaterMark;     // most bytes ever waiting since the last reset
+    uint16_t framesQueued;
+    uint16_t framesDropped;     // enqueue() calls refused for lack of space
+    uint16_t rxOverruns;        // received bytes lost because the RX ring was full
+} SerialTxQueueStats;
+
+class SerialTxQueue {
+    public:
+        static void begin(uint32_t baud);
+
+        static bool enqueue(const uint8_t *data, uint16_t length);
+        static bool write(uint8_t data);
+        static uint16_t getQueued();
+        static uint16_t getFree();
+        static void flush();
+
+        static int available();
+        static int read();
+
+        static void getStats(SerialTxQueueStats *stats);
+        static void resetHighWaterMark();
+};
+
+#endif /* _SERIALTXQUEUE_H_ */
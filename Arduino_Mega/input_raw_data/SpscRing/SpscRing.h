@@ -0,0 +1,100 @@
+// SpscRing - fixed capacity single-producer/single-consumer ring buffer
+//
+// One task (or ISR) pushes, one other task pops, and neither ever blocks or
+// takes a lock: only the producer writes head, only the consumer writes
+// tail, and both are single bytes, which the AVR loads and stores in one
+// instruction. The capacity is a template parameter, so the storage is a
+// plain array sized at compile time and nothing comes from the heap.
+//
+// When the ring is full push() drops the new item and counts an overrun
+// instead of waiting, so a slow consumer can never stall the producer.
+//
+// Usage:
+//     SpscRing<Packet, 16> packets;
+//     packets.push(packet);              // producer
+//     while (packets.pop(&packet)) ...   // consumer
+
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+#include <stdint.h>
+#ifdef __AVR__
+#include <util/atomic.h>
+#endif
+
+// Keeps the compiler from moving the item copy past the index update
+#define SPSCRING_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+template <typename T, uint8_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && Capacity <= 128 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two from 2 to 128");
+
+    public:
+        SpscRing() : head(0), tail(0), overruns(0) {}
+
+        /** Append an item. Producer side only.
+         * @param item Item to copy into the ring
+         * @return False if the ring was full (the item is dropped and counted as an overrun)
+         */
+        bool push(const T &item) {
+            uint8_t h = head;
+            if ((uint8_t)(h - tail) >= Capacity) {
+                overruns++;
+                return false;
+            }
+            items[h & (Capacity - 1)] = item;
+            SPSCRING_BARRIER();
+            head = h + 1;
+            return true;
+        }
+
+        /** Take the oldest item out. Consumer side only.
+         * @param item Where to copy the item
+         * @return False if the ring was empty
+         */
+        bool pop(T *item) {
+            uint8_t t = tail;
+            if (head == t) return false;
+            *item = items[t & (Capacity - 1)];
+            SPSCRING_BARRIER();
+            tail = t + 1;
+            return true;
+        }
+
+        /** Get the number of items waiting. Exact on the consumer side, a lower
+         * bound on the producer side.
+         * @return Items that pop() can return
+         */
+        uint8_t available() const {
+            return (uint8_t)(head - tail);
+        }
+
+        /** Get the number of items push() had to drop since construction.
+         * Safe to call from either side.
+         * @return Overrun count
+         */
+        uint16_t getOverrunCount() const {
+            uint16_t count;
+#ifdef __AVR__
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                count = overruns;
+            }
+#else
+            count = overruns;
+#endif
+            return count;
+        }
+
+        static uint8_t capacity() {
+            return Capacity;
+        }
+
+    private:
+        T items[Capacity];
+        volatile uint8_t head;      // next slot to write, free running
+        volatile uint8_t tail;      // next slot to read, free running
+        volatile uint16_t overruns;
+};
+
+#endif /* _SPSCRING_H_ */
@@ -0,0 +1,66 @@
+// StoredConfig - versioned, CRC-protected settings block in EEPROM
+// See StoredConfig.h for an overview.
+
+#include "StoredConfig.h"
+#include <EEPROM.h>
+#include <SensorFrame.h>
+
+/** Read the settings stored at an address.
+ * @param address EEPROM address of the block
+ * @param version Version the settings must have been saved with
+ * @param settings Where to copy the settings, untouched unless the block is valid
+ * @param size Size of the settings
+ * @return True if a valid block of this version and size was found and copied
+ */
+bool StoredConfig::load(uint16_t address, uint8_t version, void *settings, uint8_t size) {
+    uint8_t header[2] = { version, size };
+    uint16_t crc;
+    uint16_t stored;
+    uint8_t value;
+
+    if ((uint32_t)address + STOREDCONFIG_OVERHEAD + size > EEPROM.length()) return false;
+    if (EEPROM.read(address) != STOREDCONFIG_MAGIC) return false;
+    if (EEPROM.read(address + 1) != version || EEPROM.read(address + 2) != size) return false;
+
+    crc = SensorFrame::crc16(header, sizeof(header));
+    for (uint8_t n = 0; n < size; n++) {
+        value = EEPROM.read(address + 3 + n);
+        crc = SensorFrame::crc16(&value, 1, crc);
+    }
+    stored = EEPROM.read(address + 3 + size) | (EEPROM.read(address + 4 + size) << 8);
+    if (stored != crc) return false;
+
+    for (uint8_t n = 0; n < size; n++) ((uint8_t *)settings)[n] = EEPROM.read(address + 3 + n);
+    return true;
+}
+
+/** Store settings at an address. Bytes that already hold the right value are not written.
+ * The magic byte goes last, so a block torn by a reset is never taken for valid.
+ * @param address EEPROM address of the block, STOREDCONFIG_OVERHEAD + size bytes are used
+ * @param version Version of the settings
+ * @param settings Settings to store
+ * @param size Size of the settings
+ */
+void StoredConfig::save(uint16_t address, uint8_t version, const void *settings, uint8_t size) {
+    uint8_t header[2] = { version, size };
+    uint16_t crc;
+
+    if ((uint32_t)address + STOREDCONFIG_OVERHEAD + size > EEPROM.length()) return;
+
+    EEPROM.update(address, 0xFF);
+    EEPROM.update(address + 1, version);
+    EEPROM.update(address + 2, size);
+    crc = SensorFrame::crc16(header, sizeof(header));
+    crc = SensorFrame::crc16((const uint8_t *)settings, size, crc);
+    for (uint8_t n = 0; n < size; n++) EEPROM.update(address + 3 + n, ((const uint8_t *)settings)[n]);
+    EEPROM.update(address + 3 + size, crc & 0xFF);
+    EEPROM.update(address + 4 + size, crc >> 8);
+    EEPROM.update(address, STOREDCONFIG_MAGIC);
+}
+
+/** Invalidate the block at an address, load() fails until the next save().
+ * @param address EEPROM address of the block
+ */
+void StoredConfig::erase(uint16_t address) {
+    EEPROM.update(address, 0xFF);
+}
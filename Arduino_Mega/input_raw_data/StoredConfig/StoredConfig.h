@@ -0,0 +1,41 @@
+// StoredConfig - versioned, CRC-protected settings block in EEPROM
+//
+// A sketch keeps its settings in a plain struct and stores it with save();
+// at the next boot load() hands it back in a few hundred microseconds instead
+// of the sketch working the settings out again. Layout at `address`:
+//
+//   offset  size  field
+//   0       1     STOREDCONFIG_MAGIC
+//   1       1     version, chosen by the sketch
+//   2       1     size of the settings
+//   3       n     settings
+//   3+n     2     CRC-16/CCITT-FALSE over bytes 1 .. 2+n (SensorFrame::crc16)
+//
+// load() refuses blank EEPROM, a block written by another version or for a
+// struct of another size, and a block whose CRC does not match (a write torn
+// by a reset), and leaves the caller's struct untouched then. Change the
+// version whenever the meaning of the struct changes. save() only writes the
+// bytes that differ, an EEPROM cell lasts about 100000 writes.
+//
+// Usage:
+//     if (!StoredConfig::load(0, SETTINGS_VERSION, &settings, sizeof(settings))) {
+//         calibrate(&settings);
+//         StoredConfig::save(0, SETTINGS_VERSION, &settings, sizeof(settings));
+//     }
+
+#ifndef _STOREDCONFIG_H_
+#define _STOREDCONFIG_H_
+
+#include <Arduino.h>
+
+#define STOREDCONFIG_MAGIC      0xC5
+#define STOREDCONFIG_OVERHEAD   5       // magic, version, size and CRC around the settings
+
+class StoredConfig {
+    public:
+        static bool load(uint16_t address, uint8_t version, void *settings, uint8_t size);
+        static void save(uint16_t address, uint8_t version, const void *settings, uint8_t size);
+        static void erase(uint16_t address);
+};
+
+#endif /* _STOREDCONFIG_H_ */
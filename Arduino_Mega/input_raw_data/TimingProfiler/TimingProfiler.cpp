@@ -0,0 +1,124 @@
+// TimingProfiler - micros() based timing budget counters for periodic tasks
+// See TimingProfiler.h for an overview.
+
+#include "TimingProfiler.h"
+
+/** Default constructor. All phases start unnamed with 1 ms histogram bins.
+ */
+TimingProfiler::TimingProfiler() {
+    for (uint8_t phase = 0; phase < PROFILER_MAX_PHASES; phase++) {
+        names[phase] = NULL;
+        stats[phase].budgetMicros = 0;
+        stats[phase].binMicros = 1000;
+        startedAt[phase] = 0;
+    }
+    reset();
+}
+
+/** Name a phase and set up its histogram and budget.
+ * @param phase Phase index (0 to PROFILER_MAX_PHASES - 1)
+ * @param name Label printed by dump(), phases without a name are skipped
+ * @param binMicros Histogram bin width in microseconds
+ * @param budgetMicros Durations above this are counted as over budget (0 to disable)
+ */
+void TimingProfiler::configure(uint8_t phase, const char *name, uint16_t binMicros, uint32_t budgetMicros) {
+    if (phase >= PROFILER_MAX_PHASES) return;
+    names[phase] = name;
+    stats[phase].binMicros = binMicros > 0 ? binMicros : 1;
+    stats[phase].budgetMicros = budgetMicros;
+}
+
+/** Clear all counters. Names, bin widths and budgets are kept.
+ */
+void TimingProfiler::reset() {
+    for (uint8_t phase = 0; phase < PROFILER_MAX_PHASES; phase++) {
+        PhaseStats *s = &stats[phase];
+        s->minMicros = 0xFFFFFFFF;
+        s->maxMicros = 0;
+        s->totalMicros = 0;
+        s->count = 0;
+        s->overBudget = 0;
+        for (uint8_t bin = 0; bin < PROFILER_HISTOGRAM_BINS; bin++) s->histogram[bin] = 0;
+    }
+}
+
+/** Mark the start of a phase.
+ * @param phase Phase index
+ */
+void TimingProfiler::start(uint8_t phase) {
+    if (phase >= PROFILER_MAX_PHASES) return;
+    startedAt[phase] = micros();
+}
+
+/** Mark the end of a phase and record its duration.
+ * @param phase Phase index
+ * @return Duration in microseconds since the matching start()
+ */
+uint32_t TimingProfiler::stop(uint8_t phase) {
+    if (phase >= PROFILER_MAX_PHASES) return 0;
+    uint32_t elapsed = micros() - startedAt[phase]; // unsigned subtraction handles micros() wrap
+    record(phase, elapsed);
+    return elapsed;
+}
+
+/** Record a duration measured elsewhere, e.g. the interval between two wake-ups.
+ * @param phase Phase index
+ * @param elapsed Duration in microseconds
+ */
+void TimingProfiler::record(uint8_t phase, uint32_t elapsed) {
+    if (phase >= PROFILER_MAX_PHASES) return;
+    PhaseStats *s = &stats[phase];
+    if (elapsed < s->minMicros) s->minMicros = elapsed;
+    if (elapsed > s->maxMicros) s->maxMicros = elapsed;
+    s->totalMicros += elapsed;
+    s->count++;
+    if (s->budgetMicros > 0 && elapsed > s->budgetMicros && s->overBudget < 0xFFFF) s->overBudget++;
+
+    uint32_t bin = elapsed / s->binMicros;
+    if (bin >= PROFILER_HISTOGRAM_BINS) bin = PROFILER_HISTOGRAM_BINS - 1;
+    if (s->histogram[bin] < 0xFFFF) s->histogram[bin]++;
+}
+
+/** Get the counters of one phase.
+ * @param phase Phase index
+ * @return Pointer to the phase counters, or NULL for an invalid index
+ */
+const PhaseStats *TimingProfiler::getStats(uint8_t phase) const {
+    if (phase >= PROFILER_MAX_PHASES) return NULL;
+    return &stats[phase];
+}
+
+/** Print one line per named phase:
+ * name n=count min/avg/max us, over-budget count and the histogram bins.
+ * @param out Where to print, usually Serial
+ */
+void TimingProfiler::dump(Print &out) const {
+    for (uint8_t phase = 0; phase < PROFILER_MAX_PHASES; phase++) {
+        const PhaseStats *s = &stats[phase];
+        if (names[phase] == NULL) continue;
+
+        out.print(names[phase]);
+        out.print(" n=");
+        out.print(s->count);
+        if (s->count > 0) {
+            out.print(" min=");
+            out.print(s->minMicros);
+            out.print(" avg=");
+            out.print(s->totalMicros / s->count);
+            out.print(" max=");
+            out.print(s->maxMicros);
+        }
+        if (s->budgetMicros > 0) {
+            out.print(" over=");
+            out.print(s->overBudget);
+        }
+        out.print(" hist/");
+        out.print(s->binMicros);
+        out.print("us:");
+        for (uint8_t bin = 0; bin < PROFILER_HISTOGRAM_BINS; bin++) {
+            out.print(' ');
+            out.print(s->histogram[bin]);
+        }
+        out.println();
+    }
+}
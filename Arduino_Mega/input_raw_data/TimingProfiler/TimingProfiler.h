@@ -0,0 +1,48 @@
+// TimingProfiler - micros() based timing budget counters for periodic tasks
+//
+// Each phase of a loop (bus reads, formatting, serial write, ...) gets a
+// fixed-size PhaseStats block holding min/max/total, an over-budget counter
+// and a histogram. Nothing is allocated at run time, and start()/stop() only
+// cost a micros() call and a few additions, so the profiler can stay in the
+// sampling task while it runs at full rate.
+
+#ifndef _TIMINGPROFILER_H_
+#define _TIMINGPROFILER_H_
+
+#include <Arduino.h>
+
+#define PROFILER_MAX_PHASES         8
+#define PROFILER_HISTOGRAM_BINS     16
+
+typedef struct PhaseStats {
+    uint32_t minMicros;
+    uint32_t maxMicros;
+    uint32_t totalMicros;
+    uint32_t count;
+    uint32_t budgetMicros;                          // 0 = no budget
+    uint16_t overBudget;
+    uint16_t binMicros;                             // histogram bin width
+    uint16_t histogram[PROFILER_HISTOGRAM_BINS];    // last bin also counts everything above it
+} PhaseStats;
+
+class TimingProfiler {
+    public:
+        TimingProfiler();
+
+        void configure(uint8_t phase, const char *name, uint16_t binMicros, uint32_t budgetMicros=0);
+        void reset();
+
+        void start(uint8_t phase);
+        uint32_t stop(uint8_t phase);
+        void record(uint8_t phase, uint32_t elapsed);
+
+        const PhaseStats *getStats(uint8_t phase) const;
+        void dump(Print &out) const;
+
+    private:
+        PhaseStats stats[PROFILER_MAX_PHASES];
+        const char *names[PROFILER_MAX_PHASES];
+        uint32_t startedAt[PROFILER_MAX_PHASES];
+};
+
+#endif /* _TIMINGPROFILER_H_ */
@@ -0,0 +1,110 @@
+// WindowStats - sliding-window statistics over a multi-channel sample stream
+// See WindowStats.h for an overview.
+
+#include "WindowStats.h"
+
+/** Default constructor. Call begin() before adding samples.
+ */
+WindowStats::WindowStats() {
+    channelCount = 0;
+    windowLength = 1;
+    hopLength = 1;
+    reset();
+}
+
+/** Set the shape of the stream and empty the window.
+ * @param channels Values per sample, 1 to WINDOWSTATS_MAX_CHANNELS
+ * @param window Samples per window, 1 to WINDOWSTATS_MAX_WINDOW
+ * @param hop Samples between two reports, 1 to window
+ * @return False if a parameter is out of range (nothing is changed)
+ */
+bool WindowStats::begin(uint8_t channels, uint8_t window, uint8_t hop) {
+    if (channels == 0 || channels > WINDOWSTATS_MAX_CHANNELS) return false;
+    if (window == 0 || window > WINDOWSTATS_MAX_WINDOW) return false;
+    if (hop == 0 || hop > window) return false;
+
+    channelCount = channels;
+    windowLength = window;
+    hopLength = hop;
+    reset();
+    return true;
+}
+
+/** Empty the window, the next report comes once it is full again.
+ */
+void WindowStats::reset() {
+    for (uint8_t channel = 0; channel < WINDOWSTATS_MAX_CHANNELS; channel++) {
+        sums[channel] = 0;
+        sumSquares[channel] = 0;
+    }
+    count = 0;
+    head = 0;
+    sinceHop = 0;
+}
+
+/** Add a sample, dropping the oldest one if the window is full.
+ * @param sample One value per channel
+ * @return True if a hop just ended with a full window: getStats() is due
+ */
+bool WindowStats::add(const int16_t *sample) {
+    int16_t *slot = history[head];
+
+    for (uint8_t channel = 0; channel < channelCount; channel++) {
+        if (count == windowLength) {
+            int16_t old = slot[channel];
+            sums[channel] -= old;
+            sumSquares[channel] -= (uint32_t)((int32_t)old * old);
+        }
+        int16_t value = sample[channel];
+        slot[channel] = value;
+        sums[channel] += value;
+        sumSquares[channel] += (uint32_t)((int32_t)value * value);
+    }
+    if (count < windowLength) count++;
+    head = head + 1 < windowLength ? head + 1 : 0;
+
+    if (sinceHop < 0xFF) sinceHop++;
+    if (count < windowLength || sinceHop < hopLength) return false;
+    sinceHop = 0;
+    return true;
+}
+
+/** Get the number of samples in the window.
+ * @return Sample count, windowLength once the window has filled
+ */
+uint8_t WindowStats::getCount() const {
+    return count;
+}
+
+/** Get the statistics of one channel over the samples in the window.
+ * @param channel Index of the value in the samples given to add()
+ * @param stats Filled in, all zero while the window is empty
+ * @return False if channel is out of range (stats is not touched)
+ */
+bool WindowStats::getStats(uint8_t channel, WindowChannelStats *stats) const {
+    if (channel >= channelCount) return false;
+    if (count == 0) {
+        stats->mean = stats->min = stats->max = 0;
+        stats->variance = stats->energy = 0;
+        return true;
+    }
+
+    int32_t sum = sums[channel];
+    int64_t n = count;
+    // round half away from zero
+    stats->mean = (sum + (sum >= 0 ? count / 2 : -(int32_t)(count / 2))) / (int32_t)count;
+    // n * sum(x^2) - sum(x)^2 = n^2 * variance, exact in 64 bits for 64 int16 values
+    stats->variance = (uint32_t)((n * (int64_t)sumSquares[channel] - (int64_t)sum * sum) / (n * n));
+    stats->energy = (uint32_t)(sumSquares[channel] / count);
+
+    int16_t low = history[0][channel];
+    int16_t high = low;
+    for (uint8_t slot = 1; slot < count; slot++) {
+        int16_t value = history[slot][channel];
+        if (value < low) low = value;
+        if (value > high) high = value;
+    }
+    stats->min = low;
+    stats->max = high;
+    return true;
+}
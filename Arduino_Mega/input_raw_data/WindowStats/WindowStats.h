@@ -0,0 +1,56 @@
+// WindowStats - sliding-window statistics over a multi-channel sample stream
+//
+// Keeps the last `window` samples of every channel and, per channel, the
+// running sum and sum of squares of the values in the window. Each add()
+// puts the new sample in and takes the one leaving the window out again, so
+// the cost per sample does not depend on the window length. The sums are
+// integers: taking a value out undoes adding it exactly, where a floating
+// point mean/variance update (Welford) would collect rounding error with
+// every add/evict pair and drift over a long session.
+//
+// add() returns true every `hop` samples once the window is full, the same
+// segment/overlap scheme as the Pi (window N, hop N * (1 - overlap)).
+// getStats() then gives mean, variance, min, max and energy (mean square);
+// min and max come from one pass over the window, only at that point.
+
+#ifndef _WINDOWSTATS_H_
+#define _WINDOWSTATS_H_
+
+#include <Arduino.h>
+
+#define WINDOWSTATS_MAX_CHANNELS    9
+#define WINDOWSTATS_MAX_WINDOW      64
+
+typedef struct WindowChannelStats {
+    int16_t mean;       // rounded to the nearest count
+    uint32_t variance;  // population variance (as numpy var()), counts^2
+    int16_t min;
+    int16_t max;
+    uint32_t energy;    // mean of the squares, counts^2
+} WindowChannelStats;
+
+class WindowStats {
+    public:
+        WindowStats();
+
+        bool begin(uint8_t channels, uint8_t window, uint8_t hop);
+        void reset();
+
+        bool add(const int16_t *sample);
+
+        uint8_t getCount() const;
+        bool getStats(uint8_t channel, WindowChannelStats *stats) const;
+
+    private:
+        int16_t history[WINDOWSTATS_MAX_WINDOW][WINDOWSTATS_MAX_CHANNELS];
+        int32_t sums[WINDOWSTATS_MAX_CHANNELS];
+        uint64_t sumSquares[WINDOWSTATS_MAX_CHANNELS];
+        uint8_t channelCount;
+        uint8_t windowLength;
+        uint8_t hopLength;
+        uint8_t count;          // samples in the window, up to windowLength
+        uint8_t head;           // where the next sample goes, the oldest once the window is full
+        uint8_t sinceHop;       // samples added since add() last returned true
+};
+
+#endif /* _WINDOWSTATS_H_ */
@@ -2,6 +2,9 @@
 #include <I2Cdev.h>
 #include <ADXL345.h>
 #include <Wire.h>
+#include <SensorScale.h>
+#include <SensorConfig.h>
+#include <SensorCalibration.h>
 
 #define DEVICE_A_ACCEL (0x53)    //first ADXL345 device address
 #define DEVICE_B_ACCEL (0x1D)    //second ADXL345 device address
@@ -9,59 +12,47 @@
 #define TO_READ (6)        //num of bytes we are going to read each time
 #define voltageDividerPin 0
 #define currentSensorPin 1
-#define RS 0.1
-#define RL 10000
+#define I2C_CLOCK_KHZ 400 //both ADXL345 and the MPU6050 support fast mode
+#define CALIBRATION_SAMPLES 200 //readings averaged per offset trial, about 8 trials
 
 ADXL345 sensorA = ADXL345(DEVICE_A_ACCEL);
 ADXL345 sensorB = ADXL345(DEVICE_B_ACCEL);
 MPU6050 sensorC = MPU6050(DEVICE_C_GYRO);
 
-//determining scale factor based on range set
-//Since range in +-2g, range is 4mg/LSB.
-//value of 1023 is used because ADC is 10 bit
-int rangeAccel = (2-(-2));
-const float scaleFactorAccel = rangeAccel/1023.0;
+//Sensor ranges and rates, applied in calibrateSensors(). Scale factors follow from these (SensorConfig.h)
+typedef Adxl345Config<ADXL345_RANGE_2G, ADXL345_RATE_100> AccelConfig;
+typedef Mpu6050Config<MPU6050_GYRO_FS_250, MPU6050_ACCEL_FS_2, MPU6050_DLPF_BW_256, 0> MotionConfig; //as initialize() leaves it
 
-/*
- * +-250degrees/second already set initialize() function
- * value of 65535 is used due to 16 bit ADC
- */ 
-//determining the scale factor for gyroscope
-int rangeGyro = 250-(-250);
-const float scaleFactorGyro = rangeGyro/65535.0; 
- 
 //declaring variable to store value of volt and amps
-    float vOut;
-    float voltageReading;
-    float currentReading;
+    uint16_t voltageReading; //mV
+    uint16_t currentReading; //uA
 
 //16 bit integer values for raw data of accelerometers
 int16_t xa_raw, ya_raw, za_raw, xb_raw, yb_raw, zb_raw;
 
-//16 bit integer values for offset data of accelerometers
-int16_t xa_offset, ya_offset, za_offset, xb_offset, yb_offset, zb_offset;
-
-//Float values for scaled factors of accelerometers
-float xa, ya, za, xb, yb, zb;
+//Scaled values of accelerometers in mg
+int32_t xa, ya, za, xb, yb, zb;
 
 //16 bit integer values for gyroscope readings
 int16_t xg_raw, yg_raw, zg_raw;
 
-//16 bit integer values for offset data of gyroscope
-int16_t xg_offset, yg_offset, zg_offset;
-
-//Float values for scaled values of gyroscopes
-float xg, yg, zg;
+//Scaled values of gyroscopes in mdegrees/second
+int32_t xg, yg, zg;
 
 //Function prototypes
-float remapVoltage(int);
 void calibrateSensors();
 void getScaledReadings();
 void printSensorReadings();
 
 void setup()
 {
-  Wire.begin();        // join i2c bus (address optional for master)
+  // join i2c bus as master at I2C_CLOCK_KHZ
+  #if I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE
+    Wire.begin();
+    Wire.setClock(I2C_CLOCK_KHZ * 1000L);
+  #elif I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+    Fastwire::setup(I2C_CLOCK_KHZ, true);
+  #endif
   Serial.begin(115200);  // start serial for output
   // Initializing sensors 
   sensorA.initialize();
@@ -86,82 +77,70 @@ void loop()
   printSensorReadings();
 
   //Measure and display voltage measured from voltage divider
-  voltageReading = analogRead(voltageDividerPin);
-  voltageReading = remapVoltage(voltageReading);
-  Serial.print("voltage reading");
-  Serial.println(voltageReading, 9);
+  voltageReading = sensorScaleVoltage(analogRead(voltageDividerPin));
+  Serial.print("battery voltage (mV): ");
+  Serial.println(voltageReading);
 
   //Measure voltage out from current sensor to calculate current
-  vOut = analogRead(currentSensorPin);
-  vOut = remapVoltage(vOut);
-  currentReading = (vOut * 1000) / (RS * RL);
-  Serial.print("current reading: ");
-  Serial.println(currentReading, 9);
+  currentReading = sensorScaleCurrent(analogRead(currentSensorPin));
+  Serial.print("current reading (uA): ");
+  Serial.println(currentReading);
 
 }
 
-float remapVoltage(int volt) {
-  float analogToDigital;
-  analogToDigital = (5.0/1023) * volt;  
-  return analogToDigital;
-}
-
 void getScaledReadings() {
   sensorA.getAcceleration(&xa_raw, &ya_raw, &za_raw);
-  xa = (xa_raw + xa_offset)*scaleFactorAccel;
-  ya = (ya_raw + ya_offset)*scaleFactorAccel;
-  za = (za_raw + za_offset)*scaleFactorAccel;
+  xa = sensorScale(xa_raw, AccelConfig::mgQ);
+  ya = sensorScale(ya_raw, AccelConfig::mgQ);
+  za = sensorScale(za_raw, AccelConfig::mgQ);
   
   sensorB.getAcceleration(&xb_raw, &yb_raw, &zb_raw);
-  xb = (xb_raw + xb_offset)*scaleFactorAccel;
-  yb = (yb_raw + yb_offset)*scaleFactorAccel;
-  zb = (zb_raw + zb_offset)*scaleFactorAccel;
+  xb = sensorScale(xb_raw, AccelConfig::mgQ);
+  yb = sensorScale(yb_raw, AccelConfig::mgQ);
+  zb = sensorScale(zb_raw, AccelConfig::mgQ);
   
   sensorC.getRotation(&xg_raw, &yg_raw, &zg_raw);
-  xg = (xg_raw + xg_offset)*scaleFactorGyro;
-  yg = (yg_raw + yg_offset)*scaleFactorGyro;
-  zg = (zg_raw + zg_offset)*scaleFactorGyro;
+  xg = sensorScale(xg_raw, MotionConfig::gyroMdpsQ);
+  yg = sensorScale(yg_raw, MotionConfig::gyroMdpsQ);
+  zg = sensorScale(zg_raw, MotionConfig::gyroMdpsQ);
 }
 
 void printSensorReadings() {
   //Display values for different sensors
-  Serial.print("accel for Sensor A:\t");
+  Serial.print("accel for Sensor A (mg):\t");
   Serial.print(xa); Serial.print("\t");
   Serial.print(ya); Serial.print("\t");
   Serial.println(za);
   
-  Serial.print("accel for Sensor B:\t");
+  Serial.print("accel for Sensor B (mg):\t");
   Serial.print(xb); Serial.print("\t");
   Serial.print(yb); Serial.print("\t");
   Serial.println(zb);
   
-  Serial.print("rotation for Sensor C:\t");
+  Serial.print("rotation for Sensor C (mdeg/s):\t");
   Serial.print(xg); Serial.print("\t");
   Serial.print(yg); Serial.print("\t");
   Serial.println(zg);
 }
 
 /*
- * Purpose of adding 255 is to account for downward default acceleration in Z axis to be 1g
+ * Set ranges and rates, then program the offset registers so the sensors read 0 on every axis
+ * but Z, which reads 1g (AccelConfig::countsPerG). The device must lie still and level meanwhile.
+ * Each trial averages CALIBRATION_SAMPLES readings (SensorCalibration.h).
  */
 void calibrateSensors() {
-  //Setting range of ADXL345
-  sensorA.setRange(ADXL345_RANGE_2G);
-  sensorB.setRange(ADXL345_RANGE_2G);
-  
-  sensorA.getAcceleration(&xa_raw, &ya_raw, &za_raw);
-  sensorB.getAcceleration(&xb_raw, &yb_raw, &zb_raw);
-  sensorC.getRotation(&xg_raw, &yg_raw, &zg_raw);
-  
-  xa_offset = -xa_raw;
-  ya_offset = -ya_raw;
-  za_offset = -za_raw+255;
-
-  xb_offset = -xb_raw;
-  yb_offset = -yb_raw;
-  zb_offset = -zb_raw+255;
-
-  xg_offset = -xg_raw;
-  yg_offset = -yg_raw;
-  zg_offset = -zg_raw;
+  //Setting ranges and rates of the sensors
+  AccelConfig::apply(sensorA);
+  AccelConfig::apply(sensorB);
+  MotionConfig::apply(sensorC);
+
+  Adxl345Calibration calibrationA(sensorA, AccelConfig::range);
+  Adxl345Calibration calibrationB(sensorB, AccelConfig::range);
+  Mpu6050Calibration calibrationC(sensorC, MotionConfig::gyroRange, MotionConfig::accelRange);
+  OffsetCalibration *calibrations[] = { &calibrationA, &calibrationB, &calibrationC };
+
+  Serial.println("Calibrating, keep the device still and level");
+  //one new ADXL345 reading per output period
+  OffsetCalibration::run(calibrations, 3, CALIBRATION_SAMPLES, 1000000UL / AccelConfig::rateMilliHz);
+  Serial.println("Calibration done");
 }
@@ -1,10 +1,26 @@
 #include <power.h>
-#include <MPU6050.h>
+#include <MPU6050_6Axis_MotionApps20.h> //MPU6050 class with the DMP functions
+#include <MPU6050Stream.h>
+#include <OrientationFilter.h>
 #include <I2Cdev.h>
 #include <ADXL345.h>
 #include <Wire.h>
+#include <SensorFrame.h>
+#include <SensorScale.h>
+#include <SensorConfig.h>
+#include <SerialTxQueue.h>
+#include <AdcSampler.h>
+#include <EnergyMeter.h>
+#include <ChannelScheduler.h>
+#include <WindowStats.h>
+#include <SensorCalibration.h>
+#include <StoredConfig.h>
+#include <FrameHistory.h>
+#include <EEPROM.h>
+#include <TimingProfiler.h>
 #include <Arduino_FreeRTOS.h>
 #include <task.h>
+#include <avr/sleep.h>
 
 #define STACK_SIZE 500
 #define DEVICE_A_ACCEL (0x53)    //first ADXL345 device address
@@ -13,69 +29,320 @@
 #define TO_READ (6)        //num of bytes we are going to read each time
 #define voltageDividerPin 0
 #define currentSensorPin 1
-#define RS 0.1
-#define RL 10000
+#define ADC_TRIGGER ADCSAMPLER_FREE_RUNNING //~4800 conversions/s per power channel; ADCSAMPLER_TIMER0 gives ~490/s with fewer wake-ups
+#define VOLTAGE_SLOT 0 //index of voltageDividerPin in powerChannels
+#define CURRENT_SLOT 1 //index of currentSensorPin in powerChannels
 #define PKT_SIZE 1
+//Uncomment to delta code the sample frames (SensorFrame.h): a frame holds up to DELTA_KEYFRAME_INTERVAL
+//samples, the first in full and the others as varint changes from the one before. Several times the
+//samples per second fit the link, at the cost of DELTA_KEYFRAME_INTERVAL samples of latency.
+//The Mega starts with delta coded frames instead of CHANNELS frames, not for ACQ_ADXL_FIFO
+//#define DELTA_FRAMES
+#define DELTA_KEYFRAME_INTERVAL 10
+//Comment out to stop keeping the last frames sent (FrameHistory.h, FRAMEHISTORY_SIZE bytes). The Pi asks for
+//a frame it missed or got with a bad CRC with RESEND_REQUEST and the sequence number (2 bytes, little-endian)
+//and gets the same frame again, so its windows have no holes
+#define RESEND_FRAMES
+#define RESEND_REQUEST 'R'
+#define SAMPLE_PERIOD_MS 20
+#define ENERGY_REPORT_PERIOD_MS 0 //how often packet.power and packet.energy are refreshed (power is the mean over the period), 0 for every sample
+#define I2C_CLOCK_KHZ 400 //both ADXL345 and the MPU6050 support fast mode
+
+//How mainTask gets its samples
+#define ACQ_POLL 0       //read every sensor once per SAMPLE_PERIOD_MS
+#define ACQ_ADXL_FIFO 1  //both ADXL345 sample into their FIFOs, drained every FIFO_DRAIN_PERIOD_MS
+#define ACQ_DATA_READY 2 //read every sensor when the MPU6050 raises data-ready on DATA_READY_PIN
+#define ACQ_DMP 3        //as ACQ_DATA_READY, driven by the DMP interrupt, adding its quaternion and linear acceleration
+#ifndef ACQUISITION_MODE
+#define ACQUISITION_MODE ACQ_POLL
+#endif
+#define ACQ_INTERRUPT_DRIVEN (ACQUISITION_MODE == ACQ_DATA_READY || ACQUISITION_MODE == ACQ_DMP)
+//Period a session's sample divider counts in. ACQ_POLL waits whole ticks, SAMPLE_PERIOD_MS rounded down
+//to them (at least one), so with the 15ms tick the samples come every 15ms * divider
+#if ACQUISITION_MODE == ACQ_POLL
+#define POLL_PERIOD_TICKS (SAMPLE_PERIOD_MS < portTICK_PERIOD_MS ? 1 : SAMPLE_PERIOD_MS / portTICK_PERIOD_MS)
+#define BASE_PERIOD_MS (POLL_PERIOD_TICKS * portTICK_PERIOD_MS)
+#else
+#define BASE_PERIOD_MS SAMPLE_PERIOD_MS
+#endif
+
+#if ACQUISITION_MODE == ACQ_DMP
+#define SAMPLE_FRAME_TYPE SENSORFRAME_TYPE_DMP_SAMPLES
+#define SAMPLE_SIZE (4 + 9 * 2 + 2 * 2 + 2 * 4 + 4 * 2 + 3 * 2) // bytes per sample: as ACQ_DATA_READY, then quaternion and linear acceleration
+#elif ACQUISITION_MODE == ACQ_DATA_READY
+#define SAMPLE_FRAME_TYPE SENSORFRAME_TYPE_TIMED_SAMPLES
+#define SAMPLE_SIZE (4 + 9 * 2 + 2 * 2 + 2 * 4) // bytes per sample: micros() timestamp, 9 raw int16 IMU values, 2 uint16 and 2 uint32 for power
+#else
+#define SAMPLE_FRAME_TYPE SENSORFRAME_TYPE_SAMPLES
+#define SAMPLE_SIZE (9 * 2 + 2 * 2 + 2 * 4) // bytes per sample: 9 raw int16 IMU values, 2 uint16 and 2 uint32 for power
+#endif
+
+#ifdef DELTA_FRAMES
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+#error "DELTA_FRAMES needs ACQ_POLL, ACQ_DATA_READY or ACQ_DMP"
+#endif
+#define DEFAULT_FRAME_SAMPLES DELTA_KEYFRAME_INTERVAL
+//worst case varint bytes of a delta coded sample, a frame is closed early if another might not fit
+#define DELTA_SAMPLE_MAX_SIZE ((ACQ_INTERRUPT_DRIVEN ? SENSORFRAME_DELTA32_MAX_LENGTH : 0) \
+                               + (9 + 2 + (ACQUISITION_MODE == ACQ_DMP ? 4 + 3 : 0)) * SENSORFRAME_DELTA16_MAX_LENGTH \
+                               + 2 * SENSORFRAME_DELTA32_MAX_LENGTH)
+#elif ACQUISITION_MODE == ACQ_ADXL_FIFO
+#define DEFAULT_FRAME_SAMPLES SAMPLES_PER_FRAME
+#else
+#define DEFAULT_FRAME_SAMPLES PKT_SIZE
+#endif
+
+#define DATA_READY_PIN 2 //MPU6050 INT, external interrupt 0
+#define DATA_READY_RATE_DIVIDER (SAMPLE_PERIOD_MS - 1) //1kHz gyro output rate with the DLPF on / 20 = 50Hz
+#define DATA_READY_DLPF MPU6050_DLPF_BW_20 //below half of the 50Hz sample rate
+#define POLL_RATE_DIVIDER (BASE_PERIOD_MS / 2 - 1) //1kHz / 7 = 142Hz, a new sample for every 15ms poll
+#define DATA_READY_TIMEOUT_MS (3 * SAMPLE_PERIOD_MS) //read anyway if no interrupt came, so the stream keeps going
+#define DMP_FIFO_RATE_DIVISOR 3 //DMP output rate = 200Hz MPU6050 sample rate / (1 + divisor) = 50Hz, one packet per SAMPLE_PERIOD_MS
+#define DMP_PACKET_SIZE 42 //quaternion, gyro, accel packet of MotionApps 2.0
+
+#define ACCEL_FIFO_DEPTH 32
+#define FIFO_DRAIN_PERIOD_MS 200 //10 samples per drain, the FIFOs overflow after 32 (640ms)
+#define SAMPLES_PER_FRAME (SENSORFRAME_MAX_PAYLOAD / SAMPLE_SIZE)
+#define MOTION_OVERSAMPLE 4 //MPU6050 samples averaged into each sample sent in ACQ_ADXL_FIFO (200Hz gyro)
+#define MOTION_RATE_DIVIDER (SAMPLE_PERIOD_MS / MOTION_OVERSAMPLE - 1) //1kHz gyro output rate with the DLPF on
+#define MOTION_DLPF MPU6050_DLPF_BW_98 //below half of the 200Hz sample rate
+
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+#define TASK_PERIOD_MS FIFO_DRAIN_PERIOD_MS
+#else
+#define TASK_PERIOD_MS BASE_PERIOD_MS
+#endif
+
+//Sensor ranges, rates and filters. Scale factors follow from these at compile time (SensorConfig.h)
+//and setupSensors() writes the same settings to the registers.
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+typedef Adxl345Config<ADXL345_RANGE_2G, ADXL345_RATE_50> AccelConfig; //one FIFO entry per SAMPLE_PERIOD_MS
+typedef Mpu6050Config<MPU6050_GYRO_FS_250, MPU6050_ACCEL_FS_2, MOTION_DLPF, MOTION_RATE_DIVIDER> MotionConfig;
+static_assert(AccelConfig::rateMilliHz == 1000000UL / SAMPLE_PERIOD_MS, "ADXL345 rate must match SAMPLE_PERIOD_MS");
+static_assert(MotionConfig::sampleRateHz == MOTION_OVERSAMPLE * 1000 / SAMPLE_PERIOD_MS, "MPU6050 rate must be MOTION_OVERSAMPLE per SAMPLE_PERIOD_MS");
+#else
+typedef Adxl345Config<ADXL345_RANGE_2G, ADXL345_RATE_100> AccelConfig; //each read finds data at most 10ms old
+#if ACQUISITION_MODE == ACQ_DMP
+typedef Mpu6050Config<MPU6050_GYRO_FS_2000, MPU6050_ACCEL_FS_2, MPU6050_DLPF_BW_42, 4> MotionConfig; //what dmpInitialize() programs
+static_assert(MotionConfig::sampleRateHz / (1 + DMP_FIFO_RATE_DIVISOR) == 1000 / SAMPLE_PERIOD_MS, "DMP rate must match SAMPLE_PERIOD_MS");
+#elif ACQUISITION_MODE == ACQ_DATA_READY
+typedef Mpu6050Config<MPU6050_GYRO_FS_250, MPU6050_ACCEL_FS_2, DATA_READY_DLPF, DATA_READY_RATE_DIVIDER> MotionConfig;
+static_assert(MotionConfig::sampleRateHz == 1000 / SAMPLE_PERIOD_MS, "MPU6050 rate must match SAMPLE_PERIOD_MS");
+#else
+//at least twice the poll rate, so the MPU6050 clock drifting against the tick never hands a poll the previous reading
+typedef Mpu6050Config<MPU6050_GYRO_FS_250, MPU6050_ACCEL_FS_2, DATA_READY_DLPF, POLL_RATE_DIVIDER> MotionConfig;
+static_assert(MotionConfig::sampleRateHz >= 2 * 1000 / BASE_PERIOD_MS, "MPU6050 rate must be at least twice the poll rate");
+#endif
+#endif
+
+//Comment out to stop fusing the MPU6050 gyro and accelerometer into an orientation on the Mega
+//(ACQ_DMP gets its orientation from the DMP instead)
+#if ACQUISITION_MODE != ACQ_DMP
+#define ORIENTATION_FUSION
+#endif
+#define ORIENTATION_PERIOD_MS 100 //one ORIENTATION frame per 100ms, the filter itself runs at the full motion rate
+#define ORIENTATION_SCALE 16384 //quaternion components are sent as int16, 1.0 = 16384
+#define FUSION_KP 2.0  //accelerometer correction gain
+#define FUSION_KI 0.01 //gyro bias estimation gain
+
+//Comment out to send every field of every sample in SAMPLES frames. With it, channelTask replaces
+//mainTask and sends CHANNELS frames holding only the channels due at each sample, so the motion
+//channels can run at the full sample rate without the power fields taking their share of the link.
+//With DELTA_FRAMES the Mega starts with mainTask, the Pi can still ask for CHANNELS frames
+#if ACQUISITION_MODE == ACQ_POLL || ACQUISITION_MODE == ACQ_DATA_READY
+#define CHANNEL_FRAMES
+#endif
+//Samples between two sends of each channel. The base rate is 1000 / BASE_PERIOD_MS: ACQ_DATA_READY
+//with SAMPLE_PERIOD_MS 5 runs the motion channels at 200Hz (ACQ_POLL is bound to the 15ms tick)
+#define ACCEL_A_DIVIDER 1
+#define ACCEL_B_DIVIDER 1
+#define GYRO_DIVIDER 1
+#define POWER_DIVIDER (1000 / BASE_PERIOD_MS) //once a second, voltage and current are averaged over the second
+#define LINK_BYTES_PER_SECOND (115200 / 10) //8N1
+//upper bound of the CHANNELS stream: a frame every sample, each channel's fields at its own rate
+#define CHANNEL_BYTES_PER_SECOND (1000 / BASE_PERIOD_MS * (SENSORFRAME_HEADER_LENGTH + SENSORFRAME_CRC_LENGTH + 4 + 1) \
+                                  + 1000UL * 3 * 2 / (BASE_PERIOD_MS * ACCEL_A_DIVIDER) \
+                                  + 1000UL * 3 * 2 / (BASE_PERIOD_MS * ACCEL_B_DIVIDER) \
+                                  + 1000UL * 3 * 2 / (BASE_PERIOD_MS * GYRO_DIVIDER) \
+                                  + 1000UL * (2 * 2 + 2 * 4) / (BASE_PERIOD_MS * POWER_DIVIDER))
+
+//Uncomment to also send a FEATURES frame with the mean, variance, min, max and energy of every motion
+//axis over the last FEATURE_WINDOW samples, every FEATURE_HOP samples: the Pi's segment size N and overlap
+//#define FEATURE_FRAMES
+#define FEATURE_WINDOW 64
+#define FEATURE_OVERLAP_PERCENT 50
+#define FEATURE_HOP (FEATURE_WINDOW * (100 - FEATURE_OVERLAP_PERCENT) / 100)
+#define FEATURE_CHANNELS 9 //acc1, acc2, gyro xyz
+
+//Uncomment to stream at the full rate only while the dancer moves (ACQ_POLL). Both ADXL345 flag activity
+//above ACTIVITY_THRESHOLD and inactivity below INACTIVITY_THRESHOLD for INACTIVITY_TIME_S. Once both are
+//inactive the task only checks the flags every IDLE_POLL_MS and sends a keep-alive sample every
+//IDLE_KEEPALIVE_MS, and AdcSampler runs off Timer0 so the MCU sleeps between ticks, until either moves again
+//#define ACTIVITY_GATING
+#define ACTIVITY_THRESHOLD 8   //62.5mg per count, AC coupled: 0.5g away from the level when the check started
+#define INACTIVITY_THRESHOLD 4 //0.25g, AC coupled
+#define INACTIVITY_TIME_S 5
+#define IDLE_POLL_MS 105       //7 ticks, the ADXL345 latch the flags in between
+#define IDLE_KEEPALIVE_MS 1050
+//Uncomment to also put the MPU6050 to sleep while idle (its gyro alone draws 3.6mA), but for the keep-alive samples
+//#define IDLE_SLEEP
+
+#ifdef ACTIVITY_GATING
+#if ACQUISITION_MODE != ACQ_POLL
+#error "ACTIVITY_GATING needs ACQ_POLL, the other modes are paced by the sensors"
+#endif
+static_assert(INACTIVITY_THRESHOLD < ACTIVITY_THRESHOLD && INACTIVITY_TIME_S <= 255, "activity thresholds out of range");
+static_assert(IDLE_KEEPALIVE_MS >= IDLE_POLL_MS, "IDLE_KEEPALIVE_MS must be at least one IDLE_POLL_MS");
+#ifdef IDLE_SLEEP
+static_assert(IDLE_KEEPALIVE_MS / IDLE_POLL_MS >= 3, "IDLE_SLEEP wakes the MPU6050 one IDLE_POLL_MS before the keep-alive");
+#endif
+#endif
+
+#ifdef FEATURE_FRAMES
+static_assert(FEATURE_WINDOW <= WINDOWSTATS_MAX_WINDOW && FEATURE_HOP >= 1, "FEATURE_WINDOW or FEATURE_OVERLAP_PERCENT out of range");
+#endif
+
+#ifdef CHANNEL_FRAMES
+#if ACQUISITION_MODE != ACQ_POLL && ACQUISITION_MODE != ACQ_DATA_READY
+#error "CHANNEL_FRAMES needs ACQ_POLL or ACQ_DATA_READY"
+#endif
+static_assert(CHANNEL_BYTES_PER_SECOND < LINK_BYTES_PER_SECOND * 3 / 4, "channel rates leave too little of the link for the other frames");
+static_assert(AccelConfig::rateMilliHz >= 1000000UL / (BASE_PERIOD_MS * ACCEL_A_DIVIDER), "ADXL345 rate is below the accel channel rate");
+static_assert(AccelConfig::rateMilliHz >= 1000000UL / (BASE_PERIOD_MS * ACCEL_B_DIVIDER), "ADXL345 rate is below the accel channel rate");
+static_assert(POWER_DIVIDER <= 255, "channel dividers are sent as one byte");
+#endif
+
+#if defined(DELTA_FRAMES)
+#define DEFAULT_FRAMING SENSORFRAME_FRAMING_DELTA
+#elif defined(CHANNEL_FRAMES)
+#define DEFAULT_FRAMING SENSORFRAME_FRAMING_CHANNELS
+#else
+#define DEFAULT_FRAMING SENSORFRAME_FRAMING_SAMPLES
+#endif
+
+//The offset registers found by calibrateSensors() are kept in EEPROM (StoredConfig.h) and programmed at
+//every boot, which takes well under a millisecond. Before the handshake the Pi can send COMMAND_CALIBRATE
+//(the device must lie still and level, CALIBRATION_SAMPLES readings per trial, about 8 trials) or
+//COMMAND_ERASE; the Mega answers COMMAND_DONE. Uncomment to also calibrate at boot when EEPROM holds none
+//#define CALIBRATE_OFFSETS
+#define CALIBRATION_SAMPLES 200
+#define SETTINGS_ADDRESS 0
+#define SETTINGS_VERSION 2 //2: the session
+#define COMMAND_CALIBRATE 'C'
+#define COMMAND_ERASE 'E'
+#define COMMAND_DONE 'K'
+
+//Before the handshake the Pi can also send COMMAND_HELLO, to learn the firmware version, what it was built
+//with (SENSORFRAME_CAP_*) and the session in force, and COMMAND_SESSION followed by the session it wants:
+//sample divider, samples per frame, framing, then the four channel dividers, one byte each. The Mega
+//answers both with a HELLO frame (SensorFrame.h); a session it refuses leaves the one in force unchanged.
+//Sensor ranges and the base rate stay fixed here: the sample rate is 1000 / (BASE_PERIOD_MS * divider)
+#define FIRMWARE_VERSION 0x0100 //major << 8 | minor
+#define COMMAND_HELLO 'V'
+#define COMMAND_SESSION 'S'
+#define SESSION_LENGTH 7 //bytes after COMMAND_SESSION
+#define SESSION_TIMEOUT_MS 100 //for all of them to come
+#define SESSION_MAX_DIVIDER 20 //ACQ_DMP: the MPU6050 FIFO holds 24 DMP packets
+
+//Uncomment to time every phase of mainTask and print the counters on Serial
+//#define TIMING_PROFILE
+#define PROFILE_DUMP_FRAMES 250 //frames between two dumps of the timing counters
 
 ADXL345 sensorA = ADXL345(DEVICE_A_ACCEL);
 ADXL345 sensorB = ADXL345(DEVICE_B_ACCEL);
 MPU6050 sensorC = MPU6050(DEVICE_C_GYRO);
 TickType_t xLastWakeTime;
 
-//determining scale factor based on range set
-//Since range in +-2g, range is 4mg/LSB.
-//value of 1023 is used because ADC is 10 bit
-int rangeAccel = (2-(-2));
-const float scaleFactorAccel = rangeAccel/1023.0;
-
 /*
- * +-250degrees/second already set initialize() function
- * value of 65535 is used due to 16 bit ADC
- */ 
-//determining the scale factor for gyroscope
-int rangeGyro = 250-(-250);
-const float scaleFactorGyro = rangeGyro/65535.0; 
+ * Accelerometer and gyroscope readings are sent as raw 16-bit counts.
+ * Scaling to g and degrees/second is done on the Pi (serial_frames.py).
+ * Power readings are scaled to integer mV, uA, uW and uJ with the fixed-point
+ * constants of SensorScale.h, so the power path does no float math.
+ */
  
-//declaring variable to store value of volt and amps
-float vOut , voltageReading, currentReading;
-
-//16 bit integer values for raw data of accelerometers
-int16_t xa_raw, ya_raw, za_raw, xb_raw, yb_raw, zb_raw;
-
-//16 bit integer values for gyroscope readings
-int16_t xg_raw, yg_raw, zg_raw;
+//raw ADC counts of the voltage divider and the current sensor, averaged over a sample period by AdcSampler
+uint16_t voltageReading, currentReading;
+const uint8_t powerChannels[] = { voltageDividerPin, currentSensorPin };
+EnergyMeter energyMeter(ENERGY_REPORT_PERIOD_MS * 1000UL);
 
 //Structure of data packet
 typedef struct Packet {
-  float gyro[3];
-  float acc1[3];
-  float acc2[3];
-  float power;
-  float current;
-  float voltage;
-  float energy;
+  int16_t gyro[3];
+  int16_t acc1[3];
+  int16_t acc2[3];
+  int16_t acc3[3]; //MPU6050 accelerometer, read with the gyro but not sent yet
+  uint32_t power;   //uW
+  uint16_t current; //uA
+  uint16_t voltage; //mV
+  uint32_t energy;  //uJ since the first sample, low 32 bits
+  uint32_t timestamp; //micros() at the data-ready interrupt, ACQ_DATA_READY and ACQ_DMP only
+  int16_t quaternion[4]; //DMP orientation w, x, y, z, 1.0 = 16384, ACQ_DMP only
+  int16_t linearAccel[3]; //DMP accel without gravity, 1g = 8192, ACQ_DMP only
 } Packet;   
 
 Packet packet;
 
+//Register blocks read for every sample, one bus transaction per sensor
+uint8_t accelABuffer[6];   //ADXL345 DATAX0..DATAZ1, little-endian
+uint8_t accelBBuffer[6];
+uint8_t motionBuffer[14];  //MPU6050 ACCEL_XOUT_H..GYRO_ZOUT_L (accel, temperature, gyro), big-endian
+
+const I2CdevBurst sensorBursts[] = {
+  { DEVICE_A_ACCEL, ADXL345_RA_DATAX0, sizeof(accelABuffer), accelABuffer },
+  { DEVICE_B_ACCEL, ADXL345_RA_DATAX0, sizeof(accelBBuffer), accelBBuffer },
+  { DEVICE_C_GYRO, MPU6050_RA_ACCEL_XOUT_H, sizeof(motionBuffer), motionBuffer }
+};
+#define SENSOR_BURSTS (sizeof(sensorBursts) / sizeof(sensorBursts[0]))
+
+
+//Binary frame sent to the Pi, holds session.frameSamples samples
+SensorFrame frame;
+uint16_t frameSequence = 0;
+
+//What the sampling task sends, the defaults above until the Pi asks for another session
+typedef struct Session {
+  uint8_t sampleDivider;      //samples taken every sampleDivider BASE_PERIOD_MS or data-ready interrupts
+  uint8_t frameSamples;       //samples per frame, delta coded frames are closed earlier when full
+  uint8_t framing;            //SENSORFRAME_FRAMING_*
+  uint8_t channelDividers[4]; //CHANNELS frames: samples between two sends of each channel, 0 for never
+} Session;
+
+Session session = { 1, DEFAULT_FRAME_SAMPLES, DEFAULT_FRAMING, { ACCEL_A_DIVIDER, ACCEL_B_DIVIDER, GYRO_DIVIDER, POWER_DIVIDER } };
+uint8_t sessionStatus = SENSORFRAME_SESSION_ACCEPTED; //of the last COMMAND_SESSION
+
+#ifdef RESEND_FRAMES
+FrameHistory sentFrames; //written and searched by the task sending the frames only
+uint16_t resentFrames = 0;
+#define SERVICE_RESENDS() serviceResends()
+#else
+#define SERVICE_RESENDS()
+#endif
+
+#ifdef DELTA_FRAMES
+Packet previousPacket; //last sample packed into the frame, the next one is coded as the change from it
+static_assert(SAMPLE_SIZE + DELTA_SAMPLE_MAX_SIZE <= SENSORFRAME_MAX_PAYLOAD, "a keyframe and one delta sample must fit in one frame");
+#endif
+
+#ifdef CHANNEL_FRAMES
+ChannelScheduler channelScheduler;
+#endif
 
-char databuf[2800];
+static_assert(PKT_SIZE * SAMPLE_SIZE <= SENSORFRAME_MAX_PAYLOAD, "PKT_SIZE samples do not fit in one frame");
 
-char* acc1_x;
-char* acc1_y;
-char* acc1_z;
-char* acc2_x;
-char* acc2_y;
-char* acc2_z;
-char* gyro_x;
-char* gyro_y;
-char* gyro_z;
-char* voltage_c;
-char* current_c;
-char* power_c;
-char* energy_c;
-char checksum_c[10];
-int checkSum =0 ;
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+//One block of FIFO entries per drain, pairs of A and B entries share an index
+int16_t fifoAccelA[ACCEL_FIFO_DEPTH][3];
+int16_t fifoAccelB[ACCEL_FIFO_DEPTH][3];
+uint16_t fifoOverruns = 0; //drains that found a full FIFO, the oldest entries were lost
+MPU6050Stream motionStream(&sensorC, DEVICE_C_GYRO);
+#endif
+
+#if ACQ_INTERRUPT_DRIVEN
+TaskHandle_t mainTaskHandle = NULL;
+volatile uint32_t dataReadyMicros = 0;
+uint16_t missedDataReady = 0;  //waits that timed out without an interrupt
+uint16_t skippedDataReady = 0; //interrupts that came while the previous sample was still being handled
+#endif
 
 
 int ledflag = HIGH;
@@ -84,16 +351,119 @@ int countLED = 0;
 int h_flag = 0;
 int n_flag = 0;
 int i;
+
+//Kept in EEPROM. The offset registers count in fixed units (15.6mg, 1/2048g, 1/32.8deg/s) whatever the
+//range, so stored offsets stay right when AccelConfig or MotionConfig change. The session is the last
+//one the Pi asked for, used from the next boot on if checkSession() still takes it
+typedef struct Settings {
+  int8_t accelOffsetA[3];
+  int8_t accelOffsetB[3];
+  int16_t motionOffset[6]; //accel XYZ, gyro XYZ
+  Session session;
+} Settings;
+
+Settings settings;
+
+//Phases of mainTask timed when TIMING_PROFILE is defined
+enum ProfilePhase {
+  PHASE_I2C,      //reading the three sensors
+  PHASE_ADC,      //reading the averaged voltage and current from AdcSampler
+  PHASE_POWER,    //voltage, current, power and energy arithmetic
+  PHASE_FORMAT,   //packing the sample into the frame
+  PHASE_CHECKSUM, //closing the frame (CRC)
+  PHASE_UART,     //queueing the frame for the Pi
+  PHASE_BUSY,     //wake-up to going back to sleep, must fit in TASK_PERIOD_MS
+  PHASE_PERIOD    //wake-up to wake-up
+};
+
+#ifdef ORIENTATION_FUSION
+OrientationFilter fusion(FUSION_KP, FUSION_KI);
+#define FUSE_MOTION(accel, gyro, dt) fuseMotion(accel, gyro, dt)
+#define SEND_ORIENTATION() sendOrientation()
+#else
+#define FUSE_MOTION(accel, gyro, dt)
+#define SEND_ORIENTATION()
+#endif
+
+#ifdef ACTIVITY_GATING
+bool idle = false;                  //both ADXL345 reported inactivity and neither activity since
+bool quietA = false, quietB = false;
+uint8_t idleChecks = 0;             //activity checks since the last keep-alive sample
+uint32_t stateStart = 0;            //millis() at the last switch between streaming and idle
+uint64_t stateStartEnergy = 0;      //energyMeter total then, uJ
+uint32_t stateMillis[2] = { 0, 0 }; //time spent streaming [0] and idle [1]
+uint64_t stateEnergy[2] = { 0, 0 }; //energy used in each, uJ
+#endif
+
+#ifdef FEATURE_FRAMES
+WindowStats featureStats;
+bool featuresDue = false;    //a hop ended since the last FEATURES frame
+uint32_t featureTimestamp;   //micros() of the newest sample in the window
+#define ADD_FEATURE_SAMPLE() addFeatureSample()
+#define SEND_FEATURES() sendFeatures()
+#else
+#define ADD_FEATURE_SAMPLE()
+#define SEND_FEATURES()
+#endif
+
+#ifdef TIMING_PROFILE
+TimingProfiler profiler;
+#define PROFILE_START(phase) profiler.start(phase)
+#define PROFILE_STOP(phase) profiler.stop(phase)
+#define PROFILE_WAKE() profileWake()
+#define PROFILE_DUMP() profileDump()
+#else
+#define PROFILE_START(phase)
+#define PROFILE_STOP(phase)
+#define PROFILE_WAKE()
+#define PROFILE_DUMP()
+#endif
   
+/**
+ * Queue the finished frame for the Pi, and with RESEND_FRAMES keep it for resending
+ */
+void sendFrame() {
+  SerialTxQueue::enqueue(frame.getData(), frame.getLength()); //dropped and counted if the link is backed up
+#ifdef RESEND_FRAMES
+  sentFrames.add(frame.getData(), frame.getLength()); //kept even if dropped, the Pi will ask for it
+#endif
+}
+
+#ifdef RESEND_FRAMES
+/**
+ * Answer the resend requests the Pi sent since the last call. Frames no longer kept
+ * are not answered, the Pi gives up on them after a while
+ */
+void serviceResends() {
+  static uint8_t request[3]; //RESEND_REQUEST, sequence number
+  static uint8_t received = 0;
+  const uint8_t *data;
+  uint16_t length;
+
+  while (SerialTxQueue::available()) {
+    uint8_t value = SerialTxQueue::read();
+    if (received == 0 && value != RESEND_REQUEST) continue; //left over from the handshake
+    request[received++] = value;
+    if (received < sizeof(request)) continue;
+    received = 0;
+    if (sentFrames.find(request[1] | (request[2] << 8), &data, &length)) {
+      SerialTxQueue::enqueue(data, length);
+      resentFrames++;
+    }
+  }
+}
+#endif
+
 /**
  * Main Task
  */
 void mainTask(void *p) {
 
-  
+  PROFILE_WAKE();
   while(1){
     xLastWakeTime = xTaskGetTickCount();
-    for (i=0;i <PKT_SIZE; i++) {
+    frame.begin(sessionFrameType(), frameSequence++);
+    for (i=0;i <session.frameSamples; i++) {
 //    countLED++;
 //    if (countLED >= 50) {
 //    if(ledflag == LOW) {
@@ -105,32 +475,645 @@ void mainTask(void *p) {
 //     digitalWrite(LED_BUILTIN, ledflag);  
 //      countLED = 0;  
 //    }
+      PROFILE_STOP(PHASE_BUSY);
+      waitForSample();
+      PROFILE_WAKE();
       getData(); 
-      changeFormat();
-      vTaskDelayUntil(&xLastWakeTime, (20/ portTICK_PERIOD_MS));
+      FUSE_MOTION(packet.acc3, packet.gyro, sampleInterval());
+      ADD_FEATURE_SAMPLE();
+      PROFILE_START(PHASE_FORMAT);
+      packSample();
+      PROFILE_STOP(PHASE_FORMAT);
+#ifdef DELTA_FRAMES
+      if (session.framing == SENSORFRAME_FRAMING_DELTA && frame.getPayloadSpace() < DELTA_SAMPLE_MAX_SIZE) break; //the next sample might not fit
+#endif
      }
 
-     for (i=0 ; i< strlen(databuf) ; i++ ) {
-     checkSum +=  databuf[i];
-     }
-     
+     //Header length and CRC are filled in here, then the frame goes out in one write
+     PROFILE_START(PHASE_CHECKSUM);
+     frame.finish();
+     PROFILE_STOP(PHASE_CHECKSUM);
+     PROFILE_START(PHASE_UART);
+     sendFrame();
+     PROFILE_STOP(PHASE_UART);
+     SEND_ORIENTATION();
+     SEND_FEATURES();
+     SERVICE_RESENDS();
+     PROFILE_DUMP();
+  }
+}
 
-     itoa(checkSum, checksum_c, 10); 
-     strcat(databuf, ",");
-     strcat(databuf, checksum_c);
-     strcat(databuf, "\r");
- 
-     for (i = 0; i < strlen(databuf); i++) {
-        Serial1.write(databuf[i]);
-        //Serial.print(databuf[i]); 
-     }
-     //Serial.println();
-     strcpy(databuf, "");  //clear data buffer
-     checkSum =0 ;
-     
+#ifdef CHANNEL_FRAMES
+/**
+ * Channel Task
+ * Reads the motion sensors every sample like mainTask (the fusion filter needs them all),
+ * but sends only the channels channelScheduler says are due, in one CHANNELS frame.
+ * The power readings are only taken when the power channel is due: AdcSampler and
+ * the energy meter then average them over the whole power period.
+ */
+void channelTask(void *p) {
+  uint8_t channels;
+
+  PROFILE_WAKE();
+  xLastWakeTime = xTaskGetTickCount();
+  while(1){
+    PROFILE_STOP(PHASE_BUSY);
+    waitForSample();
+    PROFILE_WAKE();
+    channels = channelScheduler.next();
+#ifdef ACTIVITY_GATING
+    if (idle) channels |= _BV(SENSORFRAME_CHANNEL_POWER); //keep-alive samples are rare enough to carry power every time
+#endif
+
+    PROFILE_START(PHASE_I2C);
+    getScaledReadings();
+    PROFILE_STOP(PHASE_I2C);
+    FUSE_MOTION(packet.acc3, packet.gyro, sampleInterval());
+    ADD_FEATURE_SAMPLE();
+    if (channels & _BV(SENSORFRAME_CHANNEL_POWER)) getPowerReadings();
+
+    if (channels != 0) {
+      PROFILE_START(PHASE_FORMAT);
+      frame.begin(SENSORFRAME_TYPE_CHANNELS, frameSequence++);
+      packChannels(channels);
+      PROFILE_STOP(PHASE_FORMAT);
+      PROFILE_START(PHASE_CHECKSUM);
+      frame.finish();
+      PROFILE_STOP(PHASE_CHECKSUM);
+      PROFILE_START(PHASE_UART);
+      sendFrame();
+      PROFILE_STOP(PHASE_UART);
+    }
+    SEND_ORIENTATION();
+    SEND_FEATURES();
+    SERVICE_RESENDS();
+    PROFILE_DUMP();
+  }
+}
+
+/**
+ * Rates of the CHANNELS frame channels, in samples between two sends
+ */
+void setupChannels() {
+  uint8_t channel;
+
+  for (channel = 0; channel < sizeof(session.channelDividers); channel++) {
+    channelScheduler.setDivider(channel, session.channelDividers[channel]);
+  }
+}
+#endif
+
+#ifdef FEATURE_FRAMES
+/**
+ * Add the motion axes of the packet to the feature window
+ */
+void addFeatureSample() {
+  int16_t sample[FEATURE_CHANNELS];
+  uint8_t axis;
+
+  for (axis = 0; axis < 3; axis++) {
+    sample[axis] = packet.acc1[axis];
+    sample[3 + axis] = packet.acc2[axis];
+    sample[6 + axis] = packet.gyro[axis];
+  }
+#if ACQ_INTERRUPT_DRIVEN
+  featureTimestamp = packet.timestamp;
+#else
+  featureTimestamp = micros();
+#endif
+  if (featureStats.add(sample)) featuresDue = true;
+}
+
+/**
+ * Send the window statistics if a hop ended since the last time.
+ * Uses the sample frame, so only call it between two sample frames.
+ */
+void sendFeatures() {
+  WindowChannelStats stats;
+  uint8_t channel;
+
+  if (!featuresDue) return;
+  featuresDue = false;
+
+  frame.begin(SENSORFRAME_TYPE_FEATURES, frameSequence++);
+  frame.putUInt32(featureTimestamp);
+  frame.putByte(featureStats.getCount());
+  for (channel = 0; channel < FEATURE_CHANNELS; channel++) {
+    featureStats.getStats(channel, &stats);
+    frame.putInt16(stats.mean);
+    frame.putUInt32(stats.variance);
+    frame.putInt16(stats.min);
+    frame.putInt16(stats.max);
+    frame.putUInt32(stats.energy);
+  }
+  frame.finish();
+  sendFrame();
+}
+#endif
+
+#ifdef ORIENTATION_FUSION
+/**
+ * Feed one MPU6050 reading in raw counts to the fusion filter
+ * @param dt Seconds since the previous reading
+ */
+void fuseMotion(const int16_t *accel, const int16_t *gyro, float dt) {
+  const float radPerCount = MotionConfig::gyroRadPerCount;
+  const float gPerCount = MotionConfig::accelGPerCount;
+  VectorFloat rate(gyro[0] * radPerCount, gyro[1] * radPerCount, gyro[2] * radPerCount);
+  VectorFloat gravity(accel[0] * gPerCount, accel[1] * gPerCount, accel[2] * gPerCount);
+
+  fusion.update(rate, gravity, dt);
+}
+
+/**
+ * Seconds between this sample and the previous one in mainTask, from the data-ready
+ * timestamps or, when polling, from micros() (the tick does not give exactly BASE_PERIOD_MS)
+ */
+float sampleInterval() {
+  static uint32_t last = 0;
+#if ACQ_INTERRUPT_DRIVEN
+  uint32_t now = packet.timestamp;
+#else
+  uint32_t now = micros();
+#endif
+  float dt = last == 0 ? 0 : (now - last) * 1e-6;
+
+  last = now;
+  return dt;
+}
+
+/**
+ * Send the current orientation, at most once every ORIENTATION_PERIOD_MS.
+ * Uses the sample frame, so only call it between two sample frames.
+ */
+void sendOrientation() {
+  static uint32_t lastSent = 0;
+  uint32_t now = millis();
+
+  if (now - lastSent < ORIENTATION_PERIOD_MS) return;
+  lastSent = now;
+
+  Quaternion q = fusion.getQuaternion();
+  frame.begin(SENSORFRAME_TYPE_ORIENTATION, frameSequence++);
+  frame.putUInt32(micros());
+  frame.putInt16(q.w * ORIENTATION_SCALE);
+  frame.putInt16(q.x * ORIENTATION_SCALE);
+  frame.putInt16(q.y * ORIENTATION_SCALE);
+  frame.putInt16(q.z * ORIENTATION_SCALE);
+  frame.finish();
+  sendFrame();
+}
+#endif
+
+/**
+ * Block until the next sample is due: session.sampleDivider POLL_PERIOD_TICKS later, or in
+ * ACQ_DATA_READY and ACQ_DMP the session.sampleDivider-th MPU6050 interrupt, whose time is kept
+ * in packet.timestamp. With ACTIVITY_GATING, while idle, only the next keep-alive sample is due.
+ */
+void waitForSample() {
+#if ACQ_INTERRUPT_DRIVEN
+  uint32_t pending = 0;
+
+  while (pending < session.sampleDivider) {
+    uint32_t taken = ulTaskNotifyTake(pdTRUE, (DATA_READY_TIMEOUT_MS / portTICK_PERIOD_MS));
+    if (taken == 0) {
+      missedDataReady++;
+      packet.timestamp = micros();
+      return;
+    }
+    pending += taken;
+  }
+  if (pending > session.sampleDivider) skippedDataReady += pending - session.sampleDivider;
+
+  taskENTER_CRITICAL();
+  packet.timestamp = dataReadyMicros;
+  taskEXIT_CRITICAL();
+#elif defined(ACTIVITY_GATING)
+  do {
+    vTaskDelayUntil(&xLastWakeTime, idle ? IDLE_POLL_MS / portTICK_PERIOD_MS : POLL_PERIOD_TICKS * session.sampleDivider);
+  } while (!activityGate());
+#else
+  vTaskDelayUntil(&xLastWakeTime, POLL_PERIOD_TICKS * session.sampleDivider);
+#endif
+}
+
+#ifdef ACTIVITY_GATING
+/**
+ * Read the activity and inactivity flags of both ADXL345 and switch between streaming and idle.
+ * Going idle takes inactivity on both sensors with no activity since; activity on either resumes streaming.
+ * @return True if a sample is due: always while streaming, every IDLE_KEEPALIVE_MS while idle
+ */
+bool activityGate() {
+  uint8_t sourceA = sensorA.getIntSource(); //reading clears the latched flags
+  uint8_t sourceB = sensorB.getIntSource();
+
+  if (sourceA & _BV(ADXL345_INT_ACTIVITY_BIT)) quietA = false;
+  else if (sourceA & _BV(ADXL345_INT_INACTIVITY_BIT)) quietA = true;
+  if (sourceB & _BV(ADXL345_INT_ACTIVITY_BIT)) quietB = false;
+  else if (sourceB & _BV(ADXL345_INT_INACTIVITY_BIT)) quietB = true;
+
+  if ((quietA && quietB) != idle) setIdle(quietA && quietB);
+  if (!idle) return true;
+  idleChecks++;
+#ifdef IDLE_SLEEP
+  //awake only around the keep-alive sample, from one check ahead: the gyro takes 30ms to start
+  if (idleChecks == 1) sensorC.setSleepEnabled(true);
+  else if (idleChecks == IDLE_KEEPALIVE_MS / IDLE_POLL_MS - 1) sensorC.setSleepEnabled(false);
+#endif
+  if (idleChecks < IDLE_KEEPALIVE_MS / IDLE_POLL_MS) return false;
+  idleChecks = 0;
+  return true;
+}
+
+/**
+ * Switch between streaming and idle, and book the time and energy of the state being left
+ */
+void setIdle(bool enable) {
+  uint32_t now = millis();
+  uint64_t energy = energyMeter.getEnergy();
+
+  stateMillis[idle] += now - stateStart;
+  stateEnergy[idle] += energy - stateStartEnergy;
+  stateStart = now;
+  stateStartEnergy = energy;
+
+  idle = enable;
+  idleChecks = 0;
+  //the Timer0 tick wakes the MCU anyway, free running conversions would wake it every 104us
+  AdcSampler::begin(powerChannels, sizeof(powerChannels), enable ? ADCSAMPLER_TIMER0 : ADC_TRIGGER);
+#ifdef IDLE_SLEEP
+  sensorC.setSleepEnabled(enable);
+#endif
+#ifdef FEATURE_FRAMES
+  if (!enable) featureStats.reset(); //keep-alive samples are too far apart for a window
+#endif
+}
+
+/**
+ * Have both ADXL345 flag activity and inactivity (INT_SOURCE, also raised on INT1),
+ * AC coupled on all axes so the orientation the dancer rests in does not matter
+ */
+void setupActivity(ADXL345 &sensor) {
+  sensor.setActivityThreshold(ACTIVITY_THRESHOLD);
+  sensor.setInactivityThreshold(INACTIVITY_THRESHOLD);
+  sensor.setInactivityTime(INACTIVITY_TIME_S);
+  sensor.setActivityAC(true);
+  sensor.setActivityXEnabled(true);
+  sensor.setActivityYEnabled(true);
+  sensor.setActivityZEnabled(true);
+  sensor.setInactivityAC(true);
+  sensor.setInactivityXEnabled(true);
+  sensor.setInactivityYEnabled(true);
+  sensor.setInactivityZEnabled(true);
+  sensor.setIntActivityEnabled(true);
+  sensor.setIntInactivityEnabled(true);
+  sensor.getIntSource(); //start with clear flags
+}
+#endif
+
+#if ACQ_INTERRUPT_DRIVEN
+/**
+ * MPU6050 data-ready (or DMP) ISR: stamp the sample and wake mainTask
+ */
+void dataReadyISR() {
+  BaseType_t woken = pdFALSE;
+
+  dataReadyMicros = micros();
+  if (mainTaskHandle == NULL) return;
+  vTaskNotifyGiveFromISR(mainTaskHandle, &woken);
+#ifdef portYIELD_FROM_ISR
+  if (woken) portYIELD_FROM_ISR();
+#endif
+}
+#endif
+
+#if ACQUISITION_MODE == ACQ_DATA_READY
+/**
+ * Have the MPU6050, running at SAMPLE_PERIOD_MS (MotionConfig), pulse INT on every new sample.
+ * The ADXL345s run at 100Hz, so each read finds data at most 10ms old.
+ */
+void setupDataReady() {
+  sensorC.setInterruptMode(MPU6050_INTMODE_ACTIVEHIGH);
+  sensorC.setInterruptDrive(MPU6050_INTDRV_PUSHPULL);
+  sensorC.setInterruptLatch(MPU6050_INTLATCH_50USPULSE);
+  sensorC.setIntEnabled(0);
+  sensorC.setIntDataReadyEnabled(true);
+  pinMode(DATA_READY_PIN, INPUT);
+}
+#endif
+
+#if ACQUISITION_MODE == ACQ_DMP
+uint8_t dmpPacket[DMP_PACKET_SIZE];
+uint16_t dmpOverflows = 0; //FIFO overflows, the DMP packets in it were lost
+bool dmpReady = false;
+
+/**
+ * Load the MotionApps 2.0 DMP firmware, set its output rate and let it pulse INT for every FIFO packet
+ */
+void setupDMP() {
+  //D_0_22 of the DMP memory holds the FIFO rate divisor, dmpInitialize() leaves it at 100Hz
+  const uint8_t fifoRate[] = { 0x00, DMP_FIFO_RATE_DIVISOR };
+
+  if (sensorC.dmpInitialize() != 0) {
+    Serial.println("DMP failed to initialize");
+    return;
   }
+  sensorC.writeMemoryBlock(fifoRate, sizeof(fifoRate), 0x02, 0x16);
+  sensorC.setDMPEnabled(true);
+  sensorC.resetFIFO();
+  dmpReady = sensorC.dmpGetFIFOPacketSize() == DMP_PACKET_SIZE;
+  pinMode(DATA_READY_PIN, INPUT);
 }
 
+/**
+ * Drain the DMP FIFO and keep the newest packet's quaternion and linear acceleration in the packet.
+ * The packet keeps its previous values if no complete packet was waiting.
+ */
+void getDMPReadings() {
+  uint8_t status;
+  uint16_t count;
+  bool fresh = false;
+
+  if (!dmpReady) return;
+
+  status = sensorC.getIntStatus(); //also clears the interrupt
+  count = sensorC.getFIFOCount();
+  if ((status & _BV(MPU6050_INTERRUPT_FIFO_OFLOW_BIT)) || count >= 1024) {
+    //frame alignment is lost once the FIFO overflows: start over
+    sensorC.resetFIFO();
+    dmpOverflows++;
+    return;
+  }
+  while (count >= DMP_PACKET_SIZE) {
+    sensorC.getFIFOBytes(dmpPacket, DMP_PACKET_SIZE);
+    count -= DMP_PACKET_SIZE;
+    fresh = true;
+  }
+  if (!fresh) return;
+
+  //integer form of dmpGetLinearAccel(), gravity and accel both in 1g = 8192
+  int16_t gravity[3];
+  VectorInt16 accel;
+  sensorC.dmpGetQuaternion(packet.quaternion, dmpPacket);
+  sensorC.dmpGetGravity(gravity, dmpPacket);
+  sensorC.dmpGetAccel(&accel, dmpPacket);
+  packet.linearAccel[0] = accel.x - gravity[0];
+  packet.linearAccel[1] = accel.y - gravity[1];
+  packet.linearAccel[2] = accel.z - gravity[2];
+}
+#endif
+
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+/**
+ * FIFO Task
+ * The ADXL345s sample on their own at the AccelConfig rate. Every FIFO_DRAIN_PERIOD_MS
+ * the task drains both FIFOs and sends the block as consecutive frames of up to
+ * session.frameSamples samples. The MPU6050 streams into its own FIFO at
+ * MOTION_OVERSAMPLE times the rate; everything it collected since the last drain
+ * is spread over the block and averaged per sample. The power readings are taken
+ * once per drain and repeated for every sample of the block.
+ */
+void fifoTask(void *p) {
+  uint8_t count, n, axis;
+  uint16_t motionSamples;
+
+  PROFILE_WAKE();
+  xLastWakeTime = xTaskGetTickCount();
+  while(1){
+    PROFILE_START(PHASE_I2C);
+    count = drainAccelFIFOs();
+    motionSamples = motionStream.getPendingSamples();
+    PROFILE_STOP(PHASE_I2C);
+    getPowerReadings();
+
+    for (n = 0; n < count; n++) {
+      if (n % session.frameSamples == 0) {
+        frame.begin(SENSORFRAME_TYPE_SAMPLES, frameSequence++);
+      }
+
+      //sample n gets the motion samples from motionSamples * n / count up to the next one's
+      PROFILE_START(PHASE_I2C);
+      getAveragedMotion(motionSamples * (n + 1) / count - motionSamples * n / count);
+      PROFILE_STOP(PHASE_I2C);
+
+      PROFILE_START(PHASE_FORMAT);
+      for (axis = 0; axis < 3; axis++) {
+        packet.acc1[axis] = fifoAccelA[n][axis];
+        packet.acc2[axis] = fifoAccelB[n][axis];
+      }
+      ADD_FEATURE_SAMPLE();
+      packSample();
+      PROFILE_STOP(PHASE_FORMAT);
+
+      if (n % session.frameSamples == session.frameSamples - 1 || n == count - 1) {
+        PROFILE_START(PHASE_CHECKSUM);
+        frame.finish();
+        PROFILE_STOP(PHASE_CHECKSUM);
+        PROFILE_START(PHASE_UART);
+        sendFrame();
+        PROFILE_STOP(PHASE_UART);
+      }
+    }
+
+    SEND_ORIENTATION();
+    SEND_FEATURES();
+    SERVICE_RESENDS();
+    PROFILE_DUMP();
+    PROFILE_STOP(PHASE_BUSY);
+    vTaskDelayUntil(&xLastWakeTime, (FIFO_DRAIN_PERIOD_MS / portTICK_PERIOD_MS));
+    PROFILE_WAKE();
+  }
+}
+
+/**
+ * Read the same number of entries from both ADXL345 FIFOs into fifoAccelA/B.
+ * The two parts run off their own oscillators, so one can slowly get ahead; its
+ * surplus entry is dropped to keep the pairs aligned.
+ * @return Number of entry pairs read
+ */
+uint8_t drainAccelFIFOs() {
+  int16_t discard[3];
+  uint8_t lengthA = sensorA.getFIFOLength();
+  uint8_t lengthB = sensorB.getFIFOLength();
+  uint8_t count = min(lengthA, lengthB);
+
+  if (lengthA >= ACCEL_FIFO_DEPTH || lengthB >= ACCEL_FIFO_DEPTH) fifoOverruns++;
+  if (count > ACCEL_FIFO_DEPTH) count = ACCEL_FIFO_DEPTH;
+
+  count = sensorA.getFIFOAccelerations(&fifoAccelA[0][0], count);
+  count = sensorB.getFIFOAccelerations(&fifoAccelB[0][0], count);
+
+  if (lengthA > lengthB + 1) sensorA.getFIFOAccelerations(discard, 1);
+  if (lengthB > lengthA + 1) sensorB.getFIFOAccelerations(discard, 1);
+  return count;
+}
+
+/**
+ * Average the next samples of the MPU6050 stream into packet.acc3 and packet.gyro.
+ * The packet keeps its previous values if the stream has nothing.
+ * @param samples Number of stream samples to consume
+ */
+void getAveragedMotion(uint16_t samples) {
+  MPU6050Sample sample;
+  int32_t accel[3] = { 0, 0, 0 };
+  int32_t gyro[3] = { 0, 0, 0 };
+  uint16_t got = 0;
+  uint8_t axis;
+
+  while (got < samples && motionStream.read(&sample)) {
+    for (axis = 0; axis < 3; axis++) {
+      accel[axis] += sample.accel[axis];
+      gyro[axis] += sample.gyro[axis];
+    }
+    FUSE_MOTION(sample.accel, sample.gyro, SAMPLE_PERIOD_MS / MOTION_OVERSAMPLE * 1e-3); //every sample at the full motion rate
+    got++;
+  }
+  if (got == 0) return;
+
+  for (axis = 0; axis < 3; axis++) {
+    packet.acc3[axis] = accel[axis] / got;
+    packet.gyro[axis] = gyro[axis] / got;
+  }
+}
+
+/**
+ * Put both ADXL345 in stream mode and empty their FIFOs so they start together,
+ * then start the MPU6050 stream
+ */
+void setupAccelFIFOs() {
+  int16_t discard[3 * ACCEL_FIFO_DEPTH];
+
+  //auto sleep would drop the data rate to 8Hz while the dancer stands still
+  sensorA.setAutoSleepEnabled(false);
+  sensorB.setAutoSleepEnabled(false);
+  sensorA.setFIFOMode(ADXL345_FIFO_MODE_STREAM);
+  sensorB.setFIFOMode(ADXL345_FIFO_MODE_STREAM);
+  sensorA.getFIFOAccelerations(discard, sensorA.getFIFOLength());
+  sensorB.getFIFOAccelerations(discard, sensorB.getFIFOLength());
+  motionStream.begin(MotionConfig::rateDivider, MotionConfig::dlpf);
+}
+#endif
+
+#ifdef TIMING_PROFILE
+/**
+ * Called each time mainTask wakes up: records the wake-up interval and starts timing the busy phase
+ */
+void profileWake() {
+  static uint32_t lastWake = 0;
+  uint32_t now = micros();
+
+  if (lastWake != 0) {
+    profiler.record(PHASE_PERIOD, now - lastWake);
+  }
+  lastWake = now;
+  profiler.start(PHASE_BUSY);
+}
+
+/**
+ * Print the Rpi link transmit queue statistics and start a new high-water measurement
+ */
+void printLinkStats() {
+  SerialTxQueueStats stats;
+
+  SerialTxQueue::getStats(&stats);
+  Serial.print("tx queued=");
+  Serial.print(stats.queued);
+  Serial.print(" high-water=");
+  Serial.print(stats.highWaterMark);
+  Serial.print("/");
+  Serial.print(SERIALTXQUEUE_TX_SIZE);
+  Serial.print(" frames=");
+  Serial.print(stats.framesQueued);
+  Serial.print(" dropped=");
+  Serial.print(stats.framesDropped);
+  Serial.print(" rx overruns=");
+#ifdef RESEND_FRAMES
+  Serial.print(stats.rxOverruns);
+  Serial.print(" resent=");
+  Serial.println(resentFrames);
+#else
+  Serial.println(stats.rxOverruns);
+#endif
+  SerialTxQueue::resetHighWaterMark();
+}
+
+/**
+ * Print and clear the counters every PROFILE_DUMP_FRAMES frames
+ */
+void profileDump() {
+  static uint16_t lastDump = 0;
+
+  if ((uint16_t)(frameSequence - lastDump) < PROFILE_DUMP_FRAMES) return;
+  lastDump = frameSequence;
+  profiler.dump(Serial);
+  printLinkStats();
+  Serial.print("adc conversions=");
+  Serial.println(AdcSampler::getConversionCount());
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+  Serial.print("fifo overruns=");
+  Serial.print(fifoOverruns);
+  Serial.print(" mpu overflows=");
+  Serial.println(motionStream.getOverflowCount());
+#elif ACQ_INTERRUPT_DRIVEN
+  Serial.print("data-ready missed=");
+  Serial.print(missedDataReady);
+  Serial.print(" skipped=");
+  Serial.println(skippedDataReady);
+#endif
+#if ACQUISITION_MODE == ACQ_DMP
+  Serial.print("dmp overflows=");
+  Serial.println(dmpOverflows);
+#endif
+#ifdef ACTIVITY_GATING
+  printActivityStats();
+#endif
+  profiler.reset();
+  profiler.start(PHASE_BUSY); //the dump itself is not part of the budget
+}
+
+#ifdef ACTIVITY_GATING
+/**
+ * Print the time spent streaming and idle, the energy per hour of each, and the energy per hour
+ * with the gating against streaming all the time (needs the power sensors)
+ */
+void printActivityStats() {
+  uint32_t millisSpent[2] = { stateMillis[0], stateMillis[1] };
+  uint64_t energySpent[2] = { stateEnergy[0], stateEnergy[1] };
+  uint8_t state;
+
+  //the state in progress counts too
+  millisSpent[idle] += millis() - stateStart;
+  energySpent[idle] += energyMeter.getEnergy() - stateStartEnergy;
+
+  for (state = 0; state < 2; state++) {
+    Serial.print(state ? " idle " : "streaming ");
+    Serial.print(millisSpent[state] / 1000);
+    Serial.print("s ");
+    //uJ / ms = mW, * 3600 = mJ per hour
+    Serial.print(millisSpent[state] ? (uint32_t)(energySpent[state] * 3600 / millisSpent[state] / 1000) : 0);
+    Serial.print("J/h");
+  }
+  Serial.print(" gated ");
+  Serial.print((uint32_t)((energySpent[0] + energySpent[1]) * 3600 / max(millisSpent[0] + millisSpent[1], 1UL) / 1000));
+  Serial.println("J/h");
+}
+#endif
+
+/**
+ * Names, histogram bin widths and budgets of the mainTask phases
+ */
+void setupProfiler() {
+  profiler.configure(PHASE_I2C, "i2c", 250);
+  profiler.configure(PHASE_ADC, "adc", 25);
+  profiler.configure(PHASE_POWER, "power", 25);
+  profiler.configure(PHASE_FORMAT, "format", 25);
+  profiler.configure(PHASE_CHECKSUM, "checksum", 25);
+  profiler.configure(PHASE_UART, "uart", 250);
+  profiler.configure(PHASE_BUSY, "busy", TASK_PERIOD_MS * 1000UL / 16, TASK_PERIOD_MS * 1000UL);
+  profiler.configure(PHASE_PERIOD, "period", TASK_PERIOD_MS * 1000UL / 8, TASK_PERIOD_MS * 1000UL * 3 / 2);
+}
+#endif
+
 
 
  /**
@@ -139,60 +1122,160 @@ void mainTask(void *p) {
 void getData(){
      
       // Read values from different sensors
+      PROFILE_START(PHASE_I2C);
       getScaledReadings();
-    
-      //Measure and display voltage measured from voltage divider
-      voltageReading = analogRead(voltageDividerPin);
-      packet.voltage = remapVoltage(voltageReading) * 2;
+#if ACQUISITION_MODE == ACQ_DMP
+      getDMPReadings();
+#endif
+      PROFILE_STOP(PHASE_I2C);
+      getPowerReadings();
+}
 
+ /**
+ *  To read voltage and current and update power and energy in the packet
+ */
+void getPowerReadings(){
+      PROFILE_START(PHASE_ADC);
+      //means of every conversion since the previous sample, the ADC runs on its own
+      voltageReading = AdcSampler::read(VOLTAGE_SLOT);
+      currentReading = AdcSampler::read(CURRENT_SLOT);
+      PROFILE_STOP(PHASE_ADC);
 
-      //Measure voltage out from current sensor to calculate current
-      vOut = analogRead(currentSensorPin);
-      vOut = remapVoltage(vOut);
-      packet.current = ((vOut * 1000) / (RS * RL));
+      PROFILE_START(PHASE_POWER);
+      //Voltage measured from voltage divider, current from the current sensor output
+      packet.voltage = sensorScaleVoltage(voltageReading);
+      packet.current = sensorScaleCurrent(currentReading);
 
-      //Power is in mW due to current being in mA
-      packet.power = packet.current * packet.voltage;
+      //the readings are means since the previous sample, so the power holds for exactly that interval
+      if (energyMeter.update(sensorScalePower(packet.voltage, packet.current), micros())) {
+        packet.power = energyMeter.getReportedPower();
+        packet.energy = (uint32_t)energyMeter.getReportedEnergy(); //wraps after 4295J, the Pi unwraps it
+      }
+      PROFILE_STOP(PHASE_POWER);
+}
 
-      static long prevTime = 0;
-      static float energy = 0;
-      
-      //Power / 1000.0 because converting mW to W
-      //This allows joules to  be in W per seconds
-      energy += ((millis()-prevTime) / (1000.0)) * packet.power;
 
-      prevTime = millis();
+/*
+ * To store the raw data obtained from sensor reading
+ * All three sensors are read in one batch, one I2C transaction each.
+ * If the batch fails part way, the packet keeps the previous values for the sensors not read.
+ */
+void getScaledReadings() {
+  uint8_t axis;
+  int8_t done = I2Cdev::readBursts(sensorBursts, SENSOR_BURSTS);
 
-      packet.energy = energy;
+  if (done >= 1) {
+    for (axis = 0; axis < 3; axis++) packet.acc1[axis] = (((int16_t)accelABuffer[2 * axis + 1]) << 8) | accelABuffer[2 * axis];
+  }
+  if (done >= 2) {
+    for (axis = 0; axis < 3; axis++) packet.acc2[axis] = (((int16_t)accelBBuffer[2 * axis + 1]) << 8) | accelBBuffer[2 * axis];
+  }
+  if (done >= 3) {
+    for (axis = 0; axis < 3; axis++) {
+      packet.acc3[axis] = (((int16_t)motionBuffer[2 * axis]) << 8) | motionBuffer[2 * axis + 1];
+      packet.gyro[axis] = (((int16_t)motionBuffer[2 * axis + 8]) << 8) | motionBuffer[2 * axis + 9];
+    }
+  }
+ }
+
+/**
+ * Program the ranges, rates and filters of AccelConfig and MotionConfig into the sensors
+ */
+void setupSensors() {
+  AccelConfig::apply(sensorA);
+  AccelConfig::apply(sensorB);
+  MotionConfig::apply(sensorC); //ACQ_DMP: dmpInitialize() sets the same again
 }
 
- /*
- * Data processing
+/**
+ * Program the offsets stored in EEPROM and take the stored session. With CALIBRATE_OFFSETS, calibrate and
+ * store them if there are none, otherwise keep the offsets the sensors hold so a session saved later does
+ * not overwrite them. Before the FIFO and interrupt set-up, except ACQ_DMP where dmpInitialize() has to come first
  */
-float remapVoltage(int volt) {
-  return (5.0/1023) * volt;
+void setupOffsets() {
+  if (StoredConfig::load(SETTINGS_ADDRESS, SETTINGS_VERSION, &settings, sizeof(settings))) {
+    applyOffsets();
+    Serial.println("Offsets loaded");
+    //a session stored by a build with another mode or link is left for the defaults
+    if (checkSession(&settings.session) == SENSORFRAME_SESSION_ACCEPTED) session = settings.session;
+    return;
+  }
+  settings.session = session;
+  readOffsets();
+#ifdef CALIBRATE_OFFSETS
+  calibrateSensors();
+  StoredConfig::save(SETTINGS_ADDRESS, SETTINGS_VERSION, &settings, sizeof(settings));
+#endif
 }
 
+/**
+ * Write the offsets in settings to the sensors' offset registers
+ */
+void applyOffsets() {
+  sensorA.setOffset(settings.accelOffsetA[0], settings.accelOffsetA[1], settings.accelOffsetA[2]);
+  sensorB.setOffset(settings.accelOffsetB[0], settings.accelOffsetB[1], settings.accelOffsetB[2]);
+  sensorC.setXAccelOffset(settings.motionOffset[0]);
+  sensorC.setYAccelOffset(settings.motionOffset[1]);
+  sensorC.setZAccelOffset(settings.motionOffset[2]);
+  sensorC.setXGyroOffset(settings.motionOffset[3]);
+  sensorC.setYGyroOffset(settings.motionOffset[4]);
+  sensorC.setZGyroOffset(settings.motionOffset[5]);
+}
 
-/*
- * To process the raw data obtained from sensor reading
+/**
+ * Keep the offsets the sensors' offset registers hold in settings, the MPU6050 ones are factory trimmed
  */
-void getScaledReadings() {
-  sensorA.getAcceleration(&xa_raw, &ya_raw, &za_raw);
-  packet.acc1[0] = (xa_raw)*scaleFactorAccel;
-  packet.acc1[1] = (ya_raw)*scaleFactorAccel;
-  packet.acc1[2] = (za_raw)*scaleFactorAccel;
-  
-  sensorB.getAcceleration(&xb_raw, &yb_raw, &zb_raw);
-  packet.acc2[0] = (xb_raw)*scaleFactorAccel;
-  packet.acc2[1] = (yb_raw)*scaleFactorAccel;
-  packet.acc2[2] = (zb_raw)*scaleFactorAccel;
-  
-  sensorC.getRotation(&xg_raw, &yg_raw, &zg_raw);
-  packet.gyro[0] = (xg_raw)*scaleFactorGyro;
-  packet.gyro[1]= (yg_raw)*scaleFactorGyro;
-  packet.gyro[2] = (zg_raw)*scaleFactorGyro;
- }
+void readOffsets() {
+  sensorA.getOffset(&settings.accelOffsetA[0], &settings.accelOffsetA[1], &settings.accelOffsetA[2]);
+  sensorB.getOffset(&settings.accelOffsetB[0], &settings.accelOffsetB[1], &settings.accelOffsetB[2]);
+  settings.motionOffset[0] = sensorC.getXAccelOffset();
+  settings.motionOffset[1] = sensorC.getYAccelOffset();
+  settings.motionOffset[2] = sensorC.getZAccelOffset();
+  settings.motionOffset[3] = sensorC.getXGyroOffset();
+  settings.motionOffset[4] = sensorC.getYGyroOffset();
+  settings.motionOffset[5] = sensorC.getZGyroOffset();
+}
+
+/**
+ * Program the offset registers so the sensors read 0 on every axis but Z, which reads 1g,
+ * and keep the results in settings. The device must lie still and level meanwhile
+ */
+void calibrateSensors() {
+  Adxl345Calibration calibrationA(sensorA, AccelConfig::range);
+  Adxl345Calibration calibrationB(sensorB, AccelConfig::range);
+  Mpu6050Calibration calibrationC(sensorC, MotionConfig::gyroRange, MotionConfig::accelRange);
+  OffsetCalibration *calibrations[] = { &calibrationA, &calibrationB, &calibrationC };
+  uint8_t axis;
+
+  Serial.println("Calibrating, keep the device still and level");
+  //one new ADXL345 reading per output period
+  OffsetCalibration::run(calibrations, 3, CALIBRATION_SAMPLES, 1000000UL / AccelConfig::rateMilliHz);
+  Serial.println("Calibration done");
+
+  for (axis = 0; axis < 3; axis++) {
+    settings.accelOffsetA[axis] = calibrationA.getOffset(axis);
+    settings.accelOffsetB[axis] = calibrationB.getOffset(axis);
+  }
+  for (axis = 0; axis < 6; axis++) settings.motionOffset[axis] = calibrationC.getOffset(axis);
+}
+
+/**
+ * COMMAND_CALIBRATE: calibrate with the acquisition already set up and store the offsets
+ */
+void recalibrate() {
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+  //readings from the FIFOs would lag the offsets by up to ACCEL_FIFO_DEPTH samples
+  sensorA.setFIFOMode(ADXL345_FIFO_MODE_BYPASS);
+  sensorB.setFIFOMode(ADXL345_FIFO_MODE_BYPASS);
+#endif
+  calibrateSensors();
+  StoredConfig::save(SETTINGS_ADDRESS, SETTINGS_VERSION, &settings, sizeof(settings));
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+  setupAccelFIFOs();
+#elif ACQUISITION_MODE == ACQ_DMP
+  sensorC.resetFIFO();
+#endif
+}
 
 /**
  *  To perform handshake to ensure that communication between Rpi and Aduino is ready
@@ -200,79 +1283,300 @@ void getScaledReadings() {
 void handshake() {
    
   while (h_flag == 0) {
-    if (Serial1.available()) {
-      if ((Serial1.read() == 'H')) {
-        h_flag = 1;
-        Serial1.write('A');
+    if (SerialTxQueue::available()) {
+      switch (SerialTxQueue::read()) {
+        case 'H':
+          h_flag = 1;
+          SerialTxQueue::write('A');
+          break;
+        case COMMAND_CALIBRATE:
+          recalibrate();
+          SerialTxQueue::write(COMMAND_DONE);
+          break;
+        case COMMAND_ERASE:
+          StoredConfig::erase(SETTINGS_ADDRESS);
+          SerialTxQueue::write(COMMAND_DONE);
+          break;
+        case COMMAND_HELLO:
+          sendHello();
+          break;
+        case COMMAND_SESSION:
+          receiveSession();
+          sendHello();
+          break;
       }
     }
   }
 
   while (n_flag == 0) {
-    if (Serial1.available()) {
-      if (Serial1.read() == 'N') {
+    if (SerialTxQueue::available()) {
+      if (SerialTxQueue::read() == 'N') {
         Serial.println("Handshake done");
         n_flag = 1;
       }
       else {
-        Serial1.write('A');
+        SerialTxQueue::write('A');
       }
     }
   }
 
 }
 
-/** 
- Change the format of the data from float to string
+/**
+ * Features built into this firmware, for the HELLO frame
+ * @return Mask of SENSORFRAME_CAP_* bits
  */
-void changeFormat(){
-char charbuf[67] ;
+uint16_t capabilities() {
+  uint16_t caps = SENSORFRAME_CAP_OFFSETS;
 
-  
-  acc1_x = dtostrf( packet.acc1[0],3,2,charbuf);
-  strcat(databuf, acc1_x); 
-  strcat(databuf, ",");
-  acc1_y = dtostrf(packet.acc1[1],3,2,charbuf);
-  strcat(databuf, acc1_y); 
-  strcat(databuf, ",");
-  acc1_z = dtostrf(packet.acc1[2],3,2,charbuf);
-  strcat(databuf, acc1_z); 
-  strcat(databuf, ",");
-
-  acc2_x = dtostrf(packet.acc2[0],3,2,charbuf);
-  strcat(databuf, acc2_x); 
-  strcat(databuf, ",");
-  acc2_y = dtostrf(packet.acc2[1],3,2,charbuf);
-  strcat(databuf, acc2_y); 
-  strcat(databuf, ",");
-  acc2_z = dtostrf(packet.acc2[2],3,2,charbuf);
-  strcat(databuf, acc2_z); 
-  strcat(databuf, ",");
-
-  gyro_x = dtostrf(packet.gyro[0],3,2,charbuf);
-  strcat(databuf, gyro_x); 
-  strcat(databuf, ",");
-  gyro_y = dtostrf( packet.gyro[1],3,2,charbuf);
-  strcat(databuf, gyro_y); 
-  strcat(databuf, ",");
-  gyro_z = dtostrf(packet.gyro[2],3,2,charbuf);
-  strcat(databuf, gyro_z); 
-  strcat(databuf, ",");
-
-  voltage_c = dtostrf(packet.voltage,3,2,charbuf);
-  strcat(databuf,  voltage_c); 
-  strcat(databuf, ",");
-  current_c = dtostrf( packet.current,3,2,charbuf);
-  strcat(databuf, current_c); 
-  strcat(databuf, ",");
-  power_c = dtostrf( packet.power,3,2,charbuf);
-  strcat(databuf, power_c ); 
-  strcat(databuf, ","); 
-  energy_c = dtostrf( packet.energy,3,2,charbuf);
-  strcat(databuf, energy_c  );
- //strcat(databuf, "\r");
+#if ACQUISITION_MODE != ACQ_ADXL_FIFO
+  caps |= SENSORFRAME_CAP_SAMPLE_DIVIDER;
+#endif
+#ifdef DELTA_FRAMES
+  caps |= SENSORFRAME_CAP_DELTA;
+#endif
+#ifdef CHANNEL_FRAMES
+  caps |= SENSORFRAME_CAP_CHANNELS;
+#endif
+#ifdef FEATURE_FRAMES
+  caps |= SENSORFRAME_CAP_FEATURES;
+#endif
+#if defined(ORIENTATION_FUSION) || ACQUISITION_MODE == ACQ_DMP
+  caps |= SENSORFRAME_CAP_ORIENTATION;
+#endif
+#ifdef RESEND_FRAMES
+  caps |= SENSORFRAME_CAP_RESEND;
+#endif
+#ifdef ACTIVITY_GATING
+  caps |= SENSORFRAME_CAP_ACTIVITY_GATING;
+#endif
+  return caps;
 }
 
+/**
+ * Answer COMMAND_HELLO or COMMAND_SESSION with a HELLO frame: the firmware and the session in force
+ */
+void sendHello() {
+  uint8_t channel;
+
+  frame.begin(SENSORFRAME_TYPE_HELLO, frameSequence++);
+  frame.putByte(SENSORFRAME_HANDSHAKE_VERSION);
+  frame.putUInt16(FIRMWARE_VERSION);
+  frame.putByte(ACQUISITION_MODE);
+  frame.putUInt16(capabilities());
+  frame.putByte(BASE_PERIOD_MS);
+  frame.putByte(SAMPLES_PER_FRAME);
+  frame.putByte(sessionStatus);
+  frame.putByte(session.sampleDivider);
+  frame.putByte(session.frameSamples);
+  frame.putByte(session.framing);
+  for (channel = 0; channel < sizeof(session.channelDividers); channel++) {
+    frame.putByte(session.channelDividers[channel]);
+  }
+  frame.finish();
+  sendFrame();
+}
+
+/**
+ * Upper bound of the bytes per second a session sends, worked out like CHANNEL_BYTES_PER_SECOND.
+ * ORIENTATION, FEATURES and resent frames are left to the rest of the link
+ * @param s Session to check
+ * @return Bytes per second at the nominal sample rate
+ */
+uint32_t sessionBytesPerSecond(const Session *s) {
+  static const uint8_t channelBytes[] = { 3 * 2, 3 * 2, 3 * 2, 2 * 2 + 2 * 4 }; //fields of each channel
+  const uint32_t period = (uint32_t)BASE_PERIOD_MS * s->sampleDivider; //ms per sample
+  const uint16_t overhead = SENSORFRAME_HEADER_LENGTH + SENSORFRAME_CRC_LENGTH;
+  uint32_t bytes;
+  uint8_t channel;
+
+  switch (s->framing) {
+    case SENSORFRAME_FRAMING_CHANNELS:
+      bytes = 1000UL * (overhead + 4 + 1) / period; //a frame every sample
+      for (channel = 0; channel < sizeof(s->channelDividers); channel++) {
+        if (s->channelDividers[channel] > 0) bytes += 1000UL * channelBytes[channel] / (period * s->channelDividers[channel]);
+      }
+      return bytes;
+#ifdef DELTA_FRAMES
+    case SENSORFRAME_FRAMING_DELTA:
+      //a keyframe, then every change at its widest
+      return 1000UL * (overhead + SAMPLE_SIZE + (s->frameSamples - 1) * (uint32_t)DELTA_SAMPLE_MAX_SIZE) / (period * s->frameSamples);
+#endif
+    default:
+      return 1000UL * (overhead + s->frameSamples * (uint32_t)SAMPLE_SIZE) / (period * s->frameSamples);
+  }
+}
+
+/**
+ * Check a session the Pi asked for against what this firmware was built with and the link
+ * @param s Session asked for
+ * @return SENSORFRAME_SESSION_ACCEPTED, or why it cannot be used
+ */
+uint8_t checkSession(const Session *s) {
+  if (s->sampleDivider < 1 || s->sampleDivider > SESSION_MAX_DIVIDER || s->frameSamples < 1) return SENSORFRAME_SESSION_UNSUPPORTED;
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+  if (s->sampleDivider != 1) return SENSORFRAME_SESSION_UNSUPPORTED; //the ADXL345s set the pace
+#endif
+  switch (s->framing) {
+    case SENSORFRAME_FRAMING_SAMPLES:
+      if (s->frameSamples > SAMPLES_PER_FRAME) return SENSORFRAME_SESSION_UNSUPPORTED;
+      break;
+#ifdef DELTA_FRAMES
+    case SENSORFRAME_FRAMING_DELTA:
+      break; //frames are closed early when full
+#endif
+#ifdef CHANNEL_FRAMES
+    case SENSORFRAME_FRAMING_CHANNELS:
+      break;
+#endif
+    default:
+      return SENSORFRAME_SESSION_UNSUPPORTED;
+  }
+  if (sessionBytesPerSecond(s) >= LINK_BYTES_PER_SECOND * 3 / 4) return SENSORFRAME_SESSION_OVER_LINK;
+  return SENSORFRAME_SESSION_ACCEPTED;
+}
+
+/**
+ * Read the SESSION_LENGTH bytes after COMMAND_SESSION and take the session if checkSession() accepts it,
+ * and store it for the next boot. sessionStatus tells the Pi how it went
+ */
+void receiveSession() {
+  uint8_t bytes[SESSION_LENGTH];
+  uint8_t received = 0;
+  uint32_t start = millis();
+  Session requested;
+
+  while (received < SESSION_LENGTH) {
+    if (SerialTxQueue::available()) bytes[received++] = SerialTxQueue::read();
+    else if (millis() - start > SESSION_TIMEOUT_MS) {
+      sessionStatus = SENSORFRAME_SESSION_UNSUPPORTED;
+      return;
+    }
+  }
+
+  requested.sampleDivider = bytes[0];
+  requested.frameSamples = bytes[1];
+  requested.framing = bytes[2];
+  memcpy(requested.channelDividers, &bytes[3], sizeof(requested.channelDividers));
+  sessionStatus = checkSession(&requested);
+  if (sessionStatus != SENSORFRAME_SESSION_ACCEPTED) return;
+  session = requested;
+  settings.session = requested;
+  StoredConfig::save(SETTINGS_ADDRESS, SETTINGS_VERSION, &settings, sizeof(settings));
+}
+
+/**
+ * Type of the sample frames mainTask sends in the session
+ */
+uint8_t sessionFrameType() {
+#ifdef DELTA_FRAMES
+  if (session.framing == SENSORFRAME_FRAMING_DELTA) return SAMPLE_FRAME_TYPE | SENSORFRAME_TYPE_DELTA;
+#endif
+  return SAMPLE_FRAME_TYPE;
+}
+
+/**
+ * Task sending the session's frames, chosen once after the handshake
+ */
+TaskFunction_t sessionTask() {
+#ifdef CHANNEL_FRAMES
+  if (session.framing == SENSORFRAME_FRAMING_CHANNELS) return channelTask;
+#endif
+  return mainTask;
+}
+
+/**
+ * Append the current packet to the frame as one binary sample.
+ * Field order matches the old comma separated line: acc1, acc2, gyro, voltage, current, power, energy
+ */
+void packSample() {
+  uint8_t axis;
+
+#ifdef DELTA_FRAMES
+  //only the first sample of a frame goes out in full, so every frame decodes on its own
+  if (session.framing == SENSORFRAME_FRAMING_DELTA && frame.getPayloadLength() > 0) {
+    packSampleDelta();
+    return;
+  }
+  previousPacket = packet;
+#endif
+#if ACQ_INTERRUPT_DRIVEN
+  frame.putUInt32(packet.timestamp);
+#endif
+  for (axis = 0; axis < 3; axis++) frame.putInt16(packet.acc1[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putInt16(packet.acc2[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putInt16(packet.gyro[axis]);
+
+  frame.putUInt16(packet.voltage);
+  frame.putUInt16(packet.current);
+  frame.putUInt32(packet.power);
+  frame.putUInt32(packet.energy);
+#if ACQUISITION_MODE == ACQ_DMP
+  for (axis = 0; axis < 4; axis++) frame.putInt16(packet.quaternion[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putInt16(packet.linearAccel[axis]);
+#endif
+}
+
+#ifdef DELTA_FRAMES
+/**
+ * Append the current packet to a delta coded frame as the change from previousPacket,
+ * field by field in the order of packSample()
+ */
+void packSampleDelta() {
+  uint8_t axis;
+
+#if ACQ_INTERRUPT_DRIVEN
+  frame.putDelta32(packet.timestamp, previousPacket.timestamp);
+#endif
+  for (axis = 0; axis < 3; axis++) frame.putDelta16(packet.acc1[axis], previousPacket.acc1[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putDelta16(packet.acc2[axis], previousPacket.acc2[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putDelta16(packet.gyro[axis], previousPacket.gyro[axis]);
+
+  frame.putDelta16(packet.voltage, previousPacket.voltage);
+  frame.putDelta16(packet.current, previousPacket.current);
+  frame.putDelta32(packet.power, previousPacket.power);
+  frame.putDelta32(packet.energy, previousPacket.energy);
+#if ACQUISITION_MODE == ACQ_DMP
+  for (axis = 0; axis < 4; axis++) frame.putDelta16(packet.quaternion[axis], previousPacket.quaternion[axis]);
+  for (axis = 0; axis < 3; axis++) frame.putDelta16(packet.linearAccel[axis], previousPacket.linearAccel[axis]);
+#endif
+  previousPacket = packet;
+}
+#endif
+
+#ifdef CHANNEL_FRAMES
+/**
+ * Fill the frame with the channels due: the sample time, the channel mask,
+ * then the fields of each channel in the mask, in bit order
+ * @param channels Mask of SENSORFRAME_CHANNEL_* bits
+ */
+void packChannels(uint8_t channels) {
+  uint8_t axis;
+
+#if ACQ_INTERRUPT_DRIVEN
+  frame.putUInt32(packet.timestamp);
+#else
+  frame.putUInt32(micros());
+#endif
+  frame.putByte(channels);
+  if (channels & _BV(SENSORFRAME_CHANNEL_ACCEL_A)) {
+    for (axis = 0; axis < 3; axis++) frame.putInt16(packet.acc1[axis]);
+  }
+  if (channels & _BV(SENSORFRAME_CHANNEL_ACCEL_B)) {
+    for (axis = 0; axis < 3; axis++) frame.putInt16(packet.acc2[axis]);
+  }
+  if (channels & _BV(SENSORFRAME_CHANNEL_GYRO)) {
+    for (axis = 0; axis < 3; axis++) frame.putInt16(packet.gyro[axis]);
+  }
+  if (channels & _BV(SENSORFRAME_CHANNEL_POWER)) {
+    frame.putUInt16(packet.voltage);
+    frame.putUInt16(packet.current);
+    frame.putUInt32(packet.power);
+    frame.putUInt32(packet.energy);
+  }
+}
+#endif
+
 void powerSavings() {
   // Initializing all analog pins that are not used to output pins
   // Turning the useless analog pins to digital pins and setting them to LOW
@@ -310,6 +1614,9 @@ void powerSavings() {
   // Changing all the rest of the digital pins that are not used to OUTPUT LOW
   // This should save ~9mA
   for(i = 0; i <=16; i++) {
+#if ACQ_INTERRUPT_DRIVEN
+    if (i == DATA_READY_PIN) continue; //driven by the MPU6050
+#endif
     pinMode(i, OUTPUT);
     digitalWrite(i, LOW);
   }
@@ -328,9 +1635,15 @@ void powerSavings() {
 
 void setup()
 {
-  Wire.begin();        // join i2c bus (address optional for master)
+  // join i2c bus as master at I2C_CLOCK_KHZ
+  #if I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE
+    Wire.begin();
+    Wire.setClock(I2C_CLOCK_KHZ * 1000L);
+  #elif I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+    Fastwire::setup(I2C_CLOCK_KHZ, true);
+  #endif
   Serial.begin(115200);  // start serial for output
-  Serial1.begin(115200); //serial for gpio connection between Mega and Rpi
+  SerialTxQueue::begin(115200); //USART1 to the Rpi, interrupt driven instead of Serial1
   pinMode(LED_BUILTIN, OUTPUT);
 
   powerSavings();
@@ -345,10 +1658,45 @@ void setup()
   Serial.println(sensorA.testConnection() ? "Sensor A connected successfully" : "Sensor A failed to connect");
   Serial.println(sensorB.testConnection() ? "Sensor B connected successfully" : "Sensor B failed to connect");
   Serial.println(sensorC.testConnection() ? "Sensor C connected successfully" : "Sensor C failed to connect");
-  
-  // calibrateSensors();
+  setupSensors();
+#if ACQUISITION_MODE != ACQ_DMP
+  setupOffsets();
+#endif
+#ifdef ACTIVITY_GATING
+  setupActivity(sensorA);
+  setupActivity(sensorB);
+#endif
+  AdcSampler::begin(powerChannels, sizeof(powerChannels), ADC_TRIGGER);
+#ifdef TIMING_PROFILE
+  setupProfiler();
+#endif
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+  setupAccelFIFOs();
+#elif ACQUISITION_MODE == ACQ_DATA_READY
+  setupDataReady();
+#elif ACQUISITION_MODE == ACQ_DMP
+  setupDMP();
+  setupOffsets(); //dmpInitialize() resets the MPU6050, its offsets with it
+  sensorC.resetFIFO();
+#endif
+#ifdef FEATURE_FRAMES
+  featureStats.begin(FEATURE_CHANNELS, FEATURE_WINDOW, FEATURE_HOP);
+#endif
   handshake();
-  xTaskCreate(mainTask, "Main Task", STACK_SIZE, (void *)NULL, 2, NULL);
+#ifdef CHANNEL_FRAMES
+  setupChannels();
+#endif
+#ifdef ACTIVITY_GATING
+  stateStart = millis(); //the energy per hour counts from here
+#endif
+#if ACQUISITION_MODE == ACQ_ADXL_FIFO
+  xTaskCreate(fifoTask, "FIFO Task", STACK_SIZE, (void *)NULL, 2, NULL);
+#elif ACQ_INTERRUPT_DRIVEN
+  xTaskCreate(sessionTask(), "Main Task", STACK_SIZE, (void *)NULL, 2, &mainTaskHandle);
+  attachInterrupt(digitalPinToInterrupt(DATA_READY_PIN), dataReadyISR, RISING);
+#else
+  xTaskCreate(sessionTask(), "Main Task", STACK_SIZE, (void *)NULL, 2, NULL);
+#endif
 } 
 
 /** To check on the amount of free Ram avaliable in Mega */
@@ -360,7 +1708,12 @@ void setup()
 
 
 
+//Runs in the FreeRTOS idle task: sleep until the next interrupt (tick, UART, TWI)
 void loop()
 {  
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sleep_cpu();
+  sleep_disable();
 }
-
+
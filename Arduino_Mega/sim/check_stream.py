@@ -0,0 +1,109 @@
+#!/usr/bin/python3
+
+# Run a firmware simulation and check the byte stream it sent the Pi, decoded
+# with the Pi's own serial_frames.py: no bad or lost frames, enough samples,
+# the readings the trace holds, the sample rate the timestamps show and the
+# session the HELLO frames announce.
+#
+#     python3 check_stream.py [--samples N] [--rate HZ] [--acc1 X Y Z] [--voltage MV]
+#                             [--hello DIVIDER SAMPLES FRAMING] -- SIMULATION [OPTIONS]
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'Raspberry_Pi'))
+from serial_frames import *
+
+RATE_TOLERANCE = 0.01
+
+def read_stream(path):
+    '''Decode every frame: (reader, hellos, samples, frame_sizes), a sample being (timestamp or None, acc1,
+    voltage or None), frame_sizes the samples in each SAMPLES or TIMED_SAMPLES frame not delta coded'''
+    hellos, samples, frame_sizes = [], [], []
+    with open(path, 'rb') as port:
+        reader = FrameReader(port, resend=False)
+        while True:
+            frame = reader.read_frame()
+            if frame is None:
+                return reader, hellos, samples, frame_sizes
+            frame_type, seq, payload = frame
+            delta = bool(frame_type & TYPE_DELTA)
+            frame_type &= ~TYPE_DELTA
+            if frame_type == TYPE_HELLO:
+                hellos.append(decode_hello(payload))
+            elif frame_type in (TYPE_SAMPLES, TYPE_TIMED_SAMPLES):
+                if frame_type == TYPE_SAMPLES:
+                    decoded = [ (None, sample[0:3], sample[9]) for sample in decode_samples(payload, SAMPLE, delta) ]
+                else:
+                    decoded = [ (timestamp, sample[0:3], sample[9]) for timestamp, sample in decode_timed_samples(payload, delta) ]
+                samples += decoded
+                if not delta: # delta coded frames are closed early when full
+                    frame_sizes.append(len(decoded))
+            elif frame_type == TYPE_CHANNELS:
+                timestamp, channels = decode_channels(payload)
+                if CHANNEL_ACCEL_A in channels:
+                    power = channels.get(CHANNEL_POWER)
+                    samples.append((timestamp, channels[CHANNEL_ACCEL_A], power[0] if power else None))
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--samples', type=int, default=1, help='at least this many samples')
+    parser.add_argument('--rate', type=float, help='samples per second, from the timestamps, also what any HELLO frame says')
+    parser.add_argument('--acc1', type=int, nargs=3, help='every ADXL345 A reading')
+    parser.add_argument('--voltage', type=int, help='every voltage sent, mV')
+    parser.add_argument('--hello', type=int, nargs=3, help='a HELLO frame with this sample divider, samples per frame and framing')
+    parser.add_argument('simulation', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+    simulation = args.simulation[1:] if args.simulation[:1] == [ '--' ] else args.simulation
+
+    with tempfile.TemporaryDirectory() as directory:
+        stream = os.path.join(directory, 'serial1.bin')
+        run = subprocess.run(simulation + [ '--out', stream ], stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                             universal_newlines=True)
+        print(run.stdout)
+        if run.returncode != 0:
+            return 'simulation failed: ' + str(run.returncode)
+        reader, hellos, samples, frame_sizes = read_stream(stream)
+
+    errors = []
+    if reader.bad_frames or reader.lost_frames:
+        errors.append('%d bad and %d lost frames' % (reader.bad_frames, reader.lost_frames))
+    if len(samples) < args.samples:
+        errors.append('%d samples, expected at least %d' % (len(samples), args.samples))
+    if args.acc1 is not None:
+        wrong = [ acc1 for timestamp, acc1, voltage in samples if list(acc1) != args.acc1 ]
+        if wrong:
+            errors.append('%d acc1 readings not %s, e.g. %s' % (len(wrong), args.acc1, list(wrong[0])))
+    if args.voltage is not None:
+        voltages = [ voltage for timestamp, acc1, voltage in samples if voltage is not None ]
+        if not voltages or any(voltage != args.voltage for voltage in voltages):
+            errors.append('voltages %s, expected %d' % (sorted(set(voltages)), args.voltage))
+    if args.rate is not None:
+        timestamps = [ timestamp for timestamp, acc1, voltage in samples if timestamp is not None ]
+        if len(timestamps) < 2:
+            errors.append('no timestamps to measure the rate with')
+        else:
+            rate = 1e6 * (len(timestamps) - 1) / ((timestamps[-1] - timestamps[0]) & 0xFFFFFFFF)
+            print('%d samples at %.2f/s' % (len(samples), rate))
+            if abs(rate - args.rate) > args.rate * RATE_TOLERANCE:
+                errors.append('%.2f samples/s, expected %.2f' % (rate, args.rate))
+            # what the Pi works the rate out from
+            if hellos and abs(rate - sample_rate(hellos[-1])) > rate * RATE_TOLERANCE:
+                errors.append('%.2f samples/s, the HELLO frame says %.2f' % (rate, sample_rate(hellos[-1])))
+    if args.hello is not None:
+        sessions = [ [ hello.sample_divider, hello.frame_samples, hello.framing ] for hello in hellos ]
+        if args.hello not in sessions:
+            errors.append('HELLO sessions %s, expected %s' % (sessions, args.hello))
+        if any(hello.status != SESSION_ACCEPTED for hello in hellos):
+            errors.append('session refused')
+        if any(size != args.hello[1] for size in frame_sizes):
+            errors.append('frames of %s samples, expected %d' % (sorted(set(frame_sizes)), args.hello[1]))
+
+    print('%d frames, %d samples' % (reader.last_seq + 1 if reader.last_seq is not None else 0, len(samples)))
+    return '\n'.join(errors) if errors else None
+
+if __name__ == '__main__':
+    sys.exit(main())
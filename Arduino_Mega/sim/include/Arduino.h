@@ -0,0 +1,165 @@
+// Arduino core stub for the host simulation (see sim/CMakeLists.txt)
+//
+// Just enough of the AVR Arduino core for the sketches and libraries in this
+// tree to compile on Linux. Time is simulated: millis() and micros() read the
+// simulation clock, which only moves when the firmware waits (delay(), I2C
+// transfers, analogRead(), FreeRTOS delays), so every run is repeatable.
+
+#ifndef _SIM_ARDUINO_H_
+#define _SIM_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+#ifndef ARDUINO
+#define ARDUINO 10805
+#endif
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define LED_BUILTIN 13
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define A8 62
+#define A9 63
+#define A10 64
+#define A11 65
+#define A12 66
+#define A13 67
+#define A14 68
+#define A15 69
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define sq(x) ((x)*(x))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define bit(b) (1UL << (b))
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : ((p) >= 18 && (p) <= 21 ? 23 - (p) : -1)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+void interrupts();
+void noInterrupts();
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *sout);
+char *itoa(int value, char *string, int radix);
+char *ltoa(long value, char *string, int radix);
+char *utoa(unsigned int value, char *string, int radix);
+char *ultoa(unsigned long value, char *string, int radix);
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t value) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size);
+        size_t write(const char *str) { return str == NULL ? 0 : write((const uint8_t *)str, strlen(str)); }
+        size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+        size_t write(int value) { return write((uint8_t)value); }
+
+        size_t print(const __FlashStringHelper *str);
+        size_t print(const char *str);
+        size_t print(char c);
+        size_t print(unsigned char value, int base=DEC);
+        size_t print(int value, int base=DEC);
+        size_t print(unsigned int value, int base=DEC);
+        size_t print(long value, int base=DEC);
+        size_t print(unsigned long value, int base=DEC);
+        size_t print(long long value, int base=DEC);
+        size_t print(unsigned long long value, int base=DEC);
+        size_t print(double value, int digits=2);
+
+        size_t println();
+        template<typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+        template<typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+    private:
+        size_t printNumber(unsigned long long value, uint8_t base);
+};
+
+// USART stand-in: Serial goes to the simulation log, Serial1 to the captured
+// byte stream and reads what the Pi sends (--send)
+class HardwareSerial : public Print {
+    public:
+        HardwareSerial(uint8_t port) : port(port) {}
+        void begin(unsigned long baud);
+        void begin(unsigned long baud, uint8_t config) { (void)config; begin(baud); }
+        void end() {}
+        int available();
+        int peek();
+        int read();
+        int availableForWrite();
+        void flush();
+        virtual size_t write(uint8_t value);
+        virtual size_t write(const uint8_t *buffer, size_t size);
+        using Print::write;
+        operator bool() { return true; }
+
+    private:
+        uint8_t port;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+void setup();
+void loop();
+
+#endif /* _SIM_ARDUINO_H_ */
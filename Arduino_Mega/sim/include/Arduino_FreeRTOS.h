@@ -0,0 +1,37 @@
+// Arduino_FreeRTOS stub for the host simulation
+//
+// Tasks are coroutines run by a cooperative scheduler (sim/src/freertos.cpp):
+// the highest priority ready task runs until it blocks in vTaskDelay(),
+// vTaskDelayUntil() or ulTaskNotifyTake(). When no task is ready the clock
+// runs on to the next wake-up, firing the simulated interrupts on the way.
+// The tick is the Arduino_FreeRTOS watchdog tick, portTICK_PERIOD_MS.
+
+#ifndef _SIM_ARDUINO_FREERTOS_H_
+#define _SIM_ARDUINO_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef uint16_t TickType_t;
+typedef int8_t BaseType_t;
+typedef uint8_t UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define portTICK_PERIOD_MS 15
+#define portMAX_DELAY ((TickType_t)0xffff)
+#define pdMS_TO_TICKS(ms) ((TickType_t)((ms) / portTICK_PERIOD_MS))
+#define configMINIMAL_STACK_SIZE 192
+#define configMAX_PRIORITIES 4
+#define tskIDLE_PRIORITY 0
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+
+#define portYIELD_FROM_ISR(...) ((void)0) // the woken task runs once the running one blocks
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskYIELD() vTaskDelay(0)
+
+#endif /* _SIM_ARDUINO_FREERTOS_H_ */
@@ -0,0 +1,30 @@
+// EEPROM stub for the host simulation: 4kB like the ATmega2560, blank (0xFF)
+// at start, or loaded from and saved back to a file (--eeprom)
+
+#ifndef _SIM_EEPROM_H_
+#define _SIM_EEPROM_H_
+
+#include <Arduino.h>
+
+#define SIM_EEPROM_SIZE 4096
+
+class EEPROMClass {
+    public:
+        uint8_t read(int address);
+        void write(int address, uint8_t value);
+        void update(int address, uint8_t value);
+        uint16_t length() { return SIM_EEPROM_SIZE; }
+
+        template<typename T> T &get(int address, T &t) {
+            for (size_t n = 0; n < sizeof(T); n++) ((uint8_t *)&t)[n] = read(address + n);
+            return t;
+        }
+        template<typename T> const T &put(int address, const T &t) {
+            for (size_t n = 0; n < sizeof(T); n++) update(address + n, ((const uint8_t *)&t)[n]);
+            return t;
+        }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* _SIM_EEPROM_H_ */
@@ -0,0 +1,46 @@
+// Wire stub for the host simulation
+//
+// Transfers go to the simulated I2C devices (sim/src/wire.cpp): a register file per
+// device, with reads answered from the recorded traffic (--trace) where the
+// recording covers the register. Every byte costs its bus time at the clock
+// set with setClock().
+
+#ifndef _SIM_WIRE_H_
+#define _SIM_WIRE_H_
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire {
+    public:
+        void begin();
+        void end() {}
+        void setClock(uint32_t clock);
+
+        void beginTransmission(uint8_t address);
+        void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+        uint8_t endTransmission(uint8_t sendStop=true);
+
+        uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop=true);
+        uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t)address, (uint8_t)quantity); }
+        uint8_t requestFrom(int address, int quantity, int sendStop) { return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t)sendStop); }
+
+        size_t write(uint8_t data);
+        size_t write(const uint8_t *data, size_t quantity);
+        int available();
+        int read();
+        int peek();
+
+    private:
+        uint8_t txAddress;
+        uint8_t txBuffer[BUFFER_LENGTH];
+        uint8_t txLength;
+        uint8_t rxBuffer[BUFFER_LENGTH];
+        uint8_t rxIndex;
+        uint8_t rxLength;
+};
+
+extern TwoWire Wire;
+
+#endif /* _SIM_WIRE_H_ */
@@ -0,0 +1,14 @@
+// AVR interrupt stub for the host simulation: ISRs are plain functions the
+// simulated peripherals call when their event is due
+
+#ifndef _SIM_AVR_INTERRUPT_H_
+#define _SIM_AVR_INTERRUPT_H_
+
+#define ISR(vector, ...) extern "C" void vector(void)
+
+void interrupts();
+void noInterrupts();
+#define sei() interrupts()
+#define cli() noInterrupts()
+
+#endif /* _SIM_AVR_INTERRUPT_H_ */
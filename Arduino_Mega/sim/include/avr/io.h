@@ -0,0 +1,82 @@
+// ATmega2560 register stub for the host simulation
+//
+// Only the registers the firmware touches directly exist. The ones whose
+// writes start something on the real chip (USART1 transmit, the ADC) are
+// SimRegister objects, so the simulation sees every access.
+
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define __AVR_ATmega2560__ 1
+
+class SimRegister {
+    public:
+        typedef void (*WriteHook)(uint8_t value);
+        typedef uint8_t (*ReadHook)(uint8_t value);
+
+        SimRegister(WriteHook onWrite=0, ReadHook onRead=0) : value(0), onWrite(onWrite), onRead(onRead) {}
+
+        operator uint8_t() const;
+        SimRegister &operator=(uint8_t data);
+        SimRegister &operator|=(uint8_t data) { return *this = (uint8_t)(*this | data); }
+        SimRegister &operator&=(uint8_t data) { return *this = (uint8_t)(*this & data); }
+        SimRegister &operator^=(uint8_t data) { return *this = (uint8_t)(*this ^ data); }
+
+        uint8_t raw() const { return value; }
+        void set(uint8_t data) { value = data; }
+
+    private:
+        SimRegister(const SimRegister &);
+        uint8_t value;
+        WriteHook onWrite;
+        ReadHook onRead;
+};
+
+// USART1
+extern SimRegister UCSR1A, UCSR1B, UCSR1C, UBRR1H, UBRR1L, UDR1;
+#define RXC1 7
+#define TXC1 6
+#define UDRE1 5
+#define FE1 4
+#define DOR1 3
+#define UPE1 2
+#define U2X1 1
+#define MPCM1 0
+#define RXCIE1 7
+#define TXCIE1 6
+#define UDRIE1 5
+#define RXEN1 4
+#define TXEN1 3
+#define UCSZ12 2
+#define UCSZ11 2
+#define UCSZ10 1
+
+// ADC
+extern SimRegister ADMUX, ADCSRA, ADCSRB, DIDR0, DIDR2;
+extern volatile uint16_t ADC;
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define MUX4 4
+#define MUX3 3
+#define MUX2 2
+#define MUX1 1
+#define MUX0 0
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define ACME 6
+#define MUX5 3
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
+
+#endif /* _SIM_AVR_IO_H_ */
@@ -0,0 +1,25 @@
+// Power reduction stub for the host simulation, in place of Power_Libraries/power.h
+
+#ifndef _SIM_POWER_H_
+#define _SIM_POWER_H_
+
+#define power_adc_enable()
+#define power_adc_disable()
+#define power_spi_enable()
+#define power_spi_disable()
+#define power_twi_enable()
+#define power_twi_disable()
+#define power_usart0_disable()
+#define power_usart1_disable()
+#define power_usart2_disable()
+#define power_usart3_disable()
+#define power_timer0_disable()
+#define power_timer1_disable()
+#define power_timer2_disable()
+#define power_timer3_disable()
+#define power_timer4_disable()
+#define power_timer5_disable()
+#define power_all_disable()
+#define power_all_enable()
+
+#endif /* _SIM_POWER_H_ */
@@ -0,0 +1,20 @@
+// FreeRTOS task API stub for the host simulation, see Arduino_FreeRTOS.h
+
+#ifndef _SIM_TASK_H_
+#define _SIM_TASK_H_
+
+#include <Arduino_FreeRTOS.h>
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint16_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *createdTask);
+void vTaskStartScheduler();
+TickType_t xTaskGetTickCount();
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t timeIncrement);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken);
+void vTaskSuspendAll();
+BaseType_t xTaskResumeAll();
+
+#endif /* _SIM_TASK_H_ */
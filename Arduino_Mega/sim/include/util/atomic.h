@@ -0,0 +1,15 @@
+// AVR atomic block stub for the host simulation. Simulated interrupts only
+// fire while the clock moves, never inside a block, so it needs no locking
+
+#ifndef _SIM_UTIL_ATOMIC_H_
+#define _SIM_UTIL_ATOMIC_H_
+
+#include <stdint.h>
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define NONATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) for (uint8_t _sim_atomic = 1; _sim_atomic; _sim_atomic = 0)
+#define NONATOMIC_BLOCK(type) ATOMIC_BLOCK(type)
+
+#endif /* _SIM_UTIL_ATOMIC_H_ */
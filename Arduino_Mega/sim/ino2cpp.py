@@ -0,0 +1,38 @@
+#!/usr/bin/python3
+
+# Turn a sketch into C++ the way the Arduino IDE does: include Arduino.h and
+# declare every function before the first one is defined, so the sketch can
+# call functions defined further down.
+#
+#     python3 ino2cpp.py sketch.ino sketch.cpp
+
+import re
+import sys
+
+# a function definition on one line, its brace on that line or the next
+DEFINITION = re.compile(r'^([A-Za-z_][\w<>,\* ]*[ \*&]+([A-Za-z_]\w*)\([^;]*\))\s*(\{.*)?$')
+NOT_FUNCTIONS = ('if', 'for', 'while', 'switch', 'return', 'ISR')
+
+def convert(path):
+    lines = open(path).read().split('\n')
+    prototypes = []
+    first = None
+    for n, line in enumerate(lines):
+        match = DEFINITION.match(line)
+        if not match or match.group(2) in NOT_FUNCTIONS:
+            continue
+        following = lines[n + 1].strip() if n + 1 < len(lines) else ''
+        if match.group(3) is None and not following.startswith('{'):
+            continue
+        if first is None:
+            first = n
+        prototypes.append(match.group(1) + ';')
+    if first is None:
+        first = len(lines)
+    return '\n'.join([ '#include <Arduino.h>', '#line 1 "%s"' % path ] + lines[:first] + prototypes +
+                     [ '#line %d "%s"' % (first + 1, path) ] + lines[first:]) + '\n'
+
+if __name__ == '__main__':
+    source = convert(sys.argv[1])
+    with open(sys.argv[2], 'w') as output:
+        output.write(source)
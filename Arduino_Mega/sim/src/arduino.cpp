@@ -0,0 +1,269 @@
+// Arduino core functions of the host simulation: the clock, pins, Print and
+// the two serial ports the sketches use
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include "sim.h"
+
+#define ANALOG_READ_NS 112000 // 13 ADC clocks at F_CPU / 128, and the set-up around them
+#define SERIAL_POLL_NS 10000  // the loop polling a serial port with nothing received
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+
+static uint64_t now = 0;
+static bool inInterrupt = false;
+static uint32_t serial1Baud = 9600;
+
+uint64_t simNow() {
+    return now;
+}
+
+bool simInInterrupt() {
+    return inInterrupt;
+}
+
+/** Move the clock on to time, running the interrupts due on the way, and stop the run at simEndTime.
+ * @param time Clock to reach
+ * @param stop Checked after every interrupt, returns true to stop early (then the clock is at the interrupt), or NULL
+ */
+void simAdvanceTo(uint64_t time, bool (*stop)()) {
+    // interrupts stay off in an ISR, and the clock cannot move for it
+    if (inInterrupt) return;
+
+    uint64_t limit = time < simEndTime ? time : simEndTime;
+    uint64_t next;
+    while ((next = simNextEvent()) <= limit) {
+        if (next > now) now = next;
+        inInterrupt = true;
+        simRunEvents(now);
+        inInterrupt = false;
+        if (stop != NULL && stop()) return;
+    }
+    if (time >= simEndTime) {
+        now = simEndTime;
+        simFinish();
+    }
+    if (time > now) now = time;
+}
+
+void simAdvance(uint64_t ns) {
+    simAdvanceTo(now + ns, NULL);
+}
+
+unsigned long millis() {
+    return (unsigned long)(now / 1000000);
+}
+
+unsigned long micros() {
+    return (unsigned long)(now / 1000);
+}
+
+void delay(unsigned long ms) {
+    simAdvance((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    simAdvance((uint64_t)us * 1000);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    (void)pin;
+    (void)value;
+}
+
+int digitalRead(uint8_t pin) {
+    (void)pin;
+    return LOW;
+}
+
+int analogRead(uint8_t pin) {
+    simAdvance(ANALOG_READ_NS);
+    return simAdcLevel(pin >= A0 ? pin - A0 : pin);
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode) {
+    (void)mode;
+    simAttachInterrupt(interruptNum, userFunc);
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+    simAttachInterrupt(interruptNum, NULL);
+}
+
+void interrupts() {
+}
+
+void noInterrupts() {
+}
+
+// The clock runs on in the FreeRTOS idle loop, sleeping changes nothing here
+void set_sleep_mode(int mode) {
+    (void)mode;
+}
+
+void sleep_enable() {
+}
+
+void sleep_disable() {
+}
+
+void sleep_cpu() {
+}
+
+void sleep_mode() {
+}
+
+char *dtostrf(double val, signed char width, unsigned char prec, char *sout) {
+    sprintf(sout, "%*.*f", width, prec, val);
+    return sout;
+}
+
+static char *toString(unsigned long value, bool negative, char *string, int radix) {
+    char digits[34];
+    uint8_t length = 0;
+    char *out = string;
+
+    do {
+        uint8_t digit = value % radix;
+        digits[length++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= radix;
+    } while (value > 0);
+    if (negative) *out++ = '-';
+    while (length > 0) *out++ = digits[--length];
+    *out = '\0';
+    return string;
+}
+
+char *itoa(int value, char *string, int radix) {
+    return ltoa(value, string, radix);
+}
+
+char *ltoa(long value, char *string, int radix) {
+    if (radix == 10 && value < 0) return toString(-(unsigned long)value, true, string, radix);
+    return toString((unsigned long)value, false, string, radix);
+}
+
+char *utoa(unsigned int value, char *string, int radix) {
+    return toString(value, false, string, radix);
+}
+
+char *ultoa(unsigned long value, char *string, int radix) {
+    return toString(value, false, string, radix);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+}
+
+size_t Print::print(const __FlashStringHelper *str) {
+    return print(reinterpret_cast<const char *>(str));
+}
+
+size_t Print::print(const char *str) {
+    return write(str);
+}
+
+size_t Print::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base) {
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(int value, int base) {
+    return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+    return print((unsigned long)value, base);
+}
+
+size_t Print::print(long value, int base) {
+    return print((long long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+    return print((unsigned long long)value, base);
+}
+
+size_t Print::print(long long value, int base) {
+    if (base == 0) return write((uint8_t)value);
+    if (base == 10 && value < 0) return print('-') + printNumber(-(unsigned long long)value, 10);
+    return printNumber(value, base);
+}
+
+size_t Print::print(unsigned long long value, int base) {
+    if (base == 0) return write((uint8_t)value);
+    return printNumber(value, base);
+}
+
+size_t Print::print(double value, int digits) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return write(buffer);
+}
+
+size_t Print::println() {
+    return write("\r\n");
+}
+
+size_t Print::printNumber(unsigned long long value, uint8_t base) {
+    char buffer[66];
+    char *digit = &buffer[sizeof(buffer) - 1];
+
+    if (base < 2) base = 10;
+    *digit = '\0';
+    do {
+        char c = value % base;
+        *--digit = c < 10 ? c + '0' : c + 'A' - 10;
+        value /= base;
+    } while (value > 0);
+    return write(digit);
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    if (port == 1) serial1Baud = baud;
+}
+
+int HardwareSerial::available() {
+    if (port != 1) return 0;
+    if (simSerial1Available(now)) return 1;
+    simAdvance(SERIAL_POLL_NS);
+    return 0;
+}
+
+int HardwareSerial::peek() {
+    return -1;
+}
+
+int HardwareSerial::read() {
+    return port == 1 ? simSerial1Read(now) : -1;
+}
+
+int HardwareSerial::availableForWrite() {
+    return 63;
+}
+
+void HardwareSerial::flush() {
+    if (port != 1) fflush(simSerialLog);
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+    if (port == 1) simSerial1Write(value, serial1Baud);
+    else fputc(value, simSerialLog);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    for (size_t n = 0; n < size; n++) write(buffer[n]);
+    return size;
+}
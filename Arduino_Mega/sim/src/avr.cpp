@@ -0,0 +1,247 @@
+// ATmega2560 peripherals of the host simulation: USART1 with what the Pi
+// sends, the ADC and the data-ready line of the MPU6050 on INT0
+//
+// Each peripheral says when its next interrupt is due (simNextEvent()) and the
+// clock runs them in time order (simRunEvents()). The ISRs are the firmware's
+// own, found by their vector names; a sketch without one never enables it.
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include "sim.h"
+
+extern "C" void USART1_UDRE_vect(void) __attribute__((weak));
+extern "C" void USART1_RX_vect(void) __attribute__((weak));
+extern "C" void ADC_vect(void) __attribute__((weak));
+
+#define RX_QUEUE_SIZE 4096
+#define SERIAL_TX_BUFFER 64       // HardwareSerial transmit ring, write() waits once it is full
+#define ADC_CONVERSION_NS 104000  // 13 ADC clocks at F_CPU / 128
+#define TIMER0_OVERFLOW_NS 1024000 // 256 counts at F_CPU / 64, the millis() timer
+#define EXTERNAL_INTERRUPTS 6
+
+#define MPU6050_ADDRESS 0x68
+#define MPU6050_SMPLRT_DIV 0x19
+#define MPU6050_CONFIG 0x1A
+#define MPU6050_INT_ENABLE 0x38
+#define MPU6050_PWR_MGMT_1 0x6B
+
+static void writeUDR1(uint8_t value);
+static uint8_t readUDR1(uint8_t value);
+static uint8_t readUCSR1A(uint8_t value);
+static void writeADCSRA(uint8_t value);
+
+SimRegister UCSR1A(NULL, readUCSR1A), UCSR1B, UCSR1C, UBRR1H, UBRR1L, UDR1(writeUDR1, readUDR1);
+SimRegister ADMUX, ADCSRA(writeADCSRA), ADCSRB, DIDR0, DIDR2;
+volatile uint16_t ADC = 0;
+
+SimRegister::operator uint8_t() const {
+    return onRead != NULL ? onRead(value) : value;
+}
+
+SimRegister &SimRegister::operator=(uint8_t data) {
+    value = data;
+    if (onWrite != NULL) onWrite(data);
+    return *this;
+}
+
+// What the Pi sends, in time order
+typedef struct Received {
+    uint64_t time;
+    uint8_t data;
+} Received;
+
+static Received rxQueue[RX_QUEUE_SIZE];
+static uint16_t rxCount = 0;
+static uint16_t rxNext = 0;
+static uint8_t rxData = 0;        // byte in UDR1
+
+static uint64_t txFreeAt = 0;     // the transmitter takes the next byte
+static uint32_t bytesSent = 0;
+
+static bool adcFlag = false;      // ADIF
+static uint64_t adcDoneAt = SIM_NEVER;
+static uint8_t adcChannel = 0;    // latched when the conversion started
+static uint16_t adcLevels[16];
+
+static void (*externalInterrupts[EXTERNAL_INTERRUPTS])(void);
+static uint64_t nextDataReady = SIM_NEVER;
+
+/** Queue bytes from the Pi, received at time (all at once, the ring takes SERIALTXQUEUE_RX_SIZE)
+ */
+void simSend(uint64_t time, const uint8_t *data, uint16_t length) {
+    for (uint16_t n = 0; n < length && rxCount < RX_QUEUE_SIZE; n++) {
+        uint16_t slot = rxCount++;
+        while (slot > rxNext && rxQueue[slot - 1].time > time) {
+            rxQueue[slot] = rxQueue[slot - 1];
+            slot--;
+        }
+        rxQueue[slot].time = time;
+        rxQueue[slot].data = data[n];
+    }
+}
+
+bool simSerial1Available(uint64_t time) {
+    return rxNext < rxCount && rxQueue[rxNext].time <= time;
+}
+
+int simSerial1Read(uint64_t time) {
+    return simSerial1Available(time) ? rxQueue[rxNext++].data : -1;
+}
+
+uint32_t simBytesSent() {
+    return bytesSent;
+}
+
+static uint64_t byteTime(uint16_t ubrr, uint8_t divisor) {
+    return 10ULL * divisor * (ubrr + 1) * 1000000000ULL / F_CPU; // 8N1
+}
+
+static void transmit(uint8_t data, uint64_t ns) {
+    uint64_t now = simNow();
+
+    txFreeAt = (txFreeAt > now ? txFreeAt : now) + ns;
+    fputc(data, simSerial1Out);
+    bytesSent++;
+}
+
+/** HardwareSerial Serial1 output: the Arduino core's UBRR for baud, U2X on
+ */
+void simSerial1Write(uint8_t data, uint32_t baud) {
+    uint64_t ns = byteTime((F_CPU / 4 / baud - 1) / 2, 8);
+
+    if (txFreeAt > simNow() + SERIAL_TX_BUFFER * ns) simAdvanceTo(txFreeAt - SERIAL_TX_BUFFER * ns, NULL);
+    transmit(data, ns);
+}
+
+static void writeUDR1(uint8_t value) {
+    if (!(UCSR1B.raw() & _BV(TXEN1))) return;
+    transmit(value, byteTime((UBRR1H.raw() << 8) | UBRR1L.raw(), UCSR1A.raw() & _BV(U2X1) ? 8 : 16));
+}
+
+static uint8_t readUDR1(uint8_t value) {
+    (void)value;
+    return rxData;
+}
+
+static uint8_t readUCSR1A(uint8_t value) {
+    value &= _BV(U2X1) | _BV(MPCM1);
+    if (txFreeAt <= simNow()) value |= _BV(UDRE1);
+    return value;
+}
+
+static uint8_t adcMux() {
+    return (ADMUX.raw() & 0x07) | (ADCSRB.raw() & _BV(MUX5) ? 8 : 0);
+}
+
+static uint8_t adcTrigger() {
+    return ADCSRB.raw() & (_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0));
+}
+
+static void adcStart() {
+    adcChannel = adcMux();
+    adcDoneAt = simNow() + ADC_CONVERSION_NS;
+}
+
+static void adcStatus() {
+    uint8_t value = ADCSRA.raw() & ~(_BV(ADSC) | _BV(ADIF));
+
+    if (adcDoneAt != SIM_NEVER) value |= _BV(ADSC);
+    if (adcFlag) value |= _BV(ADIF);
+    ADCSRA.set(value);
+}
+
+// ADIF clears on a written one. A conversion in progress is dropped when auto triggering
+// stops, so a loop waiting on ADSC does not spin on a clock that only it could move
+static void writeADCSRA(uint8_t value) {
+    if (value & _BV(ADIF)) adcFlag = false;
+    if (!(value & _BV(ADEN)) || !(value & _BV(ADATE))) adcDoneAt = SIM_NEVER;
+    if ((value & _BV(ADEN)) && (value & _BV(ADSC)) && adcDoneAt == SIM_NEVER) adcStart();
+    adcStatus();
+}
+
+void simSetAdcLevel(uint8_t channel, uint16_t level) {
+    if (channel < 16) adcLevels[channel] = level;
+}
+
+uint16_t simAdcLevel(uint8_t channel) {
+    return channel < 16 ? adcLevels[channel] : 0;
+}
+
+static bool adcTimer0() {
+    const uint8_t enabled = _BV(ADEN) | _BV(ADATE);
+    return (ADCSRA.raw() & enabled) == enabled && adcTrigger() == _BV(ADTS2);
+}
+
+static void adcDone() {
+    uint8_t value = ADCSRA.raw();
+
+    ADC = adcLevels[adcChannel];
+    adcDoneAt = SIM_NEVER;
+    if ((value & _BV(ADATE)) && adcTrigger() == 0) adcStart(); // free running, on the channel selected now
+    adcFlag = true;
+    adcStatus();
+    if ((value & _BV(ADIE)) && ADC_vect != NULL) {
+        adcFlag = false;
+        adcStatus();
+        ADC_vect();
+    }
+}
+
+void simAttachInterrupt(uint8_t interruptNum, void (*userFunc)(void)) {
+    if (interruptNum < EXTERNAL_INTERRUPTS) externalInterrupts[interruptNum] = userFunc;
+}
+
+// MPU6050 data-ready pulses on INT0: one per sample at 1kHz (8kHz with the DLPF off) / (1 + SMPLRT_DIV)
+static uint64_t dataReadyPeriod() {
+    if (externalInterrupts[0] == NULL) return 0;
+    if (!(simI2cRegister(MPU6050_ADDRESS, MPU6050_INT_ENABLE) & 0x01)) return 0;
+    if (simI2cRegister(MPU6050_ADDRESS, MPU6050_PWR_MGMT_1) & 0x40) return 0; // asleep
+    uint8_t dlpf = simI2cRegister(MPU6050_ADDRESS, MPU6050_CONFIG) & 0x07;
+    uint64_t base = dlpf == 0 || dlpf == 7 ? 125000 : 1000000;
+    return base * (1 + simI2cRegister(MPU6050_ADDRESS, MPU6050_SMPLRT_DIV));
+}
+
+uint64_t simNextEvent() {
+    uint64_t next = SIM_NEVER;
+    uint64_t now = simNow();
+    uint8_t control = UCSR1B.raw();
+
+    if ((control & _BV(RXEN1)) && (control & _BV(RXCIE1)) && USART1_RX_vect != NULL && rxNext < rxCount) {
+        next = rxQueue[rxNext].time;
+    }
+    if ((control & _BV(TXEN1)) && (control & _BV(UDRIE1)) && USART1_UDRE_vect != NULL && txFreeAt < next) {
+        next = txFreeAt;
+    }
+    if (adcDoneAt < next) next = adcDoneAt;
+    if (adcTimer0() && adcDoneAt == SIM_NEVER) {
+        uint64_t overflow = (now / TIMER0_OVERFLOW_NS + 1) * TIMER0_OVERFLOW_NS;
+        if (overflow < next) next = overflow;
+    }
+
+    uint64_t period = dataReadyPeriod();
+    if (period == 0) nextDataReady = SIM_NEVER;
+    else if (nextDataReady == SIM_NEVER) nextDataReady = now + period;
+    if (nextDataReady < next) next = nextDataReady;
+    return next;
+}
+
+void simRunEvents(uint64_t time) {
+    uint8_t control = UCSR1B.raw();
+
+    if ((control & _BV(RXEN1)) && (control & _BV(RXCIE1)) && USART1_RX_vect != NULL) {
+        while (simSerial1Available(time)) {
+            rxData = rxQueue[rxNext++].data;
+            USART1_RX_vect();
+        }
+    }
+    control = UCSR1B.raw();
+    if ((control & _BV(TXEN1)) && (control & _BV(UDRIE1)) && USART1_UDRE_vect != NULL && txFreeAt <= time) {
+        USART1_UDRE_vect();
+    }
+    if (adcDoneAt <= time) adcDone();
+    else if (adcTimer0() && adcDoneAt == SIM_NEVER && time % TIMER0_OVERFLOW_NS == 0) adcStart();
+    if (nextDataReady <= time) {
+        nextDataReady += dataReadyPeriod();
+        if (externalInterrupts[0] != NULL) externalInterrupts[0]();
+    }
+}
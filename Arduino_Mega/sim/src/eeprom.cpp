@@ -0,0 +1,51 @@
+// EEPROM of the host simulation, see EEPROM.h
+
+#include <EEPROM.h>
+#include "sim.h"
+
+EEPROMClass EEPROM;
+
+static uint8_t cells[SIM_EEPROM_SIZE];
+static bool blank = false;
+
+static void setupCells() {
+    if (blank) return;
+    blank = true;
+    memset(cells, 0xFF, sizeof(cells));
+}
+
+uint8_t EEPROMClass::read(int address) {
+    setupCells();
+    return address >= 0 && address < SIM_EEPROM_SIZE ? cells[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+    setupCells();
+    if (address >= 0 && address < SIM_EEPROM_SIZE) cells[address] = value;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+    write(address, value);
+}
+
+/** Start from the contents saved by an earlier run, if there is one
+ * @return False if the file exists but cannot be read
+ */
+bool simLoadEeprom(const char *path) {
+    FILE *file = fopen(path, "rb");
+
+    setupCells();
+    if (file == NULL) return true;
+    bool ok = fread(cells, 1, sizeof(cells), file) == sizeof(cells);
+    fclose(file);
+    return ok;
+}
+
+bool simSaveEeprom(const char *path) {
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL) return false;
+    setupCells();
+    bool ok = fwrite(cells, 1, sizeof(cells), file) == sizeof(cells);
+    return fclose(file) == 0 && ok;
+}
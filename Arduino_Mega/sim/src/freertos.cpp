@@ -0,0 +1,178 @@
+// FreeRTOS of the host simulation: tasks are coroutines (ucontext) switched
+// cooperatively. The highest priority ready task runs, equal priorities in
+// turn, until it blocks; with none ready the idle loop calls loop() and the
+// clock runs on to the next wake-up, or to a notification from an ISR.
+// A task is not preempted while it runs, which only shifts when a task
+// woken by an ISR gets to run by the time the running one takes to block.
+
+#include <Arduino.h>
+#include <Arduino_FreeRTOS.h>
+#include <task.h>
+#include <ucontext.h>
+#include "sim.h"
+
+#define MAX_TASKS 8
+#define TASK_STACK_BYTES (256 * 1024) // host code needs far more than the AVR stack depth given
+#define TICK_NS (portTICK_PERIOD_MS * 1000000ULL)
+
+typedef struct Task {
+    ucontext_t context;
+    TaskFunction_t code;
+    void *parameters;
+    const char *name;
+    UBaseType_t priority;
+    uint64_t wakeAt;       // blocked until then, SIM_NEVER for good, 0 when ready
+    bool waitingNotify;
+    uint32_t notifyValue;
+    bool deleted;
+} Task;
+
+static Task tasks[MAX_TASKS];
+static uint8_t taskCount = 0;
+static Task *current = NULL;
+static ucontext_t schedulerContext;
+static bool notified = false;   // an ISR readied a waiting task
+
+static uint64_t ticks() {
+    return simNow() / TICK_NS;
+}
+
+static void taskEntry(int index) {
+    Task *task = &tasks[index];
+    task->code(task->parameters);
+    task->deleted = true; // a FreeRTOS task must not return, treat it as deleted
+    swapcontext(&task->context, &schedulerContext);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint16_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *createdTask) {
+    (void)stackDepth;
+    if (taskCount >= MAX_TASKS) return pdFAIL;
+
+    Task *task = &tasks[taskCount];
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = malloc(TASK_STACK_BYTES);
+    task->context.uc_stack.ss_size = TASK_STACK_BYTES;
+    task->context.uc_link = &schedulerContext;
+    makecontext(&task->context, (void (*)())taskEntry, 1, (int)taskCount);
+    task->code = code;
+    task->parameters = parameters;
+    task->name = name;
+    task->priority = priority;
+    task->wakeAt = 0;
+    task->waitingNotify = false;
+    task->notifyValue = 0;
+    task->deleted = false;
+    taskCount++;
+    if (createdTask != NULL) *createdTask = task;
+    return pdPASS;
+}
+
+static bool isReady(const Task *task) {
+    if (task->deleted) return false;
+    if (task->waitingNotify && task->notifyValue > 0) return true;
+    return task->wakeAt <= simNow();
+}
+
+static bool anyNotified() {
+    return notified;
+}
+
+/** Switch back to the scheduler until the task is ready again, at wakeAt or when notified
+ */
+static void block(uint64_t wakeAt) {
+    if (current == NULL) {
+        // before the scheduler runs, e.g. in setup(): just let the time pass
+        if (wakeAt != SIM_NEVER) simAdvanceTo(wakeAt, NULL);
+        return;
+    }
+    current->wakeAt = wakeAt;
+    swapcontext(&current->context, &schedulerContext);
+}
+
+void vTaskStartScheduler() {
+    static uint8_t turn = 0;
+
+    for (;;) {
+        Task *next = NULL;
+        for (uint8_t n = 0; n < taskCount; n++) {
+            Task *task = &tasks[(turn + n) % taskCount];
+            if (isReady(task) && (next == NULL || task->priority > next->priority)) next = task;
+        }
+        if (next != NULL) {
+            turn = (next - tasks + 1) % taskCount; // equal priorities take turns
+            next->wakeAt = 0;
+            current = next;
+            swapcontext(&schedulerContext, &next->context);
+            current = NULL;
+            continue;
+        }
+
+        loop();
+        uint64_t wake = SIM_NEVER;
+        for (uint8_t n = 0; n < taskCount; n++) {
+            if (!tasks[n].deleted && tasks[n].wakeAt < wake) wake = tasks[n].wakeAt;
+        }
+        notified = false;
+        simAdvanceTo(wake, anyNotified);
+    }
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)ticks();
+}
+
+void vTaskDelay(TickType_t ticksToDelay) {
+    block((ticks() + ticksToDelay) * TICK_NS);
+}
+
+// Same wrap handling as FreeRTOS: no wait if the wake time has already passed
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t timeIncrement) {
+    const TickType_t now = (TickType_t)ticks();
+    const TickType_t wake = *previousWakeTime + timeIncrement;
+    bool wait;
+
+    if (now < *previousWakeTime) wait = wake < *previousWakeTime && wake > now;
+    else wait = wake < *previousWakeTime || wake > now;
+    *previousWakeTime = wake;
+    if (wait) block((ticks() + (TickType_t)(wake - now)) * TICK_NS);
+    else block(0); // FreeRTOS yields here too
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    Task *task = current;
+    uint32_t value;
+
+    if (task == NULL) return 0;
+    if (task->notifyValue == 0 && ticksToWait > 0) {
+        task->waitingNotify = true;
+        block(ticksToWait == portMAX_DELAY ? SIM_NEVER : (ticks() + ticksToWait) * TICK_NS);
+        task->waitingNotify = false;
+    }
+    value = task->notifyValue;
+    if (value > 0) task->notifyValue = clearCountOnExit ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+    Task *task = (Task *)handle;
+
+    task->notifyValue++;
+    if (task->waitingNotify) notified = true;
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t *higherPriorityTaskWoken) {
+    Task *task = (Task *)handle;
+    bool wasWaiting = task->waitingNotify;
+
+    xTaskNotifyGive(handle);
+    if (higherPriorityTaskWoken != NULL && wasWaiting) *higherPriorityTaskWoken = pdTRUE;
+}
+
+void vTaskSuspendAll() {
+}
+
+BaseType_t xTaskResumeAll() {
+    return pdFALSE;
+}
@@ -0,0 +1,127 @@
+// Host simulation entry point: setup(), then the FreeRTOS scheduler, for
+// --duration milliseconds of simulated time
+//
+//     mega_sim [--duration MS] [--trace FILE] [--send MS:BYTES]... [--out FILE]
+//              [--log FILE] [--i2c-log FILE] [--eeprom FILE] [--wall-timeout S]
+//
+// --send queues bytes from the Pi at MS, with C escapes (\xAA, \n, \\); the
+// handshake is "--send 0:HN". The byte stream the Mega sends on USART1 goes to
+// --out (serial1.bin), the Serial console to --log (standard output).
+
+#include <Arduino.h>
+#include <task.h>
+#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+#include "sim.h"
+
+FILE *simSerial1Out = NULL;
+FILE *simSerialLog = NULL;
+FILE *simI2cLog = NULL;
+uint64_t simEndTime = 2000 * 1000000ULL;
+
+static const char *eepromPath = NULL;
+
+void simFinish() {
+    fflush(simSerialLog);
+    fflush(simSerial1Out);
+    if (simI2cLog != NULL) fflush(simI2cLog);
+    if (eepromPath != NULL && !simSaveEeprom(eepromPath)) {
+        fprintf(stderr, "%s: cannot save EEPROM\n", eepromPath);
+        _exit(1);
+    }
+    fprintf(stderr, "simulated %lu ms, %lu bytes sent to the Pi\n",
+            (unsigned long)(simNow() / 1000000), (unsigned long)simBytesSent());
+    _exit(0);
+}
+
+static void wallTimeout(int signal) {
+    (void)signal;
+    static const char message[] = "wall clock timeout: the firmware is spinning without waiting\n";
+    if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0) _exit(3);
+    _exit(2);
+}
+
+static uint16_t unescape(const char *text, uint8_t *data) {
+    uint16_t length = 0;
+
+    while (*text != '\0') {
+        if (text[0] == '\\' && text[1] == 'x' && isxdigit(text[2]) && isxdigit(text[3])) {
+            char hex[3] = { text[2], text[3], '\0' };
+            data[length++] = strtoul(hex, NULL, 16);
+            text += 4;
+        } else if (text[0] == '\\' && text[1] != '\0') {
+            data[length++] = text[1] == 'n' ? '\n' : text[1] == 'r' ? '\r' : text[1];
+            text += 2;
+        } else {
+            data[length++] = *text++;
+        }
+    }
+    return length;
+}
+
+static FILE *openOutput(const char *path, const char *mode) {
+    FILE *file = fopen(path, mode);
+    if (file == NULL) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        exit(1);
+    }
+    return file;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--duration MS] [--trace FILE] [--send MS:BYTES]... [--out FILE] [--log FILE]\n"
+                    "       [--i2c-log FILE] [--eeprom FILE] [--wall-timeout S]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *outPath = "serial1.bin";
+    unsigned wallSeconds = 60;
+
+    simSerialLog = stdout;
+    for (int n = 1; n < argc; n++) {
+        const char *option = argv[n];
+        if (n + 1 >= argc) usage(argv[0]);
+        const char *value = argv[++n];
+
+        if (strcmp(option, "--duration") == 0) {
+            simEndTime = strtoull(value, NULL, 10) * 1000000ULL;
+        } else if (strcmp(option, "--trace") == 0) {
+            if (!simLoadTrace(value)) {
+                fprintf(stderr, "%s: cannot load trace\n", value);
+                return 1;
+            }
+        } else if (strcmp(option, "--send") == 0) {
+            char *text;
+            uint64_t time = strtoull(value, &text, 10) * 1000000ULL;
+            uint8_t data[256];
+            if (*text != ':' || strlen(text + 1) >= sizeof(data)) usage(argv[0]);
+            simSend(time, data, unescape(text + 1, data));
+        } else if (strcmp(option, "--out") == 0) {
+            outPath = value;
+        } else if (strcmp(option, "--log") == 0) {
+            simSerialLog = openOutput(value, "w");
+        } else if (strcmp(option, "--i2c-log") == 0) {
+            simI2cLog = openOutput(value, "w");
+        } else if (strcmp(option, "--eeprom") == 0) {
+            eepromPath = value;
+            if (!simLoadEeprom(value)) {
+                fprintf(stderr, "%s: cannot load EEPROM\n", value);
+                return 1;
+            }
+        } else if (strcmp(option, "--wall-timeout") == 0) {
+            wallSeconds = strtoul(value, NULL, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    simSerial1Out = openOutput(outPath, "wb");
+
+    signal(SIGALRM, wallTimeout);
+    alarm(wallSeconds);
+
+    setup();
+    vTaskStartScheduler(); // only returns at simEndTime, through simFinish()
+    return 0;
+}
@@ -0,0 +1,48 @@
+// Internals shared by the host simulation sources, not for the sketches
+//
+// One simulated clock in nanoseconds drives everything. It only moves when
+// the firmware waits (simAdvance()); the peripherals' interrupts come due on
+// the way and run in time order, so a run depends on nothing but its inputs.
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_NEVER UINT64_MAX
+
+// main.cpp: options and the end of the run
+extern FILE *simSerial1Out;   // USART1 byte stream, what the Pi would receive
+extern FILE *simSerialLog;    // Serial, the debug console
+extern FILE *simI2cLog;       // I2C traffic as trace lines, or NULL
+extern uint64_t simEndTime;   // clock at which the run stops
+void simFinish();
+
+// arduino.cpp: the clock
+uint64_t simNow();
+void simAdvance(uint64_t ns);
+void simAdvanceTo(uint64_t time, bool (*stop)());
+bool simInInterrupt();
+
+// avr.cpp: USART1, ADC and INT0, and what the Pi sends
+void simSend(uint64_t time, const uint8_t *data, uint16_t length);
+uint64_t simNextEvent();
+void simRunEvents(uint64_t time);
+bool simSerial1Available(uint64_t time);
+int simSerial1Read(uint64_t time);
+void simSerial1Write(uint8_t data, uint32_t baud);
+void simAttachInterrupt(uint8_t interruptNum, void (*userFunc)(void));
+void simSetAdcLevel(uint8_t channel, uint16_t level);
+uint16_t simAdcLevel(uint8_t channel);
+uint32_t simBytesSent();
+
+// wire.cpp: the I2C devices
+bool simLoadTrace(const char *path);
+uint8_t simI2cRegister(uint8_t address, uint8_t reg);
+
+// eeprom.cpp
+bool simLoadEeprom(const char *path);
+bool simSaveEeprom(const char *path);
+
+#endif /* _SIM_H_ */
@@ -0,0 +1,296 @@
+// I2C devices of the host simulation: the two ADXL345 and the MPU6050
+//
+// Each device is a register file with a register pointer, as on the bus.
+// Reads of a register the trace (--trace) recorded take the next recorded
+// reading, cycling through them, and leave it in the register file; the other
+// registers read back what was written, or the part's reset value. Readings
+// are taken as the sensor's own output: the offset registers are added on top
+// the way the parts do, so calibration converges here as on the bench.
+//
+// Trace lines, hex numbers:
+//     read <address> <register> <byte> ...   one burst read, as the firmware saw it
+//     write <address> <register> <byte> ...  ignored on replay, --i2c-log writes them
+//     adc <channel> <level>                  ADC counts of an analog input (decimal)
+
+#include <Wire.h>
+#include "sim.h"
+
+#define DEVICES 128
+#define REGISTERS 256
+#define TRACE_MAX_BYTES 32
+#define I2C_BYTE_BITS 9 // eight data bits and the acknowledge
+
+#define ADXL345_DEVID 0x00
+#define ADXL345_OFSX 0x1E
+#define ADXL345_DATA_FORMAT 0x31
+#define ADXL345_DATAX0 0x32
+#define MPU6050_XA_OFFS_H 0x06
+#define MPU6050_XG_OFFS_USRH 0x13
+#define MPU6050_GYRO_CONFIG 0x1B
+#define MPU6050_ACCEL_CONFIG 0x1C
+#define MPU6050_ACCEL_XOUT_H 0x3B
+#define MPU6050_GYRO_XOUT_H 0x43
+#define MPU6050_PWR_MGMT_1 0x6B
+#define MPU6050_WHO_AM_I 0x75
+
+TwoWire Wire;
+
+typedef enum DeviceKind { DEVICE_NONE, DEVICE_ADXL345, DEVICE_MPU6050 } DeviceKind;
+
+typedef struct TraceRead {
+    uint8_t address;
+    uint8_t reg;
+    uint8_t length;
+    uint8_t data[TRACE_MAX_BYTES];
+    int32_t next;          // next read of the same register, cycling
+} TraceRead;
+
+static uint8_t registers[DEVICES][REGISTERS];
+static uint8_t pointers[DEVICES];
+static DeviceKind kinds[DEVICES];
+static TraceRead *trace = NULL;
+static int32_t traceLength = 0;
+static int32_t *traceCursor = NULL; // per address and register, last read taken, -1 for none
+static uint32_t clockHz = 100000;
+
+static void resetDevice(uint8_t address) {
+    memset(registers[address], 0, REGISTERS);
+    pointers[address] = 0;
+    if (kinds[address] == DEVICE_ADXL345) {
+        registers[address][ADXL345_DEVID] = 0xE5;
+        registers[address][0x2C] = 0x0A; // BW_RATE, 100Hz
+        registers[address][0x30] = 0x02; // INT_SOURCE, watermark
+    } else if (kinds[address] == DEVICE_MPU6050) {
+        registers[address][MPU6050_PWR_MGMT_1] = 0x40; // asleep
+        registers[address][MPU6050_WHO_AM_I] = address & 0x7E;
+    }
+}
+
+static void setupDevices() {
+    static bool done = false;
+    if (done) return;
+    done = true;
+    kinds[0x53] = kinds[0x1D] = DEVICE_ADXL345;
+    kinds[0x68] = DEVICE_MPU6050;
+    for (uint16_t address = 0; address < DEVICES; address++) resetDevice(address);
+}
+
+static int16_t getInt16(const uint8_t *data, bool bigEndian) {
+    return bigEndian ? (int16_t)((data[0] << 8) | data[1]) : (int16_t)((data[1] << 8) | data[0]);
+}
+
+static void putInt16(uint8_t *data, int32_t value, bool bigEndian) {
+    int16_t clamped = value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+    data[bigEndian ? 0 : 1] = (uint16_t)clamped >> 8;
+    data[bigEndian ? 1 : 0] = clamped & 0xFF;
+}
+
+// Add offset register * counts per offset step (in 1/16 counts) to three data registers
+static void addOffsets(uint8_t *view, uint8_t data, const int16_t *offsets, uint8_t countsPerStepQ4, bool bigEndian) {
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        uint8_t *value = &view[data + 2 * axis];
+        putInt16(value, getInt16(value, bigEndian) + (int32_t)offsets[axis] * countsPerStepQ4 / 16, bigEndian);
+    }
+}
+
+/** Registers as a read sees them: the register file with the offset registers applied
+ */
+static void readView(uint8_t address, uint8_t *view) {
+    const uint8_t *file = registers[address];
+    int16_t offsets[3];
+
+    memcpy(view, file, REGISTERS);
+    if (kinds[address] == DEVICE_ADXL345) {
+        // 15.6mg steps: 4 counts at +-2g, halved for every range step
+        for (uint8_t axis = 0; axis < 3; axis++) offsets[axis] = (int8_t)file[ADXL345_OFSX + axis];
+        addOffsets(view, ADXL345_DATAX0, offsets, 64 >> (file[ADXL345_DATA_FORMAT] & 0x03), false);
+    } else if (kinds[address] == DEVICE_MPU6050) {
+        // 1/2048g and 1/32.8deg/s steps: 8 and 4 counts at the smallest ranges
+        for (uint8_t axis = 0; axis < 3; axis++) offsets[axis] = getInt16(&file[MPU6050_XA_OFFS_H + 2 * axis], true);
+        addOffsets(view, MPU6050_ACCEL_XOUT_H, offsets, 128 >> ((file[MPU6050_ACCEL_CONFIG] >> 3) & 0x03), true);
+        for (uint8_t axis = 0; axis < 3; axis++) offsets[axis] = getInt16(&file[MPU6050_XG_OFFS_USRH + 2 * axis], true);
+        addOffsets(view, MPU6050_GYRO_XOUT_H, offsets, 64 >> ((file[MPU6050_GYRO_CONFIG] >> 3) & 0x03), true);
+    }
+}
+
+static void logTransfer(const char *kind, uint8_t address, uint8_t reg, const uint8_t *data, uint8_t length) {
+    if (simI2cLog == NULL) return;
+    fprintf(simI2cLog, "%s %02x %02x", kind, address, reg);
+    for (uint8_t n = 0; n < length; n++) fprintf(simI2cLog, " %02x", data[n]);
+    fputc('\n', simI2cLog);
+}
+
+static void deviceWrite(uint8_t address, const uint8_t *data, uint8_t length) {
+    if (length == 0) return;
+    uint8_t reg = data[0];
+    logTransfer("write", address, reg, &data[1], length - 1);
+    pointers[address] = reg;
+    for (uint8_t n = 1; n < length; n++) {
+        if (kinds[address] == DEVICE_MPU6050 && pointers[address] == MPU6050_PWR_MGMT_1 && (data[n] & 0x80)) {
+            resetDevice(address);
+            continue;
+        }
+        registers[address][pointers[address]++] = data[n];
+    }
+}
+
+static void deviceRead(uint8_t address, uint8_t *data, uint8_t length) {
+    uint8_t reg = pointers[address];
+    uint8_t view[REGISTERS];
+
+    if (traceCursor != NULL) {
+        int32_t *cursor = &traceCursor[address * REGISTERS + reg];
+        if (*cursor >= 0) {
+            *cursor = trace[*cursor].next;
+            memcpy(&registers[address][reg], trace[*cursor].data, trace[*cursor].length);
+        }
+    }
+    readView(address, view);
+    for (uint8_t n = 0; n < length; n++) data[n] = view[(uint8_t)(reg + n)];
+    pointers[address] = reg + length;
+    logTransfer("read", address, reg, data, length);
+}
+
+static void busTime(uint16_t bytes) {
+    simAdvance((uint64_t)bytes * I2C_BYTE_BITS * 1000000000ULL / clockHz);
+}
+
+uint8_t simI2cRegister(uint8_t address, uint8_t reg) {
+    setupDevices();
+    return registers[address & 0x7F][reg];
+}
+
+/** Load the recorded register reads and ADC levels
+ * @return False if the file cannot be read or has a bad line
+ */
+bool simLoadTrace(const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[512];
+    uint32_t lineNumber = 0;
+
+    if (file == NULL) return false;
+    setupDevices();
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char kind[8];
+        int consumed;
+        unsigned address, reg;
+
+        lineNumber++;
+        if (sscanf(line, " %7s%n", kind, &consumed) != 1 || kind[0] == '#') continue;
+        char *rest = line + consumed;
+        if (strcmp(kind, "adc") == 0) {
+            unsigned channel, level;
+            if (sscanf(rest, "%u %u", &channel, &level) != 2) break;
+            simSetAdcLevel(channel, level);
+            continue;
+        }
+        if (strcmp(kind, "write") == 0) continue;
+        if (strcmp(kind, "read") != 0 || sscanf(rest, "%x %x%n", &address, &reg, &consumed) != 2 || address >= DEVICES) break;
+        rest += consumed;
+
+        TraceRead record;
+        unsigned value;
+        record.address = address;
+        record.reg = reg;
+        record.length = 0;
+        while (record.length < TRACE_MAX_BYTES && sscanf(rest, "%x%n", &value, &consumed) == 1) {
+            record.data[record.length++] = value;
+            rest += consumed;
+        }
+        if (record.length == 0 || reg + record.length > REGISTERS) break;
+
+        trace = (TraceRead *)realloc(trace, (traceLength + 1) * sizeof(TraceRead));
+        trace[traceLength++] = record;
+    }
+    bool ok = feof(file);
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "%s:%u: bad trace line\n", path, (unsigned)lineNumber);
+        return false;
+    }
+
+    // link the reads of each register into a ring, cursors on the last so the first read takes the first
+    traceCursor = (int32_t *)malloc(DEVICES * REGISTERS * sizeof(int32_t));
+    for (int32_t n = 0; n < DEVICES * REGISTERS; n++) traceCursor[n] = -1;
+    for (int32_t n = 0; n < traceLength; n++) {
+        int32_t *cursor = &traceCursor[trace[n].address * REGISTERS + trace[n].reg];
+        if (*cursor < 0) {
+            trace[n].next = n;
+        } else {
+            trace[n].next = trace[*cursor].next;
+            trace[*cursor].next = n;
+        }
+        *cursor = n;
+    }
+    return true;
+}
+
+void TwoWire::begin() {
+    setupDevices();
+    txLength = rxIndex = rxLength = 0;
+}
+
+void TwoWire::setClock(uint32_t clock) {
+    clockHz = clock;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    txAddress = address & 0x7F;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if (txLength >= BUFFER_LENGTH) return 0;
+    txBuffer[txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity) {
+    size_t n = 0;
+    while (n < quantity && write(data[n])) n++;
+    return n;
+}
+
+/** Send the bytes queued since beginTransmission()
+ * @return 0 on success, 2 if no device answered its address
+ */
+uint8_t TwoWire::endTransmission(uint8_t sendStop) {
+    (void)sendStop;
+    setupDevices();
+    busTime(1 + txLength);
+    if (kinds[txAddress] == DEVICE_NONE) return 2;
+    deviceWrite(txAddress, txBuffer, txLength);
+    txLength = 0;
+    return 0;
+}
+
+/** Read quantity bytes from the register pointer on
+ * @return Number of bytes read, 0 if no device answered its address
+ */
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop) {
+    (void)sendStop;
+    setupDevices();
+    address &= 0x7F;
+    if (quantity > BUFFER_LENGTH) quantity = BUFFER_LENGTH;
+    rxIndex = rxLength = 0;
+    if (kinds[address] == DEVICE_NONE) {
+        busTime(1);
+        return 0;
+    }
+    busTime(1 + quantity);
+    deviceRead(address, rxBuffer, quantity);
+    rxLength = quantity;
+    return quantity;
+}
+
+int TwoWire::available() {
+    return rxLength - rxIndex;
+}
+
+int TwoWire::read() {
+    return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+}
+
+int TwoWire::peek() {
+    return rxIndex < rxLength ? rxBuffer[rxIndex] : -1;
+}
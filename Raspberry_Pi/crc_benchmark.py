@@ -0,0 +1,66 @@
+#!/usr/bin/python3
+
+# Frame CRC benchmark: CRC-16/CCITT-FALSE over full-size frame bodies three ways
+#   bitwise   the pure Python loop serial_frames.py used before
+#   table     pure Python, one 256-entry table lookup per byte
+#   binascii  binascii.crc_hqx, what serial_frames.crc16() uses now
+# Prints MB/s and frames/s for each and checks they agree. For comparison the
+# link delivers at most 11520 bytes/s (115200 baud).
+
+import os
+import sys
+import time
+import binascii
+
+import serial_frames
+
+BODY_LENGTH = 4 + serial_frames.MAX_PAYLOAD # type, length, sequence and a full payload
+FRAMES = 2000
+
+def crc16_bitwise(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+def make_table():
+    table = []
+    for byte in range(256):
+        table.append(crc16_bitwise(bytes([byte]), 0))
+    return table
+
+TABLE = make_table()
+
+def crc16_table(data, crc=0xFFFF):
+    for byte in data:
+        crc = ((crc << 8) & 0xFFFF) ^ TABLE[(crc >> 8) ^ byte]
+    return crc
+
+def crc16_binascii(data, crc=0xFFFF):
+    return binascii.crc_hqx(data, crc)
+
+def run(name, crc, bodies):
+    start = time.perf_counter()
+    results = [ crc(body) for body in bodies ]
+    elapsed = time.perf_counter() - start
+    total = len(bodies) * BODY_LENGTH
+    print("%-9s %9.3f MB/s %10.0f frames/s" % (name, total / elapsed / 1e6, len(bodies) / elapsed))
+    return results
+
+def main():
+    frames = int(sys.argv[1]) if len(sys.argv) > 1 else FRAMES
+    bodies = [ os.urandom(BODY_LENGTH) for _ in range(frames) ]
+    print(frames, "frames of", BODY_LENGTH, "bytes")
+    reference = run("bitwise", crc16_bitwise, bodies)
+    same = run("table", crc16_table, bodies) == reference
+    same = run("binascii", crc16_binascii, bodies) == reference and same
+    same = crc16_binascii(b'123456789') == 0x29B1 and same # the CRC-16/CCITT-FALSE check value
+    print("CRCs match" if same else "CRC MISMATCH")
+    return 0 if same else 1
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -8,6 +8,8 @@ import socket
 import base64
 import pickle
 
+from serial_frames import FrameReader, negotiate, sample_rate
+
 N = 128
 count = 1
 
@@ -15,24 +17,6 @@ danceMove = "number7"
 dancer = "jin"
 SAVEPATH = os.path.join("dataset", "RawData", dancer, danceMove + ".txt")
 
-def readLineCR(port):
-    rv = ""
-    while True:
-        ch = port.read().decode()
-        rv += ch
-        if ch == "\r" or ch == "":
-            return rv
-        
-def testReadLineCR(port):
-    read_flag = 1
-    rv = ""
-    while (read_flag == 1):
-        ch = port.read()
-        rv += ch
-        if ch == "\r":
-            data = rv
-            read_flag = 0
-
 handshake_flag = False
 data_flag = False
 print("test")
@@ -43,6 +27,10 @@ port.reset_output_buffer()
 #port.flushInput()
 #port.flushOutput()
 
+hello = negotiate(port) # None from firmware without session negotiation
+if hello is not None:
+    print("firmware %d.%d, %.1f samples/s" % (hello.firmware >> 8, hello.firmware & 0xFF, sample_rate(hello)))
+
 while (handshake_flag == False):
     port.write("H".encode())
     print("H sent")
@@ -57,6 +45,7 @@ while (handshake_flag == False):
     else:
         time.sleep(0.5)
     
+frameReader = FrameReader(port)
 print("connected")
 #port.flush() #waits till all in buffer is written then flush
 
@@ -64,9 +53,10 @@ while (data_flag == False):
     print("ENTERING")
     with open(SAVEPATH, "a") as txtfile:
         for i in range(N): # print from 0->127 = 128 sets of readings
-            data = readLineCR(port)
-            data = data.split(",")[0:9] # extract acc1[3], acc2[3] and gyro[3] values
-            data = [ val.strip() for val in data ]
+            data = frameReader.read_sample()
+            if data is None:
+                continue
+            data = [ "%.2f" % val for val in data[0:9] ] # extract acc1[3], acc2[3] and gyro[3] values
             output = "\t".join(data) + "\n"
             # output = output.replace(' ', '').replace(',', '\t').replace('[', '').replace(']', '')
             txtfile.write(output)
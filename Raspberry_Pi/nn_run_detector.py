@@ -23,6 +23,8 @@ from obspy.signal.filter import highpass
 from scipy.signal import savgol_filter
 from scipy.fftpack import fft, ifft, rfft
 from keras.models import load_model
+
+from serial_frames import FrameReader
 from scipy.stats import entropy
 
 # Fix seed value for reproducibility
@@ -200,16 +202,6 @@ def predict_dance_move(segment):
         traceback.print_exc()
         print("Error in predicting dance move!")
 
-def readLineCR(port):
-    rv = ""
-    while True:
-        ch = port.read().decode()
-        rv += ch
-        # print("I'm reading " + ch)
-        if ch == "\r" or ch == "":
-        # if ch == "\r":
-            return rv
-
 def inputData():
     #'#action | voltage | current | power | cumulativepower|'
     action = str(input('Manually enter data: '))
@@ -285,6 +277,7 @@ while (handshake_flag == False):
 
 port.reset_input_buffer()
 port.reset_output_buffer()
+frameReader = FrameReader(port)
 print("connected")
 
 countMovesSent = 0
@@ -302,11 +295,10 @@ while (data_flag == False):
         else:
             ite = N
         for i in range(ite): # extract from 0->N-1 = N sets of readings
-            data = readLineCR(port).split(',')
+            data = frameReader.read_sample() # None on timeout, frames failing the CRC are skipped
             print(data)
-            if not len(data) == 13:
+            if data is None:
                continue
-            data = [ float(val.strip()) for val in data ]
             movementData.append(data[:9]) # extract acc1[3], and acc2[3] values
             otherData.append(data[9:]) # extract voltage, current, power and cumulative power
     except:
@@ -364,6 +356,7 @@ while (data_flag == False):
             sendToServer(s, output)
             port.reset_input_buffer()
             port.reset_output_buffer()
+            frameReader.reset()
             print("Sent to server: " + str(output) + ".")
             danceMoveBuffer = []
             stoptime = int(round(time.time() * 1000))
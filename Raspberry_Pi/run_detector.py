@@ -25,6 +25,8 @@ from scipy.fftpack import fft, ifft, rfft
 from scipy.stats import entropy
 # from keras.models import load_model
 
+from serial_frames import FrameReader
+
 # Fix seed value for reproducibility
 np.random.seed(1234)
 
@@ -201,31 +203,6 @@ def predict_dance_move(segment):
         traceback.print_exc()
         print("Error in predicting dance move!")
 
-def readLineCR(port):
-    rv = ""
-    while True:
-        ch = port.read().decode()
-        rv += ch
-        # print("I'm reading " + ch)
-        # if ch == "\r" or ch == "":
-        if ch == "\r":
-            return rv
-
-def compute_checksum(data, correct_cs):
-    correct_cs = correct_cs.strip()
-    cs = 0
-    for i in range(len(data)):
-        cs += ord(data[i]) #to get ASCII value of each char
-    if (cs == int(correct_cs)):
-        # print("Packet OK")
-        return True
-    else:
-        print("Bad Checksum")
-        print(data)
-        print(cs)
-        print("correct cs: " + correct_cs)
-        return False
-
 def inputData():
     #'#action | voltage | current | power | cumulativepower|'
     action = str(input('Manually enter data: '))
@@ -301,6 +278,7 @@ while (handshake_flag == False):
 
 port.reset_input_buffer()
 port.reset_output_buffer()
+frameReader = FrameReader(port)
 print("connected")
 
 countMovesSent = 0
@@ -309,8 +287,6 @@ ite = N
 while (data_flag == False):
 
     # print("ENTERING")
-    cs = False
-    checksum_data = []
     movementData = []
     otherData = []
     try:
@@ -319,17 +295,9 @@ while (data_flag == False):
         else:
             ite = N
         for i in range(ite): # extract from 0->N-1 = N sets of readings
-            checksum_data = readLineCR(port)
-            #if not len(data) == 13:
-            #   print("Corrupt packet!")
-               # print(data)
-            #   continue
-            checksum_data, correct_checksum = checksum_data.rsplit(',' , 1)
-            cs = compute_checksum(checksum_data, correct_checksum)
-            if cs:
-                data = checksum_data.split(',')
+            data = frameReader.read_sample() # None on timeout, frames failing the CRC are skipped
+            if data is not None:
                 # print(data)
-                data = [ float(val.strip()) for val in data ]
                 movementData.append(data[:9]) # extract acc1[3], and acc2[3] values
                 otherData.append(data[9:]) # extract voltage, current, power and cumulative power
     except:
@@ -387,6 +355,7 @@ while (data_flag == False):
             sendToServer(s, output)
             port.reset_input_buffer()
             port.reset_output_buffer()
+            frameReader.reset()
             print("Sent to server: " + str(output) + ".")
             danceMoveBuffer = []
             stoptime = int(round(time.time() * 1000))
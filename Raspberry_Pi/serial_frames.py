@@ -0,0 +1,548 @@
+#!/usr/bin/python3
+
+# Decoder (and encoder, for testing) for the binary frames sent by the Mega.
+# Frame layout, see Arduino_Mega/input_raw_data/SensorFrame/SensorFrame.h:
+#
+#   0xAA 0x55 | type (1) | payload length (1) | sequence (2) | payload | CRC-16 (2)
+#
+# All multi-byte fields are little-endian. The CRC is CRC-16/CCITT-FALSE over
+# type, length, sequence and payload.
+
+import binascii
+import re
+import struct
+import time
+from collections import deque, namedtuple
+
+SYNC = b'\xaa\x55'
+HEADER = struct.Struct('<BBH') # type, payload length, sequence
+CRC = struct.Struct('<H')
+MAX_PAYLOAD = 240
+
+TYPE_SAMPLES = 0x01
+TYPE_TIMED_SAMPLES = 0x02
+TYPE_ORIENTATION = 0x03
+TYPE_DMP_SAMPLES = 0x04
+TYPE_CHANNELS = 0x05
+TYPE_FEATURES = 0x06
+TYPE_HELLO = 0x07
+# flag on SAMPLES, TIMED_SAMPLES and DMP_SAMPLES: the first sample is in full,
+# every later field is the zigzag varint of its change from the sample before
+TYPE_DELTA = 0x80
+
+# acc1[3], acc2[3], gyro[3] as raw counts, then voltage (mV), current (uA),
+# power (uW) and energy (uJ) as unsigned integers
+SAMPLE = struct.Struct('<9h2H2I')
+# the same preceded by the micros() timestamp of the MPU6050 data-ready interrupt
+TIMED_SAMPLE = struct.Struct('<I9h2H2I')
+
+# micros() timestamp and the fused orientation quaternion w, x, y, z
+ORIENTATION = struct.Struct('<I4h')
+ORIENTATION_SCALE = 16384.0
+
+# a timed sample followed by the DMP quaternion w, x, y, z and the linear
+# acceleration x, y, z (gravity removed)
+DMP_SAMPLE = struct.Struct('<I9h2H2I4h3h')
+LINEAR_ACCEL_SCALE = 8192.0 # counts per g
+
+# CHANNELS frames: micros() timestamp and a mask of the channels present, then
+# the fields of each present channel in bit order. Each channel has its own rate.
+CHANNELS_HEADER = struct.Struct('<IB')
+CHANNEL_ACCEL_A = 0
+CHANNEL_ACCEL_B = 1
+CHANNEL_GYRO = 2
+CHANNEL_POWER = 3
+CHANNEL_FIELDS = [
+    struct.Struct('<3h'), # acc1 raw counts
+    struct.Struct('<3h'), # acc2 raw counts
+    struct.Struct('<3h'), # gyro raw counts
+    struct.Struct('<2H2I'), # voltage (mV), current (uA), power (uW), energy (uJ)
+]
+MOTION_CHANNELS = (1 << CHANNEL_ACCEL_A) | (1 << CHANNEL_ACCEL_B) | (1 << CHANNEL_GYRO)
+
+# FEATURES frames: micros() timestamp of the newest sample and the window
+# length, then for acc1, acc2, gyro xyz the window mean, variance, min, max and
+# energy (mean square), in raw counts (counts^2 for variance and energy)
+FEATURES_HEADER = struct.Struct('<IB')
+FEATURE = struct.Struct('<hIhhI')
+FEATURE_CHANNELS = 9
+
+# Scale factors the classifier models were trained with (the firmware used to
+# apply these before sending). Keep them unless the models are retrained.
+ACC_SCALE = (2 - (-2)) / 1023.0
+GYRO_SCALE = (250 - (-250)) / 65535.0
+# the DMP firmware runs the gyro at +-2000 deg/s, DMP_SAMPLES gyro counts are 8x coarser
+DMP_GYRO_SCALE = (2000 - (-2000)) / 65535.0
+# mV, uA, uW, uJ to the V, mA, mW, mJ the firmware used to send as floats
+POWER_SCALE = 0.001
+# the energy field carries the low 32 bits of the Mega's 64-bit uJ total
+ENERGY_WRAP = 1 << 32
+
+# Set-up commands the Mega takes before the handshake 'H' (mega.ino)
+COMMAND_CALIBRATE = b'C' # find and store the sensor offsets, the device must lie still and level
+COMMAND_ERASE = b'E'     # forget the stored offsets
+COMMAND_DONE = b'K'
+CALIBRATE_TIMEOUT = 60.0 # seconds, calibration takes about 20
+
+# Asking the Mega to send a frame again (RESEND_FRAMES in mega.ino): the
+# request byte and the sequence number. Later frames are held back until the
+# missing one comes or RESEND_TIMEOUT passes, so frames come out in order.
+RESEND_REQUEST = b'R'
+RESEND_SEQUENCE = struct.Struct('<H')
+RESEND_TIMEOUT = 0.3 # seconds per attempt
+RESEND_ATTEMPTS = 2
+RESEND_MAX_GAP = 8 # frames asked for at once, 3 bytes each into the Mega's 32 byte receive ring
+RESEND_MAX_HELD = 32 # frames held back at most while waiting
+
+# Session negotiation before the handshake 'H': COMMAND_HELLO asks the Mega
+# what it runs, COMMAND_SESSION followed by SESSION asks for other settings.
+# The Mega answers both with a HELLO frame: what it runs, whether the session
+# was taken (a refused one changes nothing), and the session in force.
+# Old firmware does not answer at all.
+COMMAND_HELLO = b'V'
+COMMAND_SESSION = b'S'
+# handshake version, firmware version (major << 8 | minor), acquisition mode,
+# capabilities, base sample period (ms), most samples per SAMPLES frame, status
+HELLO = struct.Struct('<BHBHBBB')
+# sample divider, samples per frame, framing, divider of each CHANNELS frame channel (0 = never)
+SESSION = struct.Struct('<BBB4B')
+HELLO_TIMEOUT = 1.0 # seconds
+HANDSHAKE_VERSION = 1
+ACQ_POLL = 0
+ACQ_ADXL_FIFO = 1
+ACQ_DATA_READY = 2
+ACQ_DMP = 3
+CAP_SAMPLE_DIVIDER = 0x0001
+CAP_DELTA = 0x0002
+CAP_CHANNELS = 0x0004
+CAP_FEATURES = 0x0008
+CAP_ORIENTATION = 0x0010
+CAP_RESEND = 0x0020
+CAP_ACTIVITY_GATING = 0x0040
+CAP_OFFSETS = 0x0080
+FRAMING_SAMPLES = 0
+FRAMING_DELTA = 1
+FRAMING_CHANNELS = 2
+SESSION_ACCEPTED = 0
+SESSION_UNSUPPORTED = 1
+SESSION_OVER_LINK = 2
+
+Hello = namedtuple('Hello', [ 'version', 'firmware', 'mode', 'capabilities', 'sample_period_ms', 'max_frame_samples', 'status',
+                              'sample_divider', 'frame_samples', 'framing', 'channel_dividers' ])
+
+# CRC-16/CCITT-FALSE as SensorFrame::crc16(). binascii.crc_hqx is the same
+# CRC (poly 0x1021, MSB first, no final xor), table driven in C: some hundred
+# times faster than a bitwise loop in Python (crc_benchmark.py)
+def crc16(data, crc=0xFFFF):
+    return binascii.crc_hqx(data, crc)
+
+def encode_frame(frame_type, seq, payload):
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError("payload too long: " + str(len(payload)))
+    body = HEADER.pack(frame_type, len(payload), seq & 0xFFFF) + payload
+    return SYNC + body + CRC.pack(crc16(body))
+
+def encode_samples(seq, samples):
+    return encode_frame(TYPE_SAMPLES, seq, b''.join(SAMPLE.pack(*sample) for sample in samples))
+
+def encode_timed_samples(seq, samples):
+    return encode_frame(TYPE_TIMED_SAMPLES, seq, b''.join(TIMED_SAMPLE.pack(*sample) for sample in samples))
+
+# (bits, signed) of every field of a sample layout, in order
+def field_widths(layout):
+    widths = []
+    for count, code in re.findall(r'(\d*)([hHiI])', layout.format):
+        widths += [ (struct.calcsize(code) * 8, code.islower()) ] * int(count or 1)
+    return widths
+
+def read_varint(payload, offset):
+    value = 0
+    shift = 0
+    while True:
+        if offset >= len(payload):
+            raise ValueError("varint runs past the end of the payload")
+        byte = payload[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+def write_varint(value):
+    data = b''
+    while value >= 0x80:
+        data += bytes([ (value & 0x7F) | 0x80 ])
+        value >>= 7
+    return data + bytes([ value ])
+
+def encode_delta_payload(samples, layout=SAMPLE):
+    payload = layout.pack(*samples[0])
+    widths = field_widths(layout)
+    for previous, sample in zip(samples, samples[1:]):
+        for (bits, signed), value, last in zip(widths, sample, previous):
+            delta = (value - last) % (1 << bits)
+            if delta >= 1 << (bits - 1):
+                delta -= 1 << bits
+            payload += write_varint((delta << 1) ^ (-1 if delta < 0 else 0))
+    return payload
+
+# Inverse of encode_delta_payload, bit-exact: every difference is modulo the field width
+def decode_delta_samples(payload, layout=SAMPLE):
+    if len(payload) < layout.size:
+        raise ValueError("delta payload shorter than its keyframe: " + str(len(payload)))
+    samples = [ layout.unpack_from(payload, 0) ]
+    widths = field_widths(layout)
+    offset = layout.size
+    while offset < len(payload):
+        sample = []
+        for (bits, signed), last in zip(widths, samples[-1]):
+            zigzag, offset = read_varint(payload, offset)
+            value = (last + ((zigzag >> 1) ^ -(zigzag & 1))) % (1 << bits)
+            if signed and value >= 1 << (bits - 1):
+                value -= 1 << bits
+            sample.append(value)
+        samples.append(tuple(sample))
+    return samples
+
+def decode_samples(payload, layout=SAMPLE, delta=False):
+    if delta:
+        return decode_delta_samples(payload, layout)
+    if len(payload) % layout.size != 0:
+        raise ValueError("payload is not a whole number of samples: " + str(len(payload)))
+    return [ layout.unpack_from(payload, offset) for offset in range(0, len(payload), layout.size) ]
+
+# Returns (timestamp in microseconds, sample) pairs
+def decode_timed_samples(payload, delta=False):
+    return [ (sample[0], sample[1:]) for sample in decode_samples(payload, TIMED_SAMPLE, delta) ]
+
+def encode_dmp_samples(seq, samples):
+    return encode_frame(TYPE_DMP_SAMPLES, seq, b''.join(DMP_SAMPLE.pack(*sample) for sample in samples))
+
+# Returns (timestamp in microseconds, sample, (w, x, y, z), linear accel xyz in g) tuples
+def decode_dmp_samples(payload, delta=False):
+    return [ (sample[0], sample[1:14],
+              tuple(c / ORIENTATION_SCALE for c in sample[14:18]),
+              tuple(c / LINEAR_ACCEL_SCALE for c in sample[18:21]))
+             for sample in decode_samples(payload, DMP_SAMPLE, delta) ]
+
+# channels maps channel numbers to their field tuples
+def encode_channels(seq, timestamp, channels):
+    mask = 0
+    fields = b''
+    for channel, layout in enumerate(CHANNEL_FIELDS):
+        if channel in channels:
+            mask |= 1 << channel
+            fields += layout.pack(*channels[channel])
+    return encode_frame(TYPE_CHANNELS, seq, CHANNELS_HEADER.pack(timestamp, mask) + fields)
+
+# Returns (timestamp in microseconds, {channel: fields}) for the channels present
+def decode_channels(payload):
+    timestamp, mask = CHANNELS_HEADER.unpack_from(payload)
+    offset = CHANNELS_HEADER.size
+    channels = {}
+    for channel, layout in enumerate(CHANNEL_FIELDS):
+        if mask & (1 << channel):
+            channels[channel] = layout.unpack_from(payload, offset)
+            offset += layout.size
+    if offset != len(payload) or mask >> len(CHANNEL_FIELDS):
+        raise ValueError("payload does not match channel mask " + hex(mask))
+    return timestamp, channels
+
+def encode_features(seq, timestamp, window, features):
+    return encode_frame(TYPE_FEATURES, seq, FEATURES_HEADER.pack(timestamp, window) + b''.join(FEATURE.pack(*f) for f in features))
+
+# Returns (timestamp in microseconds, window length, [ (mean, variance, min, max, energy) per channel ])
+def decode_features(payload):
+    if len(payload) != FEATURES_HEADER.size + FEATURE_CHANNELS * FEATURE.size:
+        raise ValueError("bad features payload length: " + str(len(payload)))
+    timestamp, window = FEATURES_HEADER.unpack_from(payload)
+    features = [ FEATURE.unpack_from(payload, FEATURES_HEADER.size + channel * FEATURE.size) for channel in range(FEATURE_CHANNELS) ]
+    return timestamp, window, features
+
+def encode_orientation(seq, timestamp, quaternion):
+    return encode_frame(TYPE_ORIENTATION, seq, ORIENTATION.pack(timestamp, *[ int(round(c * ORIENTATION_SCALE)) for c in quaternion ]))
+
+# Returns (timestamp in microseconds, (w, x, y, z))
+def decode_orientation(payload):
+    fields = ORIENTATION.unpack(payload)
+    return fields[0], tuple(c / ORIENTATION_SCALE for c in fields[1:])
+
+def encode_hello(seq, hello):
+    return encode_frame(TYPE_HELLO, seq, HELLO.pack(*hello[:7]) + SESSION.pack(*(hello[7:10] + tuple(hello.channel_dividers))))
+
+def decode_hello(payload):
+    if len(payload) != HELLO.size + SESSION.size:
+        raise ValueError("bad hello payload length: " + str(len(payload)))
+    session = SESSION.unpack_from(payload, HELLO.size)
+    return Hello(*(HELLO.unpack_from(payload) + session[:3] + (session[3:],)))
+
+# Samples per second of the session a HELLO frame reports
+def sample_rate(hello):
+    return 1000.0 / (hello.sample_period_ms * hello.sample_divider)
+
+# Convert one raw sample to the 13 values the old comma separated line carried:
+# acc1[3], acc2[3], gyro[3], voltage, current, power, energy (2 decimal places,
+# like dtostrf(value, 3, 2) used to produce)
+def to_legacy_values(sample, gyro_scale=GYRO_SCALE):
+    values = [ raw * ACC_SCALE for raw in sample[0:6] ]
+    values += [ raw * gyro_scale for raw in sample[6:9] ]
+    values += [ raw * POWER_SCALE for raw in sample[9:13] ]
+    return [ round(val, 2) for val in values ]
+
+# Send one set-up command before the handshake and wait for the Mega to
+# confirm it. Returns False if no confirmation came within timeout seconds
+def send_command(port, command, timeout=CALIBRATE_TIMEOUT):
+    port.reset_input_buffer()
+    port.write(command)
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if port.read(1) == COMMAND_DONE:
+            return True
+    return False
+
+def _read_hello(reader, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        frame = reader.read_frame()
+        if frame is not None and frame[0] == TYPE_HELLO:
+            return decode_hello(frame[2])
+    return None
+
+# Ask the Mega what it runs and, for any setting given, for a new session,
+# before the handshake. Settings left as None stay as the Mega has them.
+# Returns the Mega's Hello (check status for the session asked for), or None
+# if it did not answer within timeout seconds
+def negotiate(port, sample_divider=None, frame_samples=None, framing=None, channel_dividers=None, timeout=HELLO_TIMEOUT):
+    port.reset_input_buffer()
+    reader = FrameReader(port, resend=False)
+    port.write(COMMAND_HELLO)
+    hello = _read_hello(reader, timeout)
+    if hello is None or (sample_divider, frame_samples, framing, channel_dividers) == (None, None, None, None):
+        return hello
+    session = (hello.sample_divider if sample_divider is None else sample_divider,
+               hello.frame_samples if frame_samples is None else frame_samples,
+               hello.framing if framing is None else framing)
+    session += tuple(hello.channel_dividers if channel_dividers is None else channel_dividers)
+    port.write(COMMAND_SESSION + SESSION.pack(*session))
+    return _read_hello(reader, timeout)
+
+class FrameReader:
+    '''
+    Reads frames from a serial port (anything with read(n)). Bytes are
+    discarded until the sync pattern is found, and frames failing the CRC are
+    dropped, so the reader resynchronises on its own after line noise.
+    With resend (and a port with write()), a gap in the sequence numbers is
+    asked for again and the frames after it held back until it is filled.
+    '''
+
+    def __init__(self, port, resend=True):
+        self.port = port
+        self.resend = resend and hasattr(port, 'write')
+        self.bad_frames = 0
+        self.lost_frames = 0
+        self.resend_requests = 0
+        self.recovered_frames = 0
+        self.last_seq = None
+        self.held = {} # sequence -> frame, received after a gap
+        self.missing = {} # sequence -> [time to give up on the attempt, attempts left]
+        self.last_timestamp = None # of the last sample returned, TIMED_SAMPLES frames only
+        self.orientation = None # latest (timestamp, (w, x, y, z)) from ORIENTATION frames, or of the last DMP sample returned
+        self.linear_accel = None # (x, y, z) in g of the last sample returned, DMP_SAMPLES frames only
+        self.features = None # latest (timestamp, window, per-channel stats) from FEATURES frames
+        self.hello = None # latest Hello, from HELLO frames
+        self.last_energy = None
+        self.energy_base = 0
+        # latest fields of every CHANNELS frame channel, held until the channel is sent again
+        self.channel_values = [ layout.unpack(bytes(layout.size)) for layout in CHANNEL_FIELDS ]
+        self.pending = deque()
+
+    # Forget buffered samples, e.g. after port.reset_input_buffer()
+    def reset(self):
+        self.last_seq = None
+        self.held.clear()
+        self.missing.clear()
+        self.pending.clear()
+
+    # Undo the 32-bit wrap of the energy field (every 4295 J). A small step
+    # back is the Mega restarting its count, not a wrap.
+    def _unwrap_energy(self, sample):
+        energy = sample[12]
+        if self.last_energy is not None and energy < self.last_energy:
+            if self.last_energy - energy > ENERGY_WRAP // 2:
+                self.energy_base += ENERGY_WRAP
+            else:
+                self.energy_base = 0
+        self.last_energy = energy
+        return sample[:12] + (self.energy_base + energy,) + sample[13:]
+
+    # Merge a CHANNELS frame into the held channel values. Frames carrying
+    # motion channels give one sample, with the other channels' last values.
+    def _merge_channels(self, payload):
+        timestamp, channels = decode_channels(payload)
+        for channel, fields in channels.items():
+            self.channel_values[channel] = fields
+        if not any((1 << channel) & MOTION_CHANNELS for channel in channels):
+            return []
+        sample = sum(self.channel_values, ())
+        return [ (timestamp, to_legacy_values(self._unwrap_energy(sample))) ]
+
+    def _read_exact(self, n):
+        data = b''
+        while len(data) < n:
+            chunk = self.port.read(n - len(data))
+            if not chunk:
+                return None # timeout
+            data += chunk
+        return data
+
+    def _sync(self):
+        previous = None
+        while True:
+            byte = self._read_exact(1)
+            if byte is None:
+                return False
+            if previous == SYNC[0:1] and byte == SYNC[1:2]:
+                return True
+            previous = byte
+
+    # Returns the next frame off the wire passing the CRC, in arrival order,
+    # or None on timeout
+    def _read_wire_frame(self):
+        while True:
+            if not self._sync():
+                return None
+            header = self._read_exact(HEADER.size)
+            if header is None:
+                return None
+            frame_type, length, seq = HEADER.unpack(header)
+            if length > MAX_PAYLOAD:
+                self.bad_frames += 1
+                continue
+            rest = self._read_exact(length + CRC.size)
+            if rest is None:
+                return None
+            payload = rest[:length]
+            (received_crc,) = CRC.unpack(rest[length:])
+            if crc16(header + payload) != received_crc:
+                self.bad_frames += 1
+                continue
+            return frame_type, seq, payload
+
+    def _request_resend(self, seq, attempts):
+        self.port.write(RESEND_REQUEST + RESEND_SEQUENCE.pack(seq))
+        self.missing[seq] = [time.monotonic() + RESEND_TIMEOUT, attempts - 1]
+        self.resend_requests += 1
+
+    # Ask for the frames from first up to (not including) last
+    def _request_resends(self, first, last):
+        seq = first
+        while seq != last:
+            if seq not in self.missing and seq not in self.held:
+                self._request_resend(seq, RESEND_ATTEMPTS)
+            seq = (seq + 1) & 0xFFFF
+
+    # Next held frame if it is the one due. The missing frame before it is
+    # given up on once its time is over, too many frames are held, or force
+    def _next_held(self, force=False):
+        while self.held:
+            seq = (self.last_seq + 1) & 0xFFFF
+            if seq in self.held:
+                self.last_seq = seq
+                return self.held.pop(seq)
+            if seq not in self.missing:
+                # not asked for: skip straight to the next frame held or asked for
+                following = min(list(self.held) + list(self.missing), key=lambda other: (other - seq) & 0xFFFF)
+                self.lost_frames += (following - seq) & 0xFFFF
+                self.last_seq = (following - 1) & 0xFFFF
+                continue
+            deadline, attempts = self.missing[seq]
+            if not force and len(self.held) < RESEND_MAX_HELD:
+                if time.monotonic() < deadline:
+                    return None
+                if attempts > 0: # the resend was lost too
+                    self._request_resend(seq, attempts)
+                    return None
+            del self.missing[seq]
+            self.lost_frames += 1
+            self.last_seq = seq
+        self.missing.clear()
+        return None
+
+    # Returns (type, sequence, payload), or None on timeout. Frames come out
+    # in sequence order; a lost frame is counted in lost_frames, and with
+    # resend asked for again first
+    def read_frame(self):
+        while True:
+            frame = self._next_held()
+            if frame is not None:
+                return frame
+            frame = self._read_wire_frame()
+            if frame is None:
+                if self.held:
+                    frame = self._next_held(force=True)
+                    if frame is not None:
+                        return frame
+                return None
+            seq = frame[1]
+            if self.last_seq is None:
+                self.last_seq = seq
+                return frame
+            gap = (seq - self.last_seq - 1) & 0xFFFF
+            if gap == 0 and not self.held:
+                self.last_seq = seq
+                return frame
+            if gap < 0x8000:
+                if seq in self.missing:
+                    self.recovered_frames += 1
+                    del self.missing[seq]
+                elif self.resend and gap <= RESEND_MAX_GAP:
+                    self._request_resends((self.last_seq + 1) & 0xFFFF, seq)
+                # frames not asked for are counted lost once this one is due
+                self.held[seq] = frame
+                continue
+            if gap >= 0x10000 - RESEND_MAX_GAP - RESEND_MAX_HELD:
+                continue # a resend that came too late, or a repeat
+            # the Mega restarted
+            self.held.clear()
+            self.missing.clear()
+            self.last_seq = seq
+            return frame
+
+    # Returns the next sample as a list of legacy values, or None on timeout.
+    # A frame may carry several samples (PKT_SIZE on the Mega); the extra ones
+    # are handed out by the following calls. CHANNELS frames give one sample per
+    # frame with motion data, channels not in the frame keeping their last values.
+    # For TIMED_SAMPLES, DMP_SAMPLES and CHANNELS frames the sample's timestamp
+    # is left in last_timestamp, and for
+    # DMP_SAMPLES its quaternion and linear acceleration in orientation and
+    # linear_accel. ORIENTATION and FEATURES frames read on the way update
+    # orientation and features, and HELLO frames hello.
+    def read_sample(self):
+        while not self.pending:
+            frame = self.read_frame()
+            if frame is None:
+                return None
+            frame_type, seq, payload = frame
+            delta = bool(frame_type & TYPE_DELTA)
+            frame_type &= ~TYPE_DELTA
+            if frame_type == TYPE_SAMPLES:
+                self.pending.extend((None, to_legacy_values(self._unwrap_energy(sample))) for sample in decode_samples(payload, SAMPLE, delta))
+            elif frame_type == TYPE_TIMED_SAMPLES:
+                self.pending.extend((timestamp, to_legacy_values(self._unwrap_energy(sample))) for timestamp, sample in decode_timed_samples(payload, delta))
+            elif frame_type == TYPE_DMP_SAMPLES:
+                self.pending.extend((timestamp, to_legacy_values(self._unwrap_energy(sample), DMP_GYRO_SCALE), quaternion, linear_accel)
+                                    for timestamp, sample, quaternion, linear_accel in decode_dmp_samples(payload, delta))
+            elif frame_type == TYPE_CHANNELS:
+                self.pending.extend(self._merge_channels(payload))
+            elif frame_type == TYPE_ORIENTATION:
+                self.orientation = decode_orientation(payload)
+            elif frame_type == TYPE_FEATURES:
+                self.features = decode_features(payload)
+            elif frame_type == TYPE_HELLO:
+                self.hello = decode_hello(payload)
+        entry = self.pending.popleft()
+        self.last_timestamp, values = entry[0], entry[1]
+        if len(entry) > 2:
+            self.orientation = (entry[0], entry[2])
+            self.linear_accel = entry[3]
+        return values
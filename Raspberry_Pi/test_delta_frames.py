@@ -0,0 +1,174 @@
+#!/usr/bin/python3
+
+# Delta coded frames from the Mega's own encoder against serial_frames.py:
+# SensorFrame.cpp is compiled with g++ into a small frame writer packing
+# samples the way mega.ino does (keyframe, then putDelta16/putDelta32 of every
+# field), and each frame it writes must be byte for byte the one
+# encode_delta_payload() builds and decode back to the samples given.
+# Skipped without g++.
+#
+#     python3 test_delta_frames.py
+
+import os
+import random
+import re
+import shutil
+import subprocess
+import tempfile
+import unittest
+
+from serial_frames import *
+from test_serial_frames import FakePort
+
+SENSORFRAME_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'Arduino_Mega', 'input_raw_data', 'SensorFrame')
+
+# Reads "<type> <sequence> <field codes> <values...>" lines, one frame each, and
+# writes the frame in hex, or "full" if the samples did not fit
+WRITER_SOURCE = r'''
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SensorFrame.h"
+
+int main() {
+    static char line[65536];
+    SensorFrame frame;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        unsigned type, sequence;
+        char codes[64];
+        int used;
+        if (sscanf(line, "%x %u %63s%n", &type, &sequence, codes, &used) != 3) return 1;
+
+        const char *values = line + used;
+        size_t fields = strlen(codes);
+        uint32_t previous[64];
+        long long value;
+        bool ok = true;
+        frame.begin(type, sequence);
+        for (size_t n = 0; sscanf(values, "%lld%n", &value, &used) == 1; n++, values += used) {
+            size_t field = n % fields;
+            bool wide = codes[field] == 'i' || codes[field] == 'I';
+            uint32_t current = (uint32_t)value;
+            if (n < fields) {
+                if (wide) ok &= frame.putUInt32(current);
+                else if (codes[field] == 'h') ok &= frame.putInt16((int16_t)current);
+                else ok &= frame.putUInt16((uint16_t)current);
+            } else if (wide) {
+                ok &= frame.putDelta32(current, previous[field]);
+            } else {
+                ok &= frame.putDelta16((uint16_t)current, (uint16_t)previous[field]);
+            }
+            previous[field] = current;
+        }
+        frame.finish();
+        if (!ok) {
+            puts("full");
+            continue;
+        }
+        for (uint16_t n = 0; n < frame.getLength(); n++) printf("%02x", frame.getData()[n]);
+        putchar('\n');
+    }
+    return 0;
+}
+'''
+
+def field_codes(layout):
+    return ''.join(code * int(count or 1) for count, code in re.findall(r'(\d*)([hHiI])', layout.format))
+
+def extremes(layout):
+    '''Samples stepping every field across its whole range and back: the widest differences, and wraps'''
+    lows, highs, zeros = [], [], []
+    for code in field_codes(layout):
+        bits = 16 if code in 'hH' else 32
+        low, high = (-(1 << (bits - 1)), (1 << (bits - 1)) - 1) if code.islower() else (0, (1 << bits) - 1)
+        lows.append(low)
+        highs.append(high)
+        zeros.append(0)
+    halfway = [ high // 2 + 1 for high in highs ] # signed: the top value + 1, wraps round to the bottom
+    return [ tuple(lows), tuple(highs), tuple(zeros), tuple(lows), tuple(halfway), tuple(highs), tuple(lows) ]
+
+def random_walk(layout, rng, count):
+    '''Samples with small changes around random values, some fields jumping far'''
+    codes = field_codes(layout)
+    sample = [ rng.randrange(-(1 << 15), 1 << 15) if code == 'h' else
+               rng.randrange(1 << 16) if code == 'H' else
+               rng.randrange(-(1 << 31), 1 << 31) if code == 'i' else
+               rng.randrange(1 << 32) for code in codes ]
+    samples = [ tuple(sample) ]
+    for _ in range(count - 1):
+        for n, code in enumerate(codes):
+            bits = 16 if code in 'hH' else 32
+            step = rng.randrange(-(1 << (bits - 1)), 1 << (bits - 1)) if rng.random() < 0.05 else rng.randrange(-300, 301)
+            value = (sample[n] + step) % (1 << bits)
+            if code.islower() and value >= 1 << (bits - 1):
+                value -= 1 << bits
+            sample[n] = value
+        samples.append(tuple(sample))
+    return samples
+
+def split_frames(samples, layout):
+    '''Consecutive samples as full as a frame holds them, like mega.ino closing a frame when full'''
+    frames, current = [], []
+    for sample in samples:
+        if current and len(encode_delta_payload(current + [ sample ], layout)) > MAX_PAYLOAD:
+            frames.append(current)
+            current = []
+        current.append(sample)
+    return frames + [ current ]
+
+@unittest.skipUnless(shutil.which('g++'), 'needs g++ to build the Mega encoder')
+class DeltaCompatibilityTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = tempfile.TemporaryDirectory()
+        source = os.path.join(cls.directory.name, 'frame_writer.cpp')
+        cls.writer = os.path.join(cls.directory.name, 'frame_writer')
+        with open(source, 'w') as output:
+            output.write(WRITER_SOURCE)
+        subprocess.check_call([ 'g++', '-O1', '-I', SENSORFRAME_DIR, '-o', cls.writer, source,
+                                os.path.join(SENSORFRAME_DIR, 'SensorFrame.cpp') ])
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.directory.cleanup()
+
+    def write_frames(self, frame_type, layout, frames):
+        lines = ''.join('%x %d %s %s\n' % (frame_type, seq, field_codes(layout), ' '.join(str(value) for sample in samples for value in sample))
+                        for seq, samples in enumerate(frames))
+        output = subprocess.run([ self.writer ], input=lines, stdout=subprocess.PIPE, universal_newlines=True, check=True)
+        return output.stdout.split()
+
+    def check(self, frame_type, layout, frames):
+        written = self.write_frames(frame_type | TYPE_DELTA, layout, frames)
+        self.assertEqual(len(written), len(frames))
+        for seq, (samples, data) in enumerate(zip(frames, written)):
+            self.assertNotEqual(data, 'full')
+            data = bytes.fromhex(data)
+            self.assertEqual(data, encode_frame(frame_type | TYPE_DELTA, seq, encode_delta_payload(samples, layout)))
+            reader = FrameReader(FakePort(data))
+            read_type, read_seq, payload = reader.read_frame()
+            self.assertEqual((read_type, read_seq, reader.bad_frames), (frame_type | TYPE_DELTA, seq, 0))
+            self.assertEqual(decode_delta_samples(payload, layout), samples)
+
+    def test_extremes(self):
+        for frame_type, layout in ((TYPE_SAMPLES, SAMPLE), (TYPE_TIMED_SAMPLES, TIMED_SAMPLE), (TYPE_DMP_SAMPLES, DMP_SAMPLE)):
+            with self.subTest(layout=layout.format):
+                self.check(frame_type, layout, split_frames(extremes(layout), layout))
+
+    def test_one_step_wraps(self):
+        # -32768 - 1 and 0xFFFFFFFF + 1 as the Mega sees them: one count, not the whole range
+        first = (-32768, 32767, 0, 0, 0, 0, 0, 0, 0, 0, 65535, 0, 0xFFFFFFFF)
+        second = (32767, -32768, -1, 1, 0, 0, 0, 0, 0, 65535, 0, 0xFFFFFFFF, 0)
+        self.check(TYPE_SAMPLES, SAMPLE, [ [ first, second, first ] ])
+        payload = encode_delta_payload([ first, second ], SAMPLE)
+        self.assertEqual(len(payload), SAMPLE.size + len(first)) # every change fits one varint byte
+
+    def test_random_walks(self):
+        rng = random.Random(18)
+        for frame_type, layout in ((TYPE_SAMPLES, SAMPLE), (TYPE_TIMED_SAMPLES, TIMED_SAMPLE), (TYPE_DMP_SAMPLES, DMP_SAMPLE)):
+            with self.subTest(layout=layout.format):
+                self.check(frame_type, layout, split_frames(random_walk(layout, rng, 500), layout))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,195 @@
+#!/usr/bin/python3
+
+# Unit tests for serial_frames.py: every frame type through encode, the wire
+# and FrameReader, plus the reader's recovery from bad CRCs, line noise,
+# sequence wrap and the energy counter wrap.
+#
+#     python3 test_serial_frames.py
+
+import random
+import unittest
+
+from serial_frames import *
+
+class FakePort:
+    '''Serial port stand-in: read() hands out the bytes given, then times out.'''
+
+    def __init__(self, data=b''):
+        self.data = bytearray(data)
+        self.written = b''
+
+    def read(self, n=1):
+        chunk = bytes(self.data[:n])
+        del self.data[:n]
+        return chunk
+
+    def reset_input_buffer(self):
+        self.data.clear()
+
+class WritablePort(FakePort):
+    def write(self, data):
+        self.written += data
+
+SAMPLE_A = (100, -200, 300, -32768, 32767, 0, 1500, -1500, 7, 3700, 250, 925000, 4294967295)
+SAMPLE_B = (101, -198, 290, 32767, -32768, 1, 1490, -1510, 9, 3699, 251, 925111, 5)
+
+def read_all(reader):
+    frames = []
+    while True:
+        frame = reader.read_frame()
+        if frame is None:
+            return frames
+        frames.append(frame)
+
+class RoundTripTest(unittest.TestCase):
+    def read_one(self, data):
+        reader = FrameReader(FakePort(data))
+        frame = reader.read_frame()
+        self.assertIsNotNone(frame)
+        self.assertIsNone(reader.read_frame())
+        self.assertEqual(reader.bad_frames, 0)
+        return frame
+
+    def test_samples(self):
+        frame_type, seq, payload = self.read_one(encode_samples(7, [ SAMPLE_A, SAMPLE_B ]))
+        self.assertEqual((frame_type, seq), (TYPE_SAMPLES, 7))
+        self.assertEqual(decode_samples(payload), [ SAMPLE_A, SAMPLE_B ])
+
+    def test_delta_samples(self):
+        samples = [ SAMPLE_A, SAMPLE_B, SAMPLE_A ]
+        frame_type, seq, payload = self.read_one(encode_frame(TYPE_SAMPLES | TYPE_DELTA, 8, encode_delta_payload(samples)))
+        self.assertEqual(frame_type, TYPE_SAMPLES | TYPE_DELTA)
+        self.assertEqual(decode_samples(payload, SAMPLE, delta=True), samples)
+
+    def test_timed_samples(self):
+        samples = [ (0xFFFFFFF0,) + SAMPLE_A, (0x10,) + SAMPLE_B ]
+        frame_type, seq, payload = self.read_one(encode_timed_samples(9, samples))
+        self.assertEqual(frame_type, TYPE_TIMED_SAMPLES)
+        self.assertEqual(decode_timed_samples(payload), [ (s[0], s[1:]) for s in samples ])
+        delta = encode_delta_payload(samples, TIMED_SAMPLE)
+        self.assertEqual(decode_timed_samples(delta, delta=True), [ (s[0], s[1:]) for s in samples ])
+
+    def test_orientation(self):
+        frame_type, seq, payload = self.read_one(encode_orientation(10, 123456, (1.0, -0.5, 0.25, 0.0)))
+        self.assertEqual(frame_type, TYPE_ORIENTATION)
+        self.assertEqual(decode_orientation(payload), (123456, (1.0, -0.5, 0.25, 0.0)))
+
+    def test_dmp_samples(self):
+        samples = [ (1000,) + SAMPLE_A + (16384, 0, -8192, 4096, 8192, -8192, 0),
+                    (21000,) + SAMPLE_B + (16383, 1, -8191, 4095, 8190, -8190, 2) ]
+        frame_type, seq, payload = self.read_one(encode_dmp_samples(11, samples))
+        self.assertEqual(frame_type, TYPE_DMP_SAMPLES)
+        decoded = decode_dmp_samples(payload)
+        self.assertEqual(decoded[0], (1000, SAMPLE_A, (1.0, 0.0, -0.5, 0.25), (1.0, -1.0, 0.0)))
+        self.assertEqual(decode_dmp_samples(encode_delta_payload(samples, DMP_SAMPLE), delta=True), decoded)
+        reader = FrameReader(FakePort(encode_dmp_samples(11, samples)))
+        self.assertEqual(reader.read_sample(), to_legacy_values(SAMPLE_A, DMP_GYRO_SCALE)) # +-2000 deg/s gyro counts
+        self.assertEqual((reader.last_timestamp, reader.orientation, reader.linear_accel), (1000, (1000, decoded[0][2]), decoded[0][3]))
+
+    def test_channels(self):
+        channels = { CHANNEL_ACCEL_B: (1, 2, 3), CHANNEL_POWER: (3700, 250, 925000, 12345) }
+        frame_type, seq, payload = self.read_one(encode_channels(12, 999, channels))
+        self.assertEqual(frame_type, TYPE_CHANNELS)
+        self.assertEqual(decode_channels(payload), (999, channels))
+
+    def test_features(self):
+        features = [ (n - 4, n * 1000, -n, n, n * n) for n in range(FEATURE_CHANNELS) ]
+        frame_type, seq, payload = self.read_one(encode_features(13, 5555, 64, features))
+        self.assertEqual(frame_type, TYPE_FEATURES)
+        self.assertEqual(decode_features(payload), (5555, 64, features))
+
+    def test_hello(self):
+        hello = Hello(HANDSHAKE_VERSION, 0x0100, ACQ_POLL, CAP_CHANNELS | CAP_RESEND, 15, 8,
+                      SESSION_ACCEPTED, 2, 1, FRAMING_CHANNELS, (1, 1, 1, 50))
+        frame_type, seq, payload = self.read_one(encode_hello(14, hello))
+        self.assertEqual(frame_type, TYPE_HELLO)
+        self.assertEqual(decode_hello(payload), hello)
+
+    def test_read_sample(self):
+        reader = FrameReader(FakePort(encode_samples(0, [ SAMPLE_B, SAMPLE_A ]) + encode_timed_samples(1, [ (77,) + SAMPLE_A ]) +
+                                      encode_channels(2, 88, { CHANNEL_GYRO: (10, 20, 30) })))
+        self.assertEqual(reader.read_sample(), to_legacy_values(SAMPLE_B))
+        self.assertEqual(reader.read_sample(), to_legacy_values(SAMPLE_A))
+        self.assertIsNone(reader.last_timestamp)
+        self.assertEqual(reader.read_sample(), to_legacy_values(SAMPLE_A))
+        self.assertEqual(reader.last_timestamp, 77)
+        self.assertEqual(reader.read_sample()[6:9], [ round(v * GYRO_SCALE, 2) for v in (10, 20, 30) ])
+        self.assertEqual(reader.last_timestamp, 88)
+        self.assertIsNone(reader.read_sample())
+
+    def test_legacy_values(self):
+        values = to_legacy_values(SAMPLE_A)
+        self.assertEqual(len(values), 13)
+        self.assertEqual(values[0:3], [ round(v * ACC_SCALE, 2) for v in SAMPLE_A[0:3] ])
+        self.assertEqual(values[6:9], [ round(v * GYRO_SCALE, 2) for v in SAMPLE_A[6:9] ])
+        self.assertEqual(values[9:13], [ 3.7, 0.25, 925.0, 4294967.29 ]) # V, mA, mW, mJ
+
+    def test_payload_too_long(self):
+        with self.assertRaises(ValueError):
+            encode_frame(TYPE_SAMPLES, 0, bytes(MAX_PAYLOAD + 1))
+
+class RecoveryTest(unittest.TestCase):
+    def test_crc_failure(self):
+        bad = bytearray(encode_samples(0, [ SAMPLE_A ]))
+        bad[10] ^= 0x01
+        reader = FrameReader(FakePort(bytes(bad) + encode_samples(1, [ SAMPLE_B ])))
+        frames = read_all(reader)
+        self.assertEqual(reader.bad_frames, 1)
+        self.assertEqual([ frame[1] for frame in frames ], [ 1 ])
+        self.assertEqual(decode_samples(frames[0][2]), [ SAMPLE_B ])
+
+    def test_resync_after_garbage(self):
+        # noise full of stray sync bytes, but no complete sync pattern
+        rng = random.Random(1)
+        garbage = bytes(rng.choice([ 0x00, 0xAA, 0xFF, 0x01 ]) for _ in range(200)) + SYNC[0:1]
+        data = garbage + encode_samples(0, [ SAMPLE_A ]) + garbage + encode_samples(1, [ SAMPLE_B ])
+        reader = FrameReader(FakePort(data))
+        frames = read_all(reader)
+        self.assertEqual([ decode_samples(frame[2]) for frame in frames ], [ [ SAMPLE_A ], [ SAMPLE_B ] ])
+        self.assertEqual((reader.bad_frames, reader.lost_frames), (0, 0))
+
+    def test_oversized_length(self):
+        data = SYNC + HEADER.pack(TYPE_SAMPLES, MAX_PAYLOAD + 1, 0) + encode_samples(0, [ SAMPLE_A ])
+        reader = FrameReader(FakePort(data))
+        self.assertEqual([ frame[1] for frame in read_all(reader) ], [ 0 ])
+        self.assertEqual(reader.bad_frames, 1)
+
+    def test_sequence_wrap(self):
+        data = b''.join(encode_samples(seq, [ SAMPLE_A ]) for seq in (0xFFFE, 0xFFFF, 0, 1))
+        reader = FrameReader(FakePort(data))
+        self.assertEqual([ frame[1] for frame in read_all(reader) ], [ 0xFFFE, 0xFFFF, 0, 1 ])
+        self.assertEqual(reader.lost_frames, 0)
+
+    def test_lost_frame_across_wrap(self):
+        data = b''.join(encode_samples(seq, [ SAMPLE_A ]) for seq in (0xFFFE, 0, 1))
+        reader = FrameReader(FakePort(data))
+        self.assertEqual([ frame[1] for frame in read_all(reader) ], [ 0xFFFE, 0, 1 ])
+        self.assertEqual(reader.lost_frames, 1)
+
+    def test_resend_request(self):
+        port = WritablePort(b''.join(encode_samples(seq, [ SAMPLE_A ]) for seq in (5, 7)))
+        reader = FrameReader(port)
+        self.assertEqual(reader.read_frame()[1], 5)
+        port.data += encode_samples(6, [ SAMPLE_B ])
+        self.assertEqual([ frame[1] for frame in read_all(reader) ], [ 6, 7 ])
+        self.assertEqual(port.written, RESEND_REQUEST + RESEND_SEQUENCE.pack(6))
+        self.assertEqual((reader.recovered_frames, reader.lost_frames), (1, 0))
+
+class EnergyWrapTest(unittest.TestCase):
+    def energies(self, values):
+        reader = FrameReader(FakePort())
+        return [ reader._unwrap_energy(SAMPLE_A[:12] + (energy,))[12] for energy in values ]
+
+    def test_wrap(self):
+        self.assertEqual(self.energies([ ENERGY_WRAP - 10, ENERGY_WRAP - 1, 5, 100 ]),
+                         [ ENERGY_WRAP - 10, ENERGY_WRAP - 1, ENERGY_WRAP + 5, ENERGY_WRAP + 100 ])
+
+    def test_two_wraps(self):
+        self.assertEqual(self.energies([ ENERGY_WRAP - 1, 0, ENERGY_WRAP // 2, ENERGY_WRAP - 1, 3 ])[-1], 2 * ENERGY_WRAP + 3)
+
+    def test_restart(self):
+        # a small step back is the Mega counting from 0 again, not a wrap
+        self.assertEqual(self.energies([ 5000, 6000, 10 ]), [ 5000, 6000, 10 ])
+
+if __name__ == '__main__':
+    unittest.main()